@@ -22,23 +22,38 @@
 #include "utils/u_memory.h"
 #include "utils/u_arena.h"
 #include "utils/u_scratch.h"
+#include "utils/u_hashmap.h"
+#include "utils/u_lz4.h"
+#include "utils/u_sha256.h"
+#include "utils/u_secp256k1.h"
 #include "utils/utils.h"
 #include "utils/cj.h"
+#include "ddfb_reader.h"
+#include "ddfb_builder.h"
 
 #include "uECC.h"
 
-#define LONESHA256_STATIC
-#include "vendor/lonesha256.h"
+/* DDFB_FAST_SECP256K1 selects utils/u_secp256k1.c as signature backend,
+   uECC is used on hosts without 128-bit integers. */
+#if defined(DDFB_FAST_SECP256K1) && defined(U_SECP256K1_SUPPORTED)
+  #define DDF_FAST_SECP256K1
+#endif
 
 #include "utils/utils.c"
 #include "utils/u_arena.c"
 #include "utils/u_math.c"
 #include "utils/u_memory.c"
 #include "utils/u_scratch.c"
+#include "utils/u_hashmap.c"
+#include "utils/u_lz4.c"
+#include "utils/u_sha256.c"
+#include "utils/u_secp256k1.c"
 #include "utils/u_sstream.c"
 #include "utils/u_bstream.c"
 #include "utils/utils_time.c"
 #include "utils/cj.c"
+#include "ddfb_reader.c"
+#include "ddfb_builder.c"
 
 /*
 
@@ -50,52 +65,73 @@
 
 /* https://github.com/deconz-community/ddf-tools/blob/main/packages/bundler/README.md */
 
-#ifdef _WIN32
-  #define U_PATH_MAX MAX_PATH
-  #define DIR_SEP '\\'
-  #define DIR_SEP_STR "\\"
-#else
-  #define U_PATH_MAX PATH_MAX
-  #define DIR_SEP '/'
-  #define DIR_SEP_STR "/"
-#endif
-
-#define MAX_CJ_TOKENS 32766
-#define VAL_BUF_SIZE 4096
-#define MAX_CONSTANTS 2048
-
-#define SHA256_BLOCK_LENGTH  64
-#define SHA256_DIGEST_LENGTH 32
+#define DDF_SCHEMA "devcap1.schema.json"
 
 typedef struct
 {
-  int size;
   char mtime[32]; /* 2023-01-08T17:24:24Z */
-  u8 *mem;
+  PL_MappedFile file;
 } extfile;
 
-typedef struct
-{
-    u32 tag;
-    u32 size;
-    u32 offset; /* where chunk data begins */
-} ChunkRef;
-
 typedef struct DDF_Signature
 {
     u8 compressed_pubkey[33];
     u8 serialized_signature[64];
 } DDF_Signature;
 
-/* list of generic items (without duplicates) in mem_arena */
-static u32 generic_item_cache_count;
-static unsigned long generic_item_cache[1024];
-static char ddf_base_path[U_PATH_MAX];
-static char constants_mtime[32];
-static char *constants_content;
-static unsigned constants_content_size;
+/* generic item file, mapped once and kept for following bundles */
+typedef struct
+{
+    char mtime[32];
+    PL_MappedFile file;
+} DDF_GenericItemFile;
+
+/* value of the constants.json hash table */
+typedef struct
+{
+    const char *value;
+    unsigned value_len;
+} DDF_Constant;
 
-static U_Arena mem_arena; /* for non scratch memory */
+/* list of files to bundle by create-all */
+typedef struct
+{
+    U_buffer buf; /* array of char* in mem_arena */
+    unsigned count;
+} DDF_FileList;
+
+#define DDF_SKIPPED 2 /* DDF_CreateBundle() result for non DDF files */
+#define DDF_PACK_ALIGN 64 /* bundle alignment in packs */
+#define DDF_KEYRING_VERSION 1
+#define DDF_KEYRING_MAX_KEYS 256 /* each key is prepared when loaded, ~5K with the fast backend */
+
+/* create-all work queue, shared by all worker threads */
+typedef struct
+{
+    char **paths;
+    unsigned count;
+    unsigned flags;
+    volatile long next;
+    volatile long created;
+    volatile long failed;
+} DDF_WorkQueue;
+
+typedef struct
+{
+    DDF_WorkQueue *queue;
+    void *scratch_mem;
+    PL_Thread *thread;
+} DDF_Worker;
+
+/* command line arguments of create and create-all */
+typedef struct
+{
+    unsigned jobs;
+    unsigned flags; /* DDF_CREATE_COMPRESS, DDF_CREATE_MINIFY, DDF_CREATE_INDEX */
+    const char *path;
+    const char *out_path; /* second path argument of mkdict */
+    const char *dict_path;
+} DDF_CreateArgs;
 
 static void print_hex(unsigned char *data, unsigned size)
 {
@@ -107,1508 +143,2798 @@ static void print_hex(unsigned char *data, unsigned size)
     }
 }
 
-static void DDF_PutFourCC(U_BStream *bs, const char *tag)
+/*** signature backends ******************************************************/
+
+/* Keys and signatures use the formats of uECC: 32 byte private keys,
+   64 byte public keys x | y, 33 byte compressed keys and 64 byte
+   signatures r | s over a 32 byte SHA-256 hash. All backends create the
+   same deterministic signatures.
+ */
+typedef struct ECC_Backend
 {
-    int i;
-    unsigned len;
+    const char *name;
+    int (*make_key)(u8 *private_key, u8 *public_key);
+    int (*compute_public_key)(const u8 *private_key, u8 *public_key);
+    void (*compress)(const u8 *public_key, u8 *compressed);
+    int (*decompress)(const u8 *compressed, u8 *public_key); /* 0 if not on the curve */
+    int (*sign)(const u8 *private_key, const u8 *hash, u8 *signature);
+    int (*verify)(const u8 *public_key, const u8 *hash, const u8 *signature);
+    /* public key with precomputed data for many verifications, see ECC_Keyring */
+    unsigned key_size;
+    int (*prepare_key)(void *key, const u8 *public_key); /* 0 if not valid */
+    int (*verify_key)(const void *key, const u8 *hash, const u8 *signature);
+} ECC_Backend;
+
+static int uECC_RNG_Callback(uint8_t *dest, unsigned size)
+{
+    if (PL_FillRandom(dest, size) == 0)
+        return 0;
+    return 1;
+}
 
-    len = U_strlen(tag);
-    U_ASSERT(len == 4);
+/* needed for uECC_sign_deterministic() */
+typedef struct SHA256_HashContext {
+    uECC_HashContext uECC;
+    U_Sha256 sha256;
+    uint8_t tmp[2 * U_SHA256_DIGEST_SIZE + U_SHA256_BLOCK_SIZE]; /* HMAC-DRBG K, V and pad */
+} SHA256_HashContext;
 
-    if (len != 4)
-        tag = "ERR0";
+static void init_SHA256(const uECC_HashContext *base) {
+    SHA256_HashContext *ctx = (SHA256_HashContext *)base;
+    U_sha256_init(&ctx->sha256);
+}
 
-    for (i = 0; i < 4; i++)
+static void update_SHA256(const uECC_HashContext *base,
+                          const uint8_t *message,
+                          unsigned message_size) {
+    SHA256_HashContext *ctx = (SHA256_HashContext *)base;
+    U_sha256_update(&ctx->sha256, message, message_size);
+}
+
+static void finish_SHA256(const uECC_HashContext *base, uint8_t *hash_result) {
+    SHA256_HashContext *ctx = (SHA256_HashContext *)base;
+    U_sha256_final(&ctx->sha256, hash_result);
+}
+
+/* The context is a few hundred bytes and lives on the stack of the caller. */
+static void ECC_InitHashContext(SHA256_HashContext *ctx) {
+    ctx->uECC.init_hash = init_SHA256;
+    ctx->uECC.update_hash = update_SHA256;
+    ctx->uECC.finish_hash = finish_SHA256;
+    ctx->uECC.block_size = U_SHA256_BLOCK_SIZE;
+    ctx->uECC.result_size = U_SHA256_DIGEST_SIZE;
+    ctx->uECC.tmp = &ctx->tmp[0];
+}
+
+static int ECC_uECC_MakeKey(u8 *private_key, u8 *public_key)
+{
+    uECC_set_rng(uECC_RNG_Callback);
+    return uECC_make_key(public_key, private_key, uECC_secp256k1());
+}
+
+static int ECC_uECC_ComputePublicKey(const u8 *private_key, u8 *public_key)
+{
+    return uECC_compute_public_key(private_key, public_key, uECC_secp256k1());
+}
+
+static void ECC_uECC_Compress(const u8 *public_key, u8 *compressed)
+{
+    uECC_compress(public_key, compressed, uECC_secp256k1());
+}
+
+static int ECC_uECC_Decompress(const u8 *compressed, u8 *public_key)
+{
+    /* uECC_decompress() doesn't check the point */
+    uECC_decompress(compressed, public_key, uECC_secp256k1());
+    return uECC_valid_public_key(public_key, uECC_secp256k1());
+}
+
+static int ECC_uECC_Sign(const u8 *private_key, const u8 *hash, u8 *signature)
+{
+    SHA256_HashContext hash_ctx;
+
+    ECC_InitHashContext(&hash_ctx);
+    return uECC_sign_deterministic(private_key, hash, U_SHA256_DIGEST_SIZE,
+                                   &hash_ctx.uECC, signature, uECC_secp256k1());
+}
+
+static int ECC_uECC_Verify(const u8 *public_key, const u8 *hash, const u8 *signature)
+{
+    return uECC_verify(public_key, hash, U_SHA256_DIGEST_SIZE, signature, uECC_secp256k1());
+}
+
+/* uECC has no precomputation, the prepared key is the decompressed key */
+static int ECC_uECC_PrepareKey(void *key, const u8 *public_key)
+{
+    if (uECC_valid_public_key(public_key, uECC_secp256k1()) != 1)
+        return 0;
+
+    U_memcpy(key, public_key, 64);
+    return 1;
+}
+
+static int ECC_uECC_VerifyKey(const void *key, const u8 *hash, const u8 *signature)
+{
+    return ECC_uECC_Verify(key, hash, signature);
+}
+
+static const ECC_Backend ecc_backend_uecc = {
+    "uECC",
+    ECC_uECC_MakeKey,
+    ECC_uECC_ComputePublicKey,
+    ECC_uECC_Compress,
+    ECC_uECC_Decompress,
+    ECC_uECC_Sign,
+    ECC_uECC_Verify,
+    64,
+    ECC_uECC_PrepareKey,
+    ECC_uECC_VerifyKey
+};
+
+#ifdef U_SECP256K1_SUPPORTED
+static int ECC_Secp256k1_MakeKey(u8 *private_key, u8 *public_key)
+{
+    /* a random value is >= n with probability 2^-128 */
+    do
     {
-        U_bstream_put_u8(bs, (u8)*tag);
-        tag++;
+        if (PL_FillRandom(private_key, U_SECP256K1_PRIVATE_KEY_SIZE) == 0)
+            return 0;
     }
+    while (U_secp256k1_compute_public_key(private_key, public_key) == 0);
+
+    return 1;
 }
 
-static int DDF_ResolveConstant(const char *constant, char *buf, unsigned bufsize)
+static int ECC_Secp256k1_PrepareKey(void *key, const u8 *public_key)
 {
-    U_ASSERT(constants_content_size > 0);
+    return U_secp256k1_prepare_key(key, public_key);
+}
 
-    cj_ctx cj;
-    cj_token *tok;
-    unsigned scratch_pos;
-    unsigned tok_pos;
-    unsigned constant_len;
+static int ECC_Secp256k1_VerifyKey(const void *key, const u8 *hash, const u8 *signature)
+{
+    return U_secp256k1_verify_key(key, hash, signature);
+}
 
-    scratch_pos = U_ScratchPos();
-    constant_len = U_strlen(constant);
-    buf[0] = '\0';
+static const ECC_Backend ecc_backend_secp256k1 = {
+    "secp256k1",
+    ECC_Secp256k1_MakeKey,
+    U_secp256k1_compute_public_key,
+    U_secp256k1_compress,
+    U_secp256k1_decompress,
+    U_secp256k1_sign,
+    U_secp256k1_verify,
+    sizeof(U_Secp256k1_Key),
+    ECC_Secp256k1_PrepareKey,
+    ECC_Secp256k1_VerifyKey
+};
+#endif
 
-    U_ASSERT(constant_len > 0);
+/* The first entry is used for keygen, sign and verify. */
+static const ECC_Backend *ecc_backends[] = {
+#ifdef DDF_FAST_SECP256K1
+    &ecc_backend_secp256k1,
+#endif
+    &ecc_backend_uecc,
+#if defined(U_SECP256K1_SUPPORTED) && !defined(DDF_FAST_SECP256K1)
+    &ecc_backend_secp256k1,
+#endif
+    NULL
+};
 
-    /*** parse JSON **************************************************/
-    cj.tokens = U_ScratchAlloc(MAX_CJ_TOKENS * sizeof(cj_token));
-    cj_parse_init(&cj, (char*)constants_content, constants_content_size, cj.tokens, MAX_CJ_TOKENS);
+int ECC_CreateKeyPair(const char *path)
+{
+    int result;
+    U_SStream ss;
+    const ECC_Backend *ecc;
+    unsigned char private_key[32];
+    unsigned char public_key[64];
+    unsigned char compressed_pubkey[33];
+    char outpath[U_PATH_MAX];
 
-    cj_parse(&cj);
-    if (cj.status != CJ_OK)
+    ecc = ecc_backends[0];
+
+    if (ecc->make_key(private_key, public_key) != 1)
     {
-        U_Printf("failed to parse constants.json, status: %d\n", (int)cj.status);
-        goto err;
+        printf("%s: make_key() failed\n", ecc->name);
+        return 0;
     }
 
-    for (tok_pos = 1; tok_pos + 3 < cj.tokens_pos; tok_pos++)
-    {
-        tok = &cj.tokens[tok_pos];
-        if (tok[0].type != CJ_TOKEN_STRING)
-            continue;
-        if (tok[0].len != constant_len)
-            continue;
-        if (tok[1].type != CJ_TOKEN_NAME_SEP)
-            continue;
-        if (tok[2].type != CJ_TOKEN_STRING)
-            continue;
-        if (tok[2].len > bufsize - 1) /* need enough space */
-            continue;
+    ecc->compress(public_key, compressed_pubkey);
 
-        U_ASSERT(tok->pos < cj.size);
-        if (cj.buf[tok->pos] != '$')
-            continue;
+    U_sstream_init(&ss, &outpath[0], sizeof(outpath));
+    U_sstream_put_str(&ss, path);
 
-        if (U_memcmp(&cj.buf[tok->pos], constant, constant_len) != 0)
-            continue;
+    result = 0;
+    if (PL_WriteFile(ss.str, private_key, sizeof(private_key)) == 1)
+        result = 1;
+
+    U_sstream_put_str(&ss, ".pub");
+    if (PL_WriteFile(ss.str, compressed_pubkey, sizeof(compressed_pubkey)) == 1)
+        result += 1;
+
+    U_Printf("private key: ");
+    print_hex(private_key, sizeof(private_key));
+    U_Printf("\n");
+
+    U_Printf("public key:  ");
+    print_hex(compressed_pubkey, sizeof(compressed_pubkey));
+    U_Printf("\n");
+
+    return result == 2 ? 1 : 0;
+}
 
-        if (cj_copy_ref(&cj, buf, bufsize, tok_pos + 2) == 0)
-            goto err;
+int ECC_FindSignature(const DDF_Signature *sig, const DDFB_Bundle *bundle, u8 *sha256, u8 *public_key)
+{
+    unsigned long pos;
+    DDFB_Chunk chunk;
+    DDFB_Signature sig1;
 
-        break;
+    if (DDFB_FindChunk(bundle, "SIGN", &chunk) == 0) /* no SIGN chunk */
+    {
+        return 0;
     }
 
-    if (buf[0] != '\0')
+    for (pos = 0; DDFB_NextSignature(&chunk, &pos, &sig1);)
     {
-        U_Printf("resolved: %s -> %s\n", constant, buf);
-        U_ScratchRestore(scratch_pos);
-        return 1;
+        if (sig1.pubkey_len != sizeof(sig->compressed_pubkey))
+        {
+            U_Printf("unsupported public key length: %u\n", sig1.pubkey_len);
+            return 0;
+        }
+
+        if (sig1.signature_len != sizeof(sig->serialized_signature))
+        {
+            U_Printf("unsupported signature length: %u\n", sig1.signature_len);
+            return 0;
+        }
+
+        if (U_memcmp(sig1.pubkey, sig->compressed_pubkey, sizeof(sig->compressed_pubkey)) == 0)
+        {
+            if (ecc_backends[0]->verify(public_key, sha256, sig1.signature) == 1)
+                return 1;
+        }
     }
 
-err:
-    U_Printf("failed to resolve constant: %s\n", constant);
-    U_ScratchRestore(scratch_pos);
     return 0;
 }
 
-static extfile DDF_ResolveExtFile(const char *abs_path, const char *ext_path)
+/** Appends a signature to the SIGN chunk at the end of the bundle file.
+ *
+ * Only the new bytes and the SIGN and RIFF size fields are written,
+ * 'bundle' is the current (mapped) file content of 'ddf_size' bytes.
+ */
+int ECC_AppendSignature(const DDF_Signature *sig, const char *path, const DDFB_Bundle *bundle, u32 ddf_size)
 {
-    extfile f;
-    int size;
-    unsigned i;
-    unsigned j;
-    char ch;
-    char *ext_abs_path;
+    u32 i;
+    u32 pos;
+    u32 end;
+    u32 sign_offset;
+    int ret;
+    u8 buf[8 + 2 + sizeof(sig->compressed_pubkey) + 2 + sizeof(sig->serialized_signature)];
+    U_BStream bs;
+    DDFB_Chunk chunk;
+    PL_File file;
+
+    U_bstream_init(&bs, buf, sizeof(buf));
+
+    if (DDFB_FindChunk(bundle, "SIGN", &chunk) == 0) /* no SIGN chunk, append one */
+    {
+        pos = bundle->ddfb_offset + 8 + bundle->ddfb_size;
+        sign_offset = pos + 8;
+        DDF_PutFourCC(&bs, "SIGN");
+        U_bstream_put_u32_le(&bs, 0); /* initial size*/
+    }
+    else
+    {
+        pos = chunk.offset + 8 + chunk.size;
+        sign_offset = chunk.offset + 8;
+    }
+
+    if (pos != ddf_size)
+    {
+        U_Printf("SIGN chunk isn't at the end of %s\n", path);
+        return 0;
+    }
+
+    /* append signature */
+    U_bstream_put_u16_le(&bs, sizeof(sig->compressed_pubkey));
+    for (i = 0; i < sizeof(sig->compressed_pubkey); i++)
+        U_bstream_put_u8(&bs, sig->compressed_pubkey[i]);
+
+    U_bstream_put_u16_le(&bs, sizeof(sig->serialized_signature));
+    for (i = 0; i < sizeof(sig->serialized_signature); i++)
+        U_bstream_put_u8(&bs, sig->serialized_signature[i]);
+
+    U_ASSERT(bs.status == U_BSTREAM_OK);
+    end = pos + bs.pos;
+
+    if (PL_FileOpen(&file, path, PL_FILE_UPDATE) == 0)
+    {
+        U_Printf("failed to open %s\n", path);
+        return 0;
+    }
+
+    ret = PL_FileWriteAt(&file, pos, buf, bs.pos);
+
+    /* write new SIGN chunk size */
+    bs.pos = 0;
+    U_bstream_put_u32_le(&bs, end - sign_offset);
+    if (ret)
+        ret = PL_FileWriteAt(&file, sign_offset - 4, buf, 4);
+
+    /* update RIFF chunk size*/
+    bs.pos = 0;
+    U_bstream_put_u32_le(&bs, end - 8);
+    if (ret)
+        ret = PL_FileWriteAt(&file, 4, buf, 4);
+
+    PL_FileClose(&file);
+
+    if (ret == 0)
+        U_Printf("failed to write %s\n", path);
+
+    return ret;
+}
+
+int ECC_Sign(const char *ddfpath, const char *keypath)
+{
+    int ret;
+    unsigned long signed_size;
+    const u8 *signed_data;
+    DDFB_Bundle bundle;
+    PL_MappedFile ddf;
+    const ECC_Backend *ecc;
+    /* buffers */
+    u8 sha256[32];
+    u8 private_key[32 + 1];
+    u8 public_key[64];
+    DDF_Signature ddf_sig;
+
     PL_Stat statbuf;
 
-    ext_abs_path = U_ScratchAlloc(U_PATH_MAX);
-    U_ASSERT(ext_abs_path);
+    /*** load private key file ***************************************/
+    if (PL_StatFile(keypath, &statbuf) != 1)
+    {
+        U_Printf("failed to open %s\n", keypath);
+        return 0;
+    }
 
-    i = U_strlen(abs_path);
-    U_ASSERT(i > 0);
-    for (;i && abs_path[i] != DIR_SEP; i--)
-        ;
+    if (statbuf.size != 32)
+    {
+        U_Printf("failed to load private key: %s, expected 32 bytes, got %u\n", keypath, (unsigned)statbuf.size);
+        return 0;
+    }
 
-    if (i)
+    ret = PL_LoadFile(keypath, &private_key[0], sizeof(private_key));
+    if (ret != (int)statbuf.size)
     {
-        U_memcpy(ext_abs_path, abs_path, i);
-        ext_abs_path[i++] = DIR_SEP;
-        ext_abs_path[i] = '\0';
+        U_Printf("failed to load private key: %s, ret: %d\n", keypath, ret);
+        return 0;
+    }
+
+    /*** map DDF file, it isn't copied *******************************/
+    if (PL_MapFile(&ddf, ddfpath) == 0 || ddf.size < 16)
+    {
+        PL_UnmapFile(&ddf);
+        U_Printf("failed to read %s\n", ddfpath);
+        return 0;
     }
 
-    for (j = 0; ext_path[j]; j++)
-    {
-        ch = ext_path[j];
-        if (ch == '/' && DIR_SEP != '/') /* convert windows to unix paths */
-            ch = DIR_SEP;
-        ext_abs_path[i + j] = ch;
+    ret = 0;
+
+    /*** test for valid DDF file *************************************/
+    if (DDFB_Open(&bundle, ddf.data, ddf.size) == 0)
+    {
+        U_Printf("no valid RIFF/DDFB chunk found in: %s\n", ddfpath);
+        goto out;
+    }
+
+    /*** generate SHA256 over DDFB chunk (header + data) *************/
+    signed_data = DDFB_SignedData(&bundle, &signed_size);
+    U_sha256(signed_data, signed_size, &sha256[0]);
+
+    U_Printf("SHA256: ");
+    print_hex(&sha256[0], sizeof(sha256));
+    U_Printf("\n");
+
+    /*** create signature over DDFB data *****************************/
+
+    U_bzero(&ddf_sig, sizeof(ddf_sig));
+
+    ecc = ecc_backends[0];
+
+    if (ecc->compute_public_key(private_key, public_key) != 1)
+    {
+        U_Printf("failed to compute public key from %s\n", keypath);
+        goto out;
+    }
+
+    U_Printf("private key: ");
+    print_hex(&private_key[0], sizeof(private_key) - 1);
+    U_Printf("\n");
+
+    /* serialize the pubkey in a compressed form(33 bytes) */
+    ecc->compress(public_key, ddf_sig.compressed_pubkey);
+
+    U_Printf("public key: ");
+    print_hex(&ddf_sig.compressed_pubkey[0], sizeof(ddf_sig.compressed_pubkey));
+    U_Printf("\n");
+
+    /* signing */
+
+    /*
+    if (uECC_sign(private_key, sha256, sizeof(sha256), ddf_sig.serialized_signature, curve) != 1)
+    {
+        goto out;
+    }
+    */
+
+    if (ecc->sign(private_key, &sha256[0], ddf_sig.serialized_signature) != 1)
+    {
+        goto out;
+    }
+
+    U_Printf("signature: ");
+    print_hex(ddf_sig.serialized_signature, sizeof(ddf_sig.serialized_signature));
+    U_Printf("\n");
+
+    /* check if signature is already there */
+    if (ECC_FindSignature(&ddf_sig, &bundle, &sha256[0], &public_key[0]))
+    {
+        U_Printf("signature already present\n");
+        ret = 1;
+        goto out;
+    }
+
+    ret = ECC_AppendSignature(&ddf_sig, ddfpath, &bundle, ddf.size);
+
+out:
+    PL_UnmapFile(&ddf);
+    return ret;
+}
+
+#ifndef DDFB_NO_MAIN /* the ddfb tool, not part of the ddfb_builder library */
+
+/* Data shared by all bundles of a base directory, it is only modified
+   by the main thread, worker threads use it read-only.
+ */
+static int generic_item_files_preloaded;
+static U_HashMap generic_item_files; /* relative path -> DDF_GenericItemFile */
+static char ddf_base_path[U_PATH_MAX];
+static char constants_mtime[32];
+static PL_MappedFile constants_file;
+static const char *constants_content;
+static unsigned constants_content_size;
+static U_HashMap constants_index; /* "$NAME" -> DDF_Constant */
+
+/* compression dictionary of --dict, read-only while creating bundles */
+static PL_MappedFile ddf_dict;
+static u32 ddf_dict_id;
+
+/** Parses constants.json once into a hash table of "$NAME": "value" pairs.
+ *
+ * The index refers to constants_content which stays mapped.
+ */
+static int DDF_IndexConstants(void)
+{
+    cj_ctx cj;
+    cj_token *tok;
+    int inserted;
+    unsigned scratch_pos;
+    unsigned tok_pos;
+    U_HashMapEntry *e;
+    DDF_Constant *c;
+
+    scratch_pos = U_ScratchPos();
+    U_bzero(&constants_index, sizeof(constants_index));
+
+    cj.tokens = U_ScratchAlloc(MAX_CJ_TOKENS * sizeof(cj_token));
+    cj_parse_init(&cj, constants_content, constants_content_size, cj.tokens, MAX_CJ_TOKENS);
+
+    cj_parse(&cj);
+    if (cj.status != CJ_OK)
+    {
+        U_Printf("failed to parse constants.json, status: %d\n", (int)cj.status);
+        U_ScratchRestore(scratch_pos);
+        return 0;
+    }
+
+    U_HashMapInit(&constants_index, &mem_arena, cj.tokens_pos / 4);
+
+    for (tok_pos = 1; tok_pos + 3 < cj.tokens_pos; tok_pos++)
+    {
+        tok = &cj.tokens[tok_pos];
+        if (tok[0].type != CJ_TOKEN_STRING)
+            continue;
+        if (tok[1].type != CJ_TOKEN_NAME_SEP)
+            continue;
+        if (tok[2].type != CJ_TOKEN_STRING)
+            continue;
+
+        U_ASSERT(tok->pos < cj.size);
+        if (cj.buf[tok->pos] != '$')
+            continue;
+
+        e = U_HashMapInsert(&constants_index, &constants_content[tok[0].pos], tok[0].len, &inserted);
+        if (!e)
+        {
+            U_ScratchRestore(scratch_pos);
+            return 0;
+        }
+
+        if (inserted == 0)
+            continue; /* first definition wins */
+
+        c = U_AllocArena(&mem_arena, sizeof(*c), U_ARENA_ALIGN_8);
+        c->value = &constants_content[tok[2].pos];
+        c->value_len = tok[2].len;
+        e->value = c;
+    }
+
+    U_ScratchRestore(scratch_pos);
+    return 1;
+}
+
+/** DDFB_Resolver.constant callback of the ddfb tool, looks up constants.json.
+ */
+static int DDF_FileConstant(void *user, const char *name, const char **value, unsigned *value_len)
+{
+    DDF_Constant *c;
+    U_HashMapEntry *e;
+
+    U_UNUSED(user);
+    U_ASSERT(constants_content_size > 0);
+
+    e = U_HashMapFind(&constants_index, name, U_strlen(name));
+    c = e ? e->value : NULL;
+    if (!c)
+        return 0;
+
+    *value = c->value;
+    *value_len = c->value_len;
+    return 1;
+}
+
+/** Maps a file referenced relative to the DDF, the caller unmaps f->file.
+ */
+static int DDF_ResolveExtFile(const char *abs_path, const char *ext_path, extfile *f)
+{
+    unsigned i;
+    unsigned j;
+    char ch;
+    char *ext_abs_path;
+    PL_Stat statbuf;
+
+    U_bzero(f, sizeof(*f));
+    ext_abs_path = U_ScratchAlloc(U_PATH_MAX);
+    U_ASSERT(ext_abs_path);
+
+    i = U_strlen(abs_path);
+    U_ASSERT(i > 0);
+    for (;i && abs_path[i] != DIR_SEP; i--)
+        ;
+
+    if (i)
+    {
+        U_memcpy(ext_abs_path, abs_path, i);
+        ext_abs_path[i++] = DIR_SEP;
+        ext_abs_path[i] = '\0';
+    }
+
+    if (i + U_strlen(ext_path) + 1 > U_PATH_MAX)
+    {
+        U_Printf("path too long: %s\n", ext_path);
+        return 0;
+    }
+
+    for (j = 0; ext_path[j]; j++)
+    {
+        ch = ext_path[j];
+        if (ch == '/' && DIR_SEP != '/') /* convert windows to unix paths */
+            ch = DIR_SEP;
+        ext_abs_path[i + j] = ch;
+    }
+
+    ext_abs_path[i + j] = '\0';
+
+    if (ext_abs_path[0] == '\0' || PL_StatFile(&ext_abs_path[0], &statbuf) != 1)
+        return 0;
+
+    if (PL_MapFile(&f->file, &ext_abs_path[0]) == 0)
+        return 0;
+
+    if (U_TimeToISO8601_UTC(statbuf.mtime, &f->mtime[0], sizeof(f->mtime)))
+    {
+        /* cut off milliseconds .000Z */
+        f->mtime[19] = 'Z';
+        f->mtime[20] = '\0';
+    }
+
+    return 1;
+}
+
+/** Creates the bundle path "<name>.ddf" in the current directory from the DDF path.
+ */
+static int DDF_BundlePath(const char *path, char *bundle_path, unsigned bufsize)
+{
+    unsigned i;
+    unsigned j;
+
+    for (i = U_strlen(path); i && path[i - 1] != DIR_SEP; --i)
+        ;
+
+    j = U_strlen(&path[i]);
+    if (j < 5 || path[i + j - 5] != '.')
+    {
+        U_Printf("path file extension '.' not found in %s\n", path);
+        return 0;
+    }
+
+    if (j >= bufsize)
+        return 0;
+
+    U_memcpy(bundle_path, &path[i], j - 4);
+    U_memcpy(&bundle_path[j - 4], "ddf", 4);
+    return 1;
+}
+
+static int DDF_ResolveBasePath(const char *abs_path)
+{
+    u32 i;
+    const char *test_path;
+    PL_Stat statbuf;
+
+    /*** search generic/items directory ******************************/
+    /* walk dir tree from DDF up and look for generic/items/attr_id_item.json file.
+     */
+    ddf_base_path[0] = '\0';
+
+    i = U_strlen(abs_path);
+
+    U_ASSERT(i + 1 < U_PATH_MAX);
+    if (i + 1 >= U_PATH_MAX)
+        return 0;
+
+    U_memcpy(&ddf_base_path[0], abs_path, i + 1);
+
+    test_path = "generic" DIR_SEP_STR "items" DIR_SEP_STR "attr_id_item.json";
+    for (;i; i--)
+    {
+        if (ddf_base_path[i - 1] == DIR_SEP)
+        {
+            U_memcpy(&ddf_base_path[i], test_path, U_strlen(test_path) + 1);
+
+            if (PL_StatFile(&ddf_base_path[0], &statbuf) != 0)
+                break;
+        }
+    }
+
+    if (i == 0)
+    {
+        U_Printf("failed to find base directory\n");
+        ddf_base_path[0] = '\0';
+        return 0;
+    }
+
+    ddf_base_path[i] = '\0';
+
+    return 1;
+}
+
+/** Returns the cached generic item file, it's mapped on first use.
+ */
+static DDF_GenericItemFile *DDF_GetGenericItemFile(const char *item_path, const char *rel_path)
+{
+    int inserted;
+    unsigned len;
+    PL_Stat statbuf;
+    U_HashMapEntry *e;
+    DDF_GenericItemFile *file;
+
+    len = U_strlen(rel_path);
+
+    e = U_HashMapFind(&generic_item_files, rel_path, len);
+    if (e)
+        return e->value;
+
+    if (generic_item_files_preloaded)
+    {
+        /* no lazy loading while worker threads access the map */
+        U_Printf("failed to resolve '%s'\n", item_path);
+        return NULL;
+    }
+
+    if (PL_StatFile(item_path, &statbuf) == 0)
+    {
+        U_Printf("failed to resolve '%s'\n", item_path);
+        return NULL;
+    }
+
+    file = U_AllocArena(&mem_arena, sizeof(*file), U_ARENA_ALIGN_8);
+
+    if (PL_MapFile(&file->file, item_path) == 0)
+    {
+        U_Printf("failed to load: %s\n", item_path);
+        return NULL;
+    }
+
+    if (U_TimeToISO8601_UTC(statbuf.mtime, &file->mtime[0], sizeof(file->mtime)))
+    {
+        /* cut off milliseconds .000Z */
+        file->mtime[19] = 'Z';
+        file->mtime[20] = '\0';
+    }
+
+    e = U_HashMapInsert(&generic_item_files, rel_path, len, &inserted);
+    if (!e)
+        return NULL;
+
+    e->value = file;
+    return file;
+}
+
+static int DDF_LoadConstants(void)
+{
+    U_SStream ss;
+    PL_Stat statbuf;
+    char *constants_path;
+
+    /*** search generic/items directory ******************************/
+    /* walk dir tree from DDF up and look for generic/items/attr_id_item.json file.
+     */
+    constants_content_size = 0;
+    constants_path = U_ScratchAlloc(U_PATH_MAX);
+    U_ASSERT(constants_path);
+    U_sstream_init(&ss, constants_path, U_PATH_MAX);
+
+    U_sstream_put_str(&ss, &ddf_base_path[0]);
+    U_sstream_put_str(&ss, "generic" DIR_SEP_STR "constants.json");
+
+     /*** load private key file ***************************************/
+    if (PL_StatFile(constants_path, &statbuf) != 1)
+    {
+        U_Printf("failed to open %s\n", constants_path);
+        return 0;
+    }
+
+    if (statbuf.size < 8)
+        return 0;
+
+    /* keep mapped, constants are shared by all bundles of create-all */
+    if (PL_MapFile(&constants_file, constants_path) == 0)
+    {
+        U_Printf("failed to read %s\n", constants_path);
+        return 0;
+    }
+
+    constants_content = (const char*)constants_file.data;
+
+    if (U_TimeToISO8601_UTC(statbuf.mtime, &constants_mtime[0], sizeof(constants_mtime)))
+    {
+        /* cut off milliseconds .000Z */
+        constants_mtime[19] = 'Z';
+        constants_mtime[20] = '\0';
+    }
+    else
+    {
+        constants_mtime[0] = '\0';
+    }
+
+    constants_content_size = (unsigned)constants_file.size;
+    return DDF_IndexConstants();
+}
+
+/** Unmaps the files of the previous base directory.
+ */
+static void DDF_UnloadBaseData(void)
+{
+    unsigned i;
+    DDF_GenericItemFile *file;
+
+    for (i = 0; i < generic_item_files.size; i++)
+    {
+        file = generic_item_files.entries[i].value;
+        if (file)
+            PL_UnmapFile(&file->file);
+    }
+
+    PL_UnmapFile(&constants_file);
+    constants_content = NULL;
+    constants_content_size = 0;
+}
+
+/** Loads data shared by bundles of the same base directory.
+ *
+ * Base path, constants and generic item files are kept loaded as long
+ * as following DDFs are located below the same base directory.
+ */
+static int DDF_LoadBaseData(const char *abs_path, unsigned flags)
+{
+    unsigned len;
+
+    len = U_strlen(&ddf_base_path[0]);
+    if (len && constants_content_size && U_memcmp(&ddf_base_path[0], abs_path, len) == 0)
+        return 1;
+
+    if (flags & DDF_CREATE_SHARED_BASE)
+    {
+        U_Printf("%s is not below base directory %s\n", abs_path, &ddf_base_path[0]);
+        return 0;
+    }
+
+    DDF_UnloadBaseData();
+    generic_item_files_preloaded = 0;
+    U_HashMapInit(&generic_item_files, &mem_arena, 256);
+
+    if (DDF_ResolveBasePath(abs_path) == 0)
+        return 0;
+
+    if (DDF_LoadConstants() == 0)
+        return 0;
+
+    return 1;
+}
+
+/** Checks the "schema" of a JSON file to be a DDF.
+ */
+static int DDF_IsDeviceDescription(DDF_Doc *doc)
+{
+    char schema[64];
+
+    if (cj_copy_value(&doc->cj, &schema[0], sizeof(schema), 0, "schema"))
+    {
+        if (U_strlen(&schema[0]) == U_strlen(DDF_SCHEMA) &&
+            U_memcmp(&schema[0], DDF_SCHEMA, U_strlen(DDF_SCHEMA)) == 0)
+            return 1;
+    }
+
+    return 0;
+}
+
+static void DDF_PreloadCallback(void *user, const char *name, int is_dir)
+{
+    unsigned len;
+    unsigned base_len;
+    char item_path[U_PATH_MAX];
+    U_SStream ss;
+
+    U_UNUSED(user);
+
+    len = U_strlen(name);
+    if (is_dir || len < 10 || U_memcmp(&name[len - 10], "_item.json", 10) != 0)
+        return;
+
+    base_len = U_strlen(&ddf_base_path[0]);
+    U_sstream_init(&ss, &item_path[0], sizeof(item_path));
+    U_sstream_put_str(&ss, &ddf_base_path[0]);
+    U_sstream_put_str(&ss, "generic" DIR_SEP_STR "items" DIR_SEP_STR);
+    U_sstream_put_str(&ss, name);
+
+    if (ss.status == U_SSTREAM_OK)
+        DDF_GetGenericItemFile(ss.str, &ss.str[base_len]);
+}
+
+/** Loads all generic item files of the base directory upfront.
+ *
+ * Afterwards the list is read-only and can be used by worker threads.
+ */
+static int DDF_PreloadGenericItems(void)
+{
+    char items_path[U_PATH_MAX];
+    U_SStream ss;
+
+    U_sstream_init(&ss, &items_path[0], sizeof(items_path));
+    U_sstream_put_str(&ss, &ddf_base_path[0]);
+    U_sstream_put_str(&ss, "generic" DIR_SEP_STR "items");
+
+    if (ss.status != U_SSTREAM_OK || PL_ListDirectory(ss.str, DDF_PreloadCallback, NULL) == 0)
+    {
+        U_Printf("failed to read generic items directory\n");
+        return 0;
+    }
+
+    generic_item_files_preloaded = 1;
+    return 1;
+}
+
+/* bundle file output of the ddfb tool, the file is created on the first write */
+typedef struct
+{
+    const char *path;
+    int open;
+    PL_File file;
+} DDF_FileSink;
+
+static int DDF_FileSinkWrite(void *user, const DDFB_IoVec *iov, unsigned iov_count)
+{
+    unsigned i;
+    PL_IoVec piov[WRITER_MAX_IOV];
+    DDF_FileSink *fs;
+
+    fs = user;
+    if (!fs->open)
+    {
+        if (PL_FileOpen(&fs->file, fs->path, PL_FILE_WRITE) == 0)
+        {
+            U_Printf("failed to open: %s\n", fs->path);
+            return 0;
+        }
+        fs->open = 1;
+    }
+
+    U_ASSERT(iov_count <= WRITER_MAX_IOV);
+    for (i = 0; i < iov_count; i++)
+    {
+        piov[i].data = iov[i].data;
+        piov[i].size = iov[i].size;
+    }
+
+    return PL_FileWriteV(&fs->file, &piov[0], iov_count);
+}
+
+static int DDF_FileSinkWriteAt(void *user, unsigned long pos, const void *data, unsigned long size)
+{
+    DDF_FileSink *fs;
+
+    fs = user;
+    if (!fs->open)
+        return 0;
+
+    return PL_FileWriteAt(&fs->file, pos, data, size);
+}
+
+/** DDFB_Resolver.script callback of the ddfb tool, maps the file relative to the DDF.
+ */
+static int DDF_FileScript(void *user, const char *path, DDFB_Input *file)
+{
+    extfile *extf;
+
+    extf = U_ScratchAlloc(sizeof(*extf));
+    if (DDF_ResolveExtFile(user, path, extf) == 0)
+    {
+        PL_UnmapFile(&extf->file);
+        return 0;
+    }
+
+    file->data = extf->file.data;
+    file->size = extf->file.size;
+    file->mtime = &extf->mtime[0];
+    file->handle = extf;
+    return 1;
+}
+
+/** DDFB_Resolver.generic_item callback of the ddfb tool, files are cached for following bundles.
+ */
+static int DDF_FileGenericItem(void *user, const char *path, DDFB_Input *file)
+{
+    unsigned i;
+    unsigned len;
+    char item_path[U_PATH_MAX];
+    DDF_GenericItemFile *item;
+
+    U_UNUSED(user);
+
+    len = U_strlen(&ddf_base_path[0]);
+    if (len + U_strlen(path) >= sizeof(item_path))
+        return 0;
+
+    U_memcpy(&item_path[0], &ddf_base_path[0], len);
+    for (i = 0; path[i]; i++)
+        item_path[len + i] = path[i] == '/' ? DIR_SEP : path[i];
+    item_path[len + i] = '\0';
+
+    item = DDF_GetGenericItemFile(&item_path[0], &item_path[len]);
+    if (!item)
+        return 0;
+
+    file->data = item->file.data;
+    file->size = item->file.size;
+    file->mtime = &item->mtime[0];
+    return 1;
+}
+
+static void DDF_FileRelease(void *user, DDFB_Input *file)
+{
+    extfile *extf;
+
+    U_UNUSED(user);
+    extf = file->handle;
+    PL_UnmapFile(&extf->file);
+}
+
+static int DDF_BuildBundle(const char *abs_path, DDF_Doc *doc, unsigned flags)
+{
+    int ret;
+    char mtime[32];
+    char *bundle_path;
+    PL_Stat statbuf;
+    DDFB_BuildInput in;
+    DDFB_Sink sink;
+    DDF_FileSink fs;
+    DDF_BundleCtx *ctx;
+
+    if (DDF_ParseDoc(doc, doc->file.data, (unsigned)doc->file.size) == 0)
+    {
+        U_Printf("failed to parse JSON, status: %d\n", (int)doc->cj.status);
+        if (flags & DDF_CREATE_SKIP_NON_DDF)
+        {
+            U_Printf("skip %s (not a DDF)\n", abs_path);
+            return DDF_SKIPPED;
+        }
+        return 0;
+    }
+
+    if ((flags & DDF_CREATE_SKIP_NON_DDF) && DDF_IsDeviceDescription(doc) == 0)
+    {
+        U_Printf("skip %s (not a DDF)\n", abs_path);
+        return DDF_SKIPPED;
+    }
+
+    if (DDF_LoadBaseData(abs_path, flags) == 0)
+    {
+        return 0;
+    }
+
+    mtime[0] = '\0';
+    if (PL_StatFile(abs_path, &statbuf) && U_TimeToISO8601_UTC(statbuf.mtime, &mtime[0], sizeof(mtime)))
+    {
+        /* cut off milliseconds .000Z */
+        mtime[19] = 'Z';
+        mtime[20] = '\0';
+    }
+
+    /* files are resolved relative to the DDF and base directory */
+    U_bzero(&in, sizeof(in));
+    in.ddf = doc->data;
+    in.ddf_size = doc->size;
+    in.ddf_mtime = &mtime[0];
+    in.constants_mtime = &constants_mtime[0];
+    in.dict = ddf_dict.data;
+    in.dict_size = ddf_dict.size;
+    in.resolver.user = (void*)abs_path;
+    in.resolver.script = DDF_FileScript;
+    in.resolver.generic_item = DDF_FileGenericItem;
+    in.resolver.constant = DDF_FileConstant;
+    in.resolver.release = DDF_FileRelease;
+
+    ctx = DDF_InitBundleCtx(&in, flags | DDF_CREATE_LOG);
+    ctx->dict_id = ddf_dict_id;
+
+    if (flags & DDF_CREATE_TRAIN)
+        return DDF_WriteBundle(ctx, doc);
+
+    bundle_path = U_ScratchAlloc(U_PATH_MAX);
+    if (DDF_BundlePath(abs_path, bundle_path, U_PATH_MAX) == 0)
+        return 0;
+
+    U_bzero(&fs, sizeof(fs));
+    fs.path = bundle_path;
+    sink.user = &fs;
+    sink.write = DDF_FileSinkWrite;
+    sink.write_at = DDF_FileSinkWriteAt;
+    DDF_WriterInit(&ctx->w, &sink);
+
+    ret = DDF_WriteBundle(ctx, doc);
+
+    if (fs.open)
+        PL_FileClose(&fs.file);
+
+    if (ret == 0)
+    {
+        if (ctx->w.status == 0)
+            U_Printf("failed to write bundle to: %s\n", bundle_path);
+
+        /* don't leave incomplete bundles behind, the path is unique within a run */
+        if (fs.open)
+            PL_DeleteFile(bundle_path);
+        return 0;
+    }
+
+    U_Printf("bundle written to: %s (%lu bytes)\n", bundle_path, DDF_WriterPos(&ctx->w));
+    return 1;
+}
+
+static int DDF_CreateBundle(const char *path, unsigned flags)
+{
+    int ret;
+    char *abs_path;
+    DDF_Doc doc;
+
+    abs_path = U_ScratchAlloc(U_PATH_MAX);
+    U_ASSERT(abs_path);
+
+    if (!PL_RealPath(path, abs_path, U_PATH_MAX))
+    {
+        U_Printf("failed to resolve: %s\n", path);
+        return 0;
+    }
+
+    if (PL_MapFile(&doc.file, abs_path) == 0 || doc.file.size == 0)
+    {
+        PL_UnmapFile(&doc.file);
+        U_Printf("failed to read: %s\n", abs_path);
+        return 0;
+    }
+
+    ret = DDF_BuildBundle(abs_path, &doc, flags);
+    PL_UnmapFile(&doc.file);
+    return ret;
+}
+
+static void DDF_AddFile(DDF_FileList *fl, const char *path)
+{
+    char *str;
+    unsigned len;
+
+    if ((fl->count + 1) * sizeof(char*) > fl->buf.size)
+        U_BufferResize(&fl->buf, (fl->count + 256) * sizeof(char*));
+
+    len = U_strlen(path);
+    str = U_AllocArena(&mem_arena, len + 1, U_ARENA_ALIGN_1);
+    U_memcpy(str, path, len + 1);
+
+    ((char**)fl->buf.buf)[fl->count] = str;
+    fl->count++;
+}
+
+typedef struct
+{
+    DDF_FileList *fl;
+    const char *dir;
+} DDF_WalkCtx;
+
+static void DDF_WalkCallback(void *user, const char *name, int is_dir)
+{
+    DDF_WalkCtx *wc;
+    DDF_WalkCtx sub;
+    char path[U_PATH_MAX];
+    U_SStream ss;
+
+    wc = user;
+    U_sstream_init(&ss, &path[0], sizeof(path));
+    U_sstream_put_str(&ss, wc->dir);
+    U_sstream_put_str(&ss, DIR_SEP_STR);
+    U_sstream_put_str(&ss, name);
+
+    if (ss.status != U_SSTREAM_OK)
+    {
+        U_Printf("path too long: %s\n", name);
+        return;
+    }
+
+    if (is_dir)
+    {
+        /* generic items and constants aren't DDFs */
+        if (U_strlen(name) == 7 && U_memcmp(name, "generic", 7) == 0)
+            return;
+
+        sub.fl = wc->fl;
+        sub.dir = ss.str;
+        PL_ListDirectory(ss.str, DDF_WalkCallback, &sub);
+    }
+    else if (ss.pos > 5 && U_memcmp(&ss.str[ss.pos - 5], ".json", 5) == 0)
+    {
+        DDF_AddFile(wc->fl, ss.str);
+    }
+}
+
+/** Reads a text file with one DDF path per line, empty lines and lines
+ *  starting with '#' are ignored.
+ */
+static int DDF_ReadFileList(DDF_FileList *fl, const char *path)
+{
+    char *data;
+    char *line;
+    unsigned i;
+    unsigned size;
+    PL_Stat statbuf;
+
+    if (PL_StatFile(path, &statbuf) == 0)
+    {
+        U_Printf("failed to open %s\n", path);
+        return 0;
+    }
+
+    size = statbuf.size;
+    data = U_ScratchAlloc(size + 1);
+
+    if (size == 0 || PL_LoadFile(path, data, size + 1) != (int)size)
+    {
+        U_Printf("failed to read %s\n", path);
+        return 0;
+    }
+
+    line = data;
+    for (i = 0; i <= size; i++)
+    {
+        if (i < size && data[i] != '\n')
+            continue;
+
+        data[i] = '\0';
+        if (&data[i] > line && data[i - 1] == '\r')
+            data[i - 1] = '\0';
+
+        if (line[0] != '\0' && line[0] != '#')
+            DDF_AddFile(fl, line);
+
+        line = &data[i + 1];
     }
 
-    ext_abs_path[i + j] = '\0';
+    return 1;
+}
+
+static int DDF_ComparePaths(const void *a, const void *b)
+{
+    return strcmp(*(const char**)a, *(const char**)b);
+}
 
-    U_bzero(&f, sizeof(f));
+static void DDF_ProcessQueue(DDF_WorkQueue *q)
+{
+    long i;
+    int ret;
+    unsigned scratch_pos;
 
-    if (ext_abs_path[0])
+    for (;;)
     {
-        size = U_MEGA_BYTES(1);
-        f.mem = U_ScratchAlloc(size);
-        f.size = PL_LoadFile(&ext_abs_path[0], f.mem, size);
+        i = PL_AtomicIncrement(&q->next) - 1;
+        if (i >= (long)q->count)
+            break;
 
-        PL_StatFile(&ext_abs_path[0], &statbuf);
+        scratch_pos = U_ScratchPos();
+        ret = DDF_CreateBundle(q->paths[i], q->flags);
+        U_ScratchRestore(scratch_pos);
 
-        if (U_TimeToISO8601_UTC(statbuf.mtime, &f.mtime[0], sizeof(f.mtime)))
+        if (ret == 1)
+        {
+            PL_AtomicIncrement(&q->created);
+        }
+        else if (ret == 0)
         {
-            /* cut off milliseconds .000Z */
-            f.mtime[19] = 'Z';
-            f.mtime[20] = '\0';
+            U_Printf("failed to create bundle for: %s\n", q->paths[i]);
+            PL_AtomicIncrement(&q->failed);
         }
     }
+}
+
+static void DDF_WorkerMain(void *arg)
+{
+    DDF_Worker *w = arg;
 
-    return f;
+    U_ScratchInitStatic(w->scratch_mem, SCRATCH_SIZE);
+    DDF_ProcessQueue(w->queue);
+    U_ScratchFree();
 }
 
-static int DDF_StoreBundle(const char *path, U_BStream *bs)
+/** Runs the worker threads on a queue of DDFs below the loaded base directory.
+ */
+static void DDF_RunPool(DDF_WorkQueue *q, DDF_Worker *workers, unsigned jobs)
 {
-    char *bundle_path;
     unsigned i;
-    unsigned j;
-    unsigned sz;
 
-    if (bs->status != U_BSTREAM_OK)
-        return 0;
+    for (i = 0; i < jobs; i++)
+    {
+        workers[i].queue = q;
+        workers[i].thread = PL_CreateThread(DDF_WorkerMain, &workers[i]);
+        if (!workers[i].thread)
+            break;
+    }
 
-    sz = U_strlen(path);
-    for (i = U_strlen(path); i && path[i - 1] != DIR_SEP; --i)
-        ;
+    if (i == 0)
+        DDF_ProcessQueue(q); /* no threads, continue in main thread */
+
+    jobs = i;
+    for (i = 0; i < jobs; i++)
+        PL_JoinThread(workers[i].thread);
+}
 
-    sz = U_strlen(&path[i]);
-    bundle_path = U_ScratchAlloc(sz + 16);
+/** Creates bundles with a pool of worker threads.
+ *
+ * The paths are split into runs of DDFs below the same base directory,
+ * the same way the serial path keeps its base data. Base data of a run
+ * is loaded by the main thread and shared read-only, each worker has
+ * its own scratch arena. The caller must have checked the queue with
+ * DDF_CheckBundleNames(), every bundle path is then written and on
+ * failure deleted by exactly one worker.
+ */
+static int DDF_RunWorkers(DDF_WorkQueue *q, unsigned jobs)
+{
+    unsigned i;
+    unsigned len;
+    unsigned begin;
+    unsigned end;
+    char *abs_path;
+    DDF_Worker *workers;
+    DDF_WorkQueue run;
 
-    for (j = 0; i && path[i]; i++, j++)
-        bundle_path[j] = path[i];
+    abs_path = U_ScratchAlloc(U_PATH_MAX);
+    workers = U_ScratchAlloc(jobs * sizeof(*workers));
+    U_bzero(workers, jobs * sizeof(*workers));
 
-    bundle_path[j] = '\0';
+    for (i = 0; i < jobs; i++)
+        workers[i].scratch_mem = U_AllocManaged(SCRATCH_SIZE);
 
-    if (bundle_path[j - 5] != '.')
+    for (begin = 0; begin < q->count; begin = end)
     {
-        U_Printf("path file extension '.' not found in %s\n", path);
-        return 0;
-    }
+        end = begin + 1;
+        U_bzero(&run, sizeof(run));
+        run.paths = &q->paths[begin];
+        run.flags = q->flags;
 
-    j -= 4;
-    bundle_path[j++] = 'd';
-    bundle_path[j++] = 'd';
-    bundle_path[j++] = 'f';
-    bundle_path[j++] = '\0';
+        if (PL_RealPath(q->paths[begin], abs_path, U_PATH_MAX) &&
+            DDF_LoadBaseData(abs_path, 0) &&
+            (generic_item_files_preloaded || DDF_PreloadGenericItems()))
+        {
+            len = U_strlen(&ddf_base_path[0]);
+            for (; end < q->count; end++)
+            {
+                if (!PL_RealPath(q->paths[end], abs_path, U_PATH_MAX) ||
+                    U_memcmp(&ddf_base_path[0], abs_path, len) != 0)
+                    break;
+            }
 
-    /* write file size in RIFF header */
-    sz = bs->pos;
-    bs->pos = 4;
-    U_bstream_put_u32_le(bs, sz - 8);
-    bs->pos = sz;
+            run.count = end - begin;
+            run.flags |= DDF_CREATE_SHARED_BASE;
+            DDF_RunPool(&run, workers, jobs);
+        }
+        else
+        {
+            /* no base directory, fails or is skipped like in the serial path */
+            run.count = 1;
+            DDF_ProcessQueue(&run);
+        }
 
-    if (PL_WriteFile(bundle_path, bs->data, sz) == 1)
-    {
-        U_Printf("bundle written to: %s (%u bytes)\n", bundle_path, bs->pos);
-        return 1;
+        q->created += run.created;
+        q->failed += run.failed;
     }
 
-    U_Printf("failed to write bundle to: %s (%u bytes)\n", bundle_path, bs->pos);
-    return 0;
-}
+    for (i = 0; i < jobs; i++)
+        U_FreeTracked(workers[i].scratch_mem);
 
-static int cj_is_valid_ref(cj_ctx *cj, cj_token_ref ref)
-{
-    if (ref >= 0 && ref < (cj_token_ref)cj->tokens_pos)
-        return 1;
-    return 0;
+    return 1;
 }
 
-static int cj_is_array(cj_ctx *cj, cj_token_ref ref)
+/** Collects the JSON files of a directory tree or file list.
+ *
+ * The paths are sorted, so DDFs of the same base directory follow
+ * each other. The caller frees fl->buf on success.
+ */
+static int DDF_CollectFiles(const char *path, DDF_FileList *fl)
 {
-    if (cj_is_valid_ref(cj, ref))
+    DDF_WalkCtx wc;
+
+    U_bzero(fl, sizeof(*fl));
+    wc.fl = fl;
+    wc.dir = path;
+
+    if (PL_ListDirectory(path, DDF_WalkCallback, &wc) == 0)
     {
-        if (cj->tokens[ref].type == CJ_TOKEN_ARRAY_BEG)
-            return 1;
+        if (DDF_ReadFileList(fl, path) == 0)
+            return 0;
     }
 
-    return 0;
+    if (fl->count == 0)
+    {
+        U_Printf("no DDF files found in %s\n", path);
+        U_BufferFree(&fl->buf);
+        return 0;
+    }
+
+    U_qsort(fl->buf.buf, fl->count, sizeof(char*), DDF_ComparePaths);
+    return 1;
 }
 
-static void U_sstream_put_js_str(U_SStream *ss, const char *str)
+static const char *DDF_FileName(const char *path)
 {
-    U_sstream_put_str(ss, "\"");
-    U_sstream_put_str(ss, str);
-    U_sstream_put_str(ss, "\"");
+    unsigned i;
+    for (i = U_strlen(path); i && path[i - 1] != DIR_SEP && path[i - 1] != '/'; --i)
+        ;
+    return &path[i];
 }
 
-static int DDF_ResolveBasePath(const char *abs_path)
+static int DDF_CompareFileNames(const void *a, const void *b)
 {
-    u32 i;
-    const char *test_path;
-    PL_Stat statbuf;
-
-    /*** search generic/items directory ******************************/
-    /* walk dir tree from DDF up and look for generic/items/attr_id_item.json file.
-     */
-    ddf_base_path[0] = '\0';
-
-    i = U_strlen(abs_path);
+    return strcmp(DDF_FileName(*(const char**)a), DDF_FileName(*(const char**)b));
+}
 
-    U_ASSERT(i + 1 < U_PATH_MAX);
-    if (i + 1 >= U_PATH_MAX)
-        return 0;
+/** Checks that no two DDFs are written to the same bundle path.
+ *
+ * Bundles are named after the DDF file name only, so equal file names
+ * in different directories would overwrite each other.
+ */
+static int DDF_CheckBundleNames(char **paths, unsigned count)
+{
+    unsigned i;
+    int ret;
+    char **names;
 
-    U_memcpy(&ddf_base_path[0], abs_path, i + 1);
+    names = U_ScratchAlloc(count * sizeof(*names));
+    U_ASSERT(names);
+    U_memcpy(names, paths, count * sizeof(*names));
+    U_qsort(names, count, sizeof(*names), DDF_CompareFileNames);
 
-    test_path = "generic" DIR_SEP_STR "items" DIR_SEP_STR "attr_id_item.json";
-    for (;i; i--)
+    ret = 1;
+    for (i = 1; i < count; i++)
     {
-        if (ddf_base_path[i - 1] == DIR_SEP)
+        if (DDF_CompareFileNames(&names[i - 1], &names[i]) == 0)
         {
-            U_memcpy(&ddf_base_path[i], test_path, U_strlen(test_path) + 1);
-
-            if (PL_StatFile(&ddf_base_path[0], &statbuf) != 0)
-                break;
+            U_Printf("duplicate bundle name: %s and %s\n", names[i - 1], names[i]);
+            ret = 0;
         }
     }
 
-    if (i == 0)
-    {
-        U_Printf("failed to find base directory\n");
-        ddf_base_path[0] = '\0';
-        return 0;
-    }
-
-    ddf_base_path[i] = '\0';
-
-    return 1;
+    return ret;
 }
 
-static int DDF_MakeDescriptor(const char *path, u8 *ddf, int ddf_size, U_SStream *ss)
+/** Creates bundles for all DDFs in a directory tree or file list.
+ *
+ * All bundles are created in one process, base path, constants and
+ * generic item files are loaded only once. With jobs > 1 the bundles
+ * are created in parallel by a worker pool.
+ */
+static int DDF_CreateAllBundles(const char *path, unsigned jobs, unsigned flags)
 {
-    cj_ctx cj;
-    cj_token_ref ref_modelid0;
-    cj_token_ref ref_modelid1;
-    cj_token_ref ref_mfname0;
-    cj_token_ref ref_mfname1;
-    char *valbuf;
-    char *valbuf1;
-    int devid_count;
-    PL_Stat statbuf;
-    unsigned scratch_pos;
+    char **paths;
+    DDF_FileList fl;
+    DDF_WorkQueue q;
 
-    scratch_pos = U_ScratchPos();
+    if (DDF_CollectFiles(path, &fl) == 0)
+        return 0;
 
-    U_ASSERT(ss->pos == 0);
+    paths = (char**)fl.buf.buf;
 
-    valbuf = U_ScratchAlloc(VAL_BUF_SIZE);
-    valbuf1 = U_ScratchAlloc(VAL_BUF_SIZE);
+    if (DDF_CheckBundleNames(paths, fl.count) == 0)
+    {
+        U_BufferFree(&fl.buf);
+        return 0;
+    }
 
-    /* start descriptor object */
-    U_sstream_put_str(ss, "{");
+    U_bzero(&q, sizeof(q));
+    q.paths = paths;
+    q.count = fl.count;
+    q.flags = DDF_CREATE_SKIP_NON_DDF | flags;
 
-    /* parse JSON */
-    cj.tokens = U_ScratchAlloc(MAX_CJ_TOKENS * sizeof(cj_token));
-    cj_parse_init(&cj, (char*)ddf, (unsigned)ddf_size, cj.tokens, MAX_CJ_TOKENS);
+    if (jobs == 0)
+        jobs = PL_CpuCount();
 
-    cj_parse(&cj);
-    if (cj.status != CJ_OK)
-    {
-        U_Printf("failed to parse JSON, status: %d\n", (int)cj.status);
-        goto err;
-    }
+    if (jobs > fl.count)
+        jobs = fl.count;
 
-    /* version (required) */
-    if (cj_copy_value(&cj, valbuf, VAL_BUF_SIZE, 0, "version"))
+    if (jobs > 1)
     {
-        U_sstream_put_js_str(ss, "version");
-        U_sstream_put_str(ss, ":");
-        U_sstream_put_js_str(ss, valbuf);
-        U_sstream_put_str(ss, ",");
+        /* bundle names were checked above, no two workers write the same file */
+        if (DDF_RunWorkers(&q, jobs) == 0)
+            q.failed = 1;
     }
     else
     {
-        /* temporary use version "0.0.0" until we have actual versions */
-        U_sstream_put_js_str(ss, "version");
-        U_sstream_put_str(ss, ":");
-        U_sstream_put_js_str(ss, "0.0.0");
-        U_sstream_put_str(ss, ",");
-    }
-    /*
-    else
-    {
-        U_Printf("key 'version' not found\n");
-        goto err;
+        DDF_ProcessQueue(&q);
     }
-    */
 
-    /*** version_deconz (required) ***********************************/
-    if (cj_copy_value(&cj, valbuf, VAL_BUF_SIZE, 0, "version_deconz"))
-    {
-        U_sstream_put_js_str(ss, "version_deconz");
-        U_sstream_put_str(ss, ":");
-        U_sstream_put_js_str(ss, valbuf);
-        U_sstream_put_str(ss, ",");
-    }
-    else
-    {
-        /* temporary use version "2.19.3" until we have actual versions */
-        U_sstream_put_js_str(ss, "version_deconz");
-        U_sstream_put_str(ss, ":");
-        U_sstream_put_js_str(ss, ">2.19.3");
-        U_sstream_put_str(ss, ",");
-    }
-    /*
-    else
+    U_Printf("%ld bundles created, %ld failed\n", q.created, q.failed);
+    U_BufferFree(&fl.buf);
+
+    return q.failed == 0 ? 1 : 0;
+}
+
+/* saved bytes if the sample is in the dictionary, the first copy isn't saved */
+static unsigned long DDF_DictSampleGain(const U_HashMapEntry *e)
+{
+    return (*(unsigned long*)e->value - 1) * e->key_len;
+}
+
+static int DDF_CompareDictGain(const void *a, const void *b)
+{
+    unsigned long ga;
+    unsigned long gb;
+
+    ga = DDF_DictSampleGain(*(const U_HashMapEntry**)a);
+    gb = DDF_DictSampleGain(*(const U_HashMapEntry**)b);
+
+    if (ga != gb)
+        return ga < gb ? 1 : -1;
+    return 0;
+}
+
+static int DDF_CompareDictCount(const void *a, const void *b)
+{
+    unsigned long ca;
+    unsigned long cb;
+
+    ca = *(unsigned long*)(*(const U_HashMapEntry**)a)->value;
+    cb = *(unsigned long*)(*(const U_HashMapEntry**)b)->value;
+
+    if (ca != cb)
+        return ca < cb ? -1 : 1;
+    return 0;
+}
+
+/** Creates a compression dictionary from the files bundled by the DDFs
+ *  in a directory tree or file list.
+ *
+ * Files which are contained in several bundles, mostly generic items and
+ * constants, are put into the dictionary. The ones saving the most bytes
+ * are taken first, the most used ones are placed at the end where they
+ * are closest to the compressed data.
+ */
+static int DDF_MakeDictionary(const char *path, const char *dict_path, unsigned flags)
+{
+    unsigned i;
+    unsigned n;
+    unsigned size;
+    unsigned scratch_pos;
+    u8 *dict;
+    U_HashMapEntry **samples;
+    DDF_FileList fl;
+
+    if (DDF_CollectFiles(path, &fl) == 0)
+        return 0;
+
+    U_HashMapInit(&dict_samples, &mem_arena, 256);
+
+    for (i = 0; i < fl.count; i++)
     {
-        U_Printf("key 'version_deconz' not found\n");
-        goto err;
+        scratch_pos = U_ScratchPos();
+        if (DDF_CreateBundle(((char**)fl.buf.buf)[i], DDF_CREATE_SKIP_NON_DDF | DDF_CREATE_TRAIN | flags) == 0)
+            U_Printf("failed to read files of: %s\n", ((char**)fl.buf.buf)[i]);
+        U_ScratchRestore(scratch_pos);
     }
-    */
 
-    /*** last_modified (required) ************************************/
-    PL_StatFile(path, &statbuf);
+    U_BufferFree(&fl.buf);
 
-    if (U_TimeToISO8601_UTC(statbuf.mtime, valbuf, VAL_BUF_SIZE))
+    /* only files which are in more than one bundle */
+    samples = U_ScratchAlloc((dict_samples.count + 1) * sizeof(*samples));
+    for (i = 0, n = 0; i < dict_samples.size; i++)
     {
-        /* cut off milliseconds .000Z */
-        valbuf[19] = 'Z';
-        valbuf[20] = '\0';
-        U_sstream_put_js_str(ss, "last_modified");
-        U_sstream_put_str(ss, ":");
-        U_sstream_put_js_str(ss, valbuf);
-        U_sstream_put_str(ss, ",");
+        if (dict_samples.entries[i].key && DDF_DictSampleGain(&dict_samples.entries[i]) > 0)
+            samples[n++] = &dict_samples.entries[i];
     }
 
+    U_qsort(samples, n, sizeof(*samples), DDF_CompareDictGain);
 
-    /* product (required) */
-    if (cj_copy_value(&cj, valbuf, VAL_BUF_SIZE, 0, "product"))
+    for (i = 0, size = 0; i < n; i++)
     {
-        U_sstream_put_js_str(ss, "product");
-        U_sstream_put_str(ss, ":");
-        U_sstream_put_js_str(ss, valbuf);
-        U_sstream_put_str(ss, ",");
+        if (size + samples[i]->key_len <= DDF_DICT_MAX_SIZE)
+            size += samples[i]->key_len;
+        else
+            samples[i] = NULL;
     }
-    else
+
+    for (i = 0; i < n;)
     {
-        U_Printf("key 'product' not found\n");
-        goto err;
+        if (samples[i] == NULL)
+            samples[i] = samples[--n];
+        else
+            i++;
     }
 
-    /*** device_identifiers (required) *********************************/
-    /*
-        Processes both, modelid and mfname, arrays in parallel.
-    */
-    ref_modelid0 = cj_value_ref(&cj, 0, "modelid");
-    if (cj_is_valid_ref(&cj, ref_modelid0) == 0)
+    if (n == 0)
     {
-        U_Printf("key 'modelid' not found\n");
-        goto err;
+        U_Printf("no files are shared by multiple bundles\n");
+        return 0;
     }
 
-    ref_mfname0 = cj_value_ref(&cj, 0, "manufacturername");
-    if (cj_is_valid_ref(&cj, ref_mfname0) == 0)
+    U_qsort(samples, n, sizeof(*samples), DDF_CompareDictCount);
+
+    dict = U_ScratchAlloc(size);
+    for (i = 0, size = 0; i < n; i++)
     {
-        U_Printf("key 'manufacturername' not found\n");
-        goto err;
+        U_memcpy(&dict[size], samples[i]->key, samples[i]->key_len);
+        size += samples[i]->key_len;
     }
 
-    U_sstream_put_js_str(ss, "device_identifiers");
-    U_sstream_put_str(ss, ":[");
-
-    devid_count = 0;
-    if (cj_is_array(&cj, ref_modelid0) && cj_is_array(&cj, ref_mfname0))
+    if (PL_WriteFile(dict_path, dict, size) == 0)
     {
-        ref_modelid1 = ref_modelid0 + 1;
-        ref_mfname1 = ref_mfname0 + 1;
+        U_Printf("failed to write %s\n", dict_path);
+        return 0;
+    }
 
-        for (; ;ref_modelid1++, ref_mfname1++)
-        {
-            if (cj_is_valid_ref(&cj, ref_modelid1) == 0)
-                goto err_invalid_model_mfname;
+    U_Printf("dictionary written to: %s (%u bytes, %u files, id %08X)\n", dict_path, size, n,
+             (unsigned)DDF_DictionaryId(dict, size));
 
-            if (cj_is_valid_ref(&cj, ref_mfname1) == 0)
-                goto err_invalid_model_mfname;
+    return 1;
+}
 
-            /* arrays must have equal arity */
-            if (cj.tokens[ref_modelid1].type != cj.tokens[ref_mfname1].type)
-                goto err_invalid_model_mfname;
+/** Loads the --dict dictionary used by DDF_Compress().
+ */
+static int DDF_LoadDictionary(const char *path)
+{
+    if (PL_MapFile(&ddf_dict, path) == 0 || ddf_dict.size == 0 || ddf_dict.size > DDF_DICT_MAX_SIZE)
+    {
+        PL_UnmapFile(&ddf_dict);
+        U_Printf("failed to load dictionary: %s\n", path);
+        return 0;
+    }
 
-            if (cj.tokens[ref_modelid1].type == CJ_TOKEN_ARRAY_END)
-                break;
+    ddf_dict_id = DDF_DictionaryId(ddf_dict.data, (unsigned)ddf_dict.size);
+    return 1;
+}
 
-            if (cj.tokens[ref_modelid1].parent != ref_modelid0)
-                goto err_invalid_model_mfname;
+/* 'ddfb catalog' and 'ddfb pack' tables, converted to little endian when written */
+typedef struct
+{
+    const char *dir;       /* bundle directory */
+    int pack;              /* collect the data of DDF_PackBundle for 'ddfb pack' */
+    U_HashMap strings_map; /* string -> offset in strings */
+    U_buffer strings;
+    unsigned strings_size;
+    U_buffer entries;      /* 4 x u32: hash, bundle, mfname, modelid */
+    unsigned entry_count;
+    U_buffer bundles;      /* 4 x u32: path, version, DESC data offset, DESC size */
+    unsigned bundle_count;
+    U_buffer pack_bundles; /* DDF_PackBundle per bundle */
+    unsigned pack_count;
+    u32 *slots;
+    unsigned slot_count;
+} DDF_Catalog;
+
+/* bundle of a pack, the HASH chunk has the first two fields */
+typedef struct
+{
+    u8 sha256[32];         /* over the DDFB chunk (the signed data) */
+    u32 bundle;            /* bundle index */
+    u32 size;              /* bundle file size */
+    u32 offset;            /* bundle offset in the pack */
+} DDF_PackBundle;
 
-            if (cj.tokens[ref_mfname1].parent != ref_mfname0)
-                goto err_invalid_model_mfname;
+static void DDF_CatalogListCallback(void *user, const char *name, int is_dir)
+{
+    unsigned len;
 
-            if (cj.tokens[ref_modelid1].type == CJ_TOKEN_ITEM_SEP)
-                continue;
+    len = U_strlen(name);
+    if (!is_dir && len > 4 && U_memcmp(&name[len - 4], ".ddf", 4) == 0)
+        DDF_AddFile(user, name);
+}
 
-            if (cj.tokens[ref_modelid1].type != CJ_TOKEN_STRING)
-                goto err_invalid_model_mfname;
+/** Adds a string to STRS, equal strings are stored once.
+ *
+ * \return the offset of the string.
+ */
+static u32 DDF_CatalogString(DDF_Catalog *cat, const char *str)
+{
+    int inserted;
+    unsigned len;
+    u32 *offset;
+    U_HashMapEntry *e;
 
+    len = U_strlen(str);
+    e = U_HashMapInsert(&cat->strings_map, str, len, &inserted);
+    U_ASSERT(e);
 
-            if (devid_count > 0)
-                U_sstream_put_str(ss, ",");
+    if (inserted)
+    {
+        if (cat->strings_size + len + 1 > cat->strings.size)
+            U_BufferResize(&cat->strings, (cat->strings_size + len + 1) * 2);
 
-            /* [ mfname, modelid ] */
-            U_sstream_put_str(ss, "[");
+        offset = U_AllocArena(&mem_arena, sizeof(*offset), U_ARENA_ALIGN_8);
+        *offset = cat->strings_size;
+        e->value = offset;
 
-            if (cj_copy_ref(&cj, valbuf, VAL_BUF_SIZE, ref_mfname1) == 0)
-                goto err_invalid_model_mfname;
+        U_memcpy(&cat->strings.buf[cat->strings_size], str, len + 1);
+        cat->strings_size += len + 1;
+    }
 
-            if (valbuf[0] == '$') /* resolve constant to actual mfname */
-            {
-                if (DDF_ResolveConstant(valbuf, valbuf1, VAL_BUF_SIZE) == 0)
-                    goto err_invalid_model_mfname;
-                U_sstream_put_js_str(ss, valbuf1);
-            }
-            else
-            {
-                U_sstream_put_js_str(ss, valbuf);
-            }
+    return *(u32*)e->value;
+}
+
+static void *DDF_CatalogAddRow(U_buffer *buf, unsigned *count, unsigned row_size)
+{
+    if ((*count + 1) * row_size > buf->size)
+        U_BufferResize(buf, (*count + 256) * row_size);
 
-            U_sstream_put_str(ss, ",");
+    *count += 1;
+    return &buf->buf[(*count - 1) * row_size];
+}
 
-            if (cj_copy_ref(&cj, valbuf, VAL_BUF_SIZE, ref_modelid1) == 0)
-                goto err_invalid_model_mfname;
-            U_sstream_put_js_str(ss, valbuf);
+/** Adds the DESC "device_identifiers" [[mfname, modelid], ...] of a bundle.
+ */
+static int DDF_CatalogAddBundle(DDF_Catalog *cat, const char *path, const char *name)
+{
+    int ret;
+    int depth;
+    unsigned n;
+    unsigned bundle;
+    cj_size i;
+    cj_token_ref ref;
+    char *mfname;
+    char *modelid;
+    char *version;
+    u32 *row;
+    DDF_PackBundle *pb;
+    PL_MappedFile mf;
+    DDFB_Bundle b;
+    DDFB_Chunk desc;
+    DDF_Doc doc;
 
-            U_sstream_put_str(ss, "]");
+    ret = 0;
+    mfname = U_ScratchAlloc(VAL_BUF_SIZE);
+    modelid = U_ScratchAlloc(VAL_BUF_SIZE);
+    version = U_ScratchAlloc(VAL_BUF_SIZE);
 
-            devid_count++;
-        }
-    }
-    else if (cj.tokens[ref_modelid0].type == CJ_TOKEN_STRING &&
-             cj.tokens[ref_mfname0].type == CJ_TOKEN_STRING)
+    if (PL_MapFile(&mf, path) == 0 || DDFB_Open(&b, mf.data, mf.size) == 0 ||
+        DDFB_FindChunk(&b, "DESC", &desc) == 0)
     {
-        /* [ mfname, modelid ] */
-        U_sstream_put_str(ss, "[");
+        U_Printf("no valid bundle: %s\n", path);
+        goto out;
+    }
 
-        if (cj_copy_ref(&cj, valbuf, VAL_BUF_SIZE, ref_mfname0) == 0)
-            goto err_invalid_model_mfname;
-        U_sstream_put_js_str(ss, valbuf);
+    if (DDF_ParseDoc(&doc, desc.data, desc.size) == 0)
+    {
+        U_Printf("invalid DESC chunk: %s\n", path);
+        goto out;
+    }
 
-        U_sstream_put_str(ss, ",");
+    if (cj_copy_value(&doc.cj, version, VAL_BUF_SIZE, 0, "version") == 0)
+        version[0] = '\0';
 
-        if (cj_copy_ref(&cj, valbuf, VAL_BUF_SIZE, ref_modelid0) == 0)
-            goto err_invalid_model_mfname;
-        U_sstream_put_js_str(ss, valbuf);
+    ref = cj_value_ref(&doc.cj, 0, "device_identifiers");
+    if (cj_is_array(&doc.cj, ref) == 0)
+    {
+        U_Printf("no device_identifiers in: %s\n", path);
+        goto out;
+    }
 
-        U_sstream_put_str(ss, "]");
+    bundle = cat->bundle_count;
+    row = DDF_CatalogAddRow(&cat->bundles, &cat->bundle_count, 4 * sizeof(u32));
+    row[0] = DDF_CatalogString(cat, name);
+    row[1] = DDF_CatalogString(cat, version);
+    row[2] = (u32)(desc.offset + 8);
+    row[3] = (u32)desc.size;
 
-        devid_count++;
-    }
-    else
+    if (cat->pack)
     {
-        goto err_invalid_model_mfname;
+        /* sha256 is set by DDF_HashPackBundles() */
+        pb = DDF_CatalogAddRow(&cat->pack_bundles, &cat->pack_count, sizeof(*pb));
+        pb->bundle = bundle;
+        pb->size = (u32)mf.size;
+        pb->offset = 0;
     }
 
-    if (devid_count == 0)
-        goto err_invalid_model_mfname;
+    /* the pairs are arrays with two strings in the device_identifiers array */
+    n = 0;
+    depth = 0;
+    for (i = ref + 1; i < doc.cj.tokens_pos; i++)
+    {
+        if (doc.cj.tokens[i].type == CJ_TOKEN_ARRAY_BEG)
+        {
+            depth++;
+            n = 0;
+        }
+        else if (doc.cj.tokens[i].type == CJ_TOKEN_ARRAY_END)
+        {
+            if (depth == 0)
+                break;
+            depth--;
+        }
+        else if (depth == 1 && doc.cj.tokens[i].type == CJ_TOKEN_STRING)
+        {
+            if (n == 0)
+                cj_copy_ref(&doc.cj, mfname, VAL_BUF_SIZE, i);
+            else if (n == 1 && cj_copy_ref(&doc.cj, modelid, VAL_BUF_SIZE, i))
+            {
+                row = DDF_CatalogAddRow(&cat->entries, &cat->entry_count, 4 * sizeof(u32));
+                row[0] = (u32)DDFB_DeviceHash(mfname, modelid);
+                row[1] = bundle;
+                row[2] = DDF_CatalogString(cat, mfname);
+                row[3] = DDF_CatalogString(cat, modelid);
+            }
+            n++;
+        }
+    }
 
-    /*** end device_identifiers ********************************************************/
-    U_sstream_put_str(ss, "]");
+    ret = 1;
 
-    /* end descriptor object */
-    U_sstream_put_str(ss, "}");
+out:
+    PL_UnmapFile(&mf);
+    return ret;
+}
 
-    U_Printf("\n%s\n", ss->str);
+/** Joins the bundle directory and a file name into scratch memory.
+ */
+static const char *DDF_CatalogPath(DDF_Catalog *cat, const char *name)
+{
+    U_SStream ss;
 
-    U_ScratchRestore(scratch_pos);
-    return 1;
+    U_sstream_init(&ss, U_ScratchAlloc(U_PATH_MAX), U_PATH_MAX);
+    U_sstream_put_str(&ss, cat->dir);
+    U_sstream_put_str(&ss, DIR_SEP_STR);
+    U_sstream_put_str(&ss, name);
 
-err:
-    return 0;
+    if (ss.status != U_SSTREAM_OK)
+    {
+        U_Printf("path too long: %s\n", name);
+        return NULL;
+    }
 
-err_invalid_model_mfname:
-    U_Printf("key 'manufacturername' or 'modelid' invalid\n");
-    return 0;
+    return ss.str;
 }
 
-static int DDF_ResolveGenericItem(const char *generic_items_path, const char *item_name, U_BStream *bs)
+/** Hashes the DDFB chunks of the pack bundles, up to U_SHA256_MULTI_MAX_LANES
+ * bundles are mapped at once and hashed in parallel.
+ */
+static int DDF_HashPackBundles(DDF_Catalog *cat)
 {
-    u8 *data;
+    int ret;
     unsigned i;
-    char *item_path;
-    char *rel_path;
-    unsigned rel_path_start;
+    unsigned n;
+    unsigned count;
     unsigned scratch_pos;
-    unsigned long hash;
-    unsigned extf_size_pos;
-    char mtime[32];
-    PL_Stat statbuf;
-    U_SStream ss;
+    const char *name;
+    const char *bundle_path;
+    const void *data[U_SHA256_MULTI_MAX_LANES];
+    unsigned long size[U_SHA256_MULTI_MAX_LANES];
+    u8 digests[U_SHA256_MULTI_MAX_LANES * U_SHA256_DIGEST_SIZE];
+    PL_MappedFile mf[U_SHA256_MULTI_MAX_LANES];
+    DDF_PackBundle *pb;
+    DDFB_Bundle b;
 
-    scratch_pos = U_ScratchPos();
+    ret = 1;
+    pb = (DDF_PackBundle*)cat->pack_bundles.buf;
+
+    for (i = 0; ret && i < cat->pack_count; i += count)
+    {
+        scratch_pos = U_ScratchPos();
+        count = cat->pack_count - i;
+        if (count > U_SHA256_MULTI_MAX_LANES)
+            count = U_SHA256_MULTI_MAX_LANES;
+
+        U_bzero(&mf[0], sizeof(mf));
+
+        for (n = 0; n < count; n++)
+        {
+            name = (const char*)&cat->strings.buf[((u32*)cat->bundles.buf)[pb[i + n].bundle * 4]];
+            bundle_path = DDF_CatalogPath(cat, name);
+
+            if (!bundle_path || PL_MapFile(&mf[n], bundle_path) == 0 ||
+                DDFB_Open(&b, mf[n].data, mf[n].size) == 0)
+            {
+                U_Printf("failed to read bundle: %s\n", name);
+                ret = 0;
+                break;
+            }
 
-    item_path = U_ScratchAlloc(U_PATH_MAX);
+            data[n] = DDFB_SignedData(&b, &size[n]);
+        }
 
-    U_sstream_init(&ss, item_path, U_PATH_MAX);
-    U_sstream_put_str(&ss, generic_items_path);
-    U_sstream_put_str(&ss, DIR_SEP_STR);
+        if (ret)
+        {
+            U_sha256_multi(&data[0], &size[0], count, &digests[0]);
+            for (n = 0; n < count; n++)
+                U_memcpy(&pb[i + n].sha256[0], &digests[n * U_SHA256_DIGEST_SIZE], U_SHA256_DIGEST_SIZE);
+        }
 
-    i = ss.pos;
-    rel_path_start = i - U_strlen("generic" DIR_SEP_STR "items") - 1;
-    rel_path = &item_path[rel_path_start];
-    U_sstream_put_str(&ss, item_name);
+        for (n = 0; n < count; n++)
+            PL_UnmapFile(&mf[n]);
 
-    for (; i < ss.pos; i++)
-    {
-        if (ss.str[i] == '/')
-            ss.str[i] = '_';
+        U_ScratchRestore(scratch_pos);
     }
 
-    U_sstream_put_str(&ss, "_item.json");
+    return ret;
+}
+
+/** Reads the bundles of a directory and fills the hash table.
+ */
+static int DDF_CollectCatalog(DDF_Catalog *cat, const char *path)
+{
+    unsigned i;
+    unsigned j;
+    unsigned scratch_pos;
+    u32 *entry;
+    const char *name;
+    const char *bundle_path;
+    DDF_FileList fl;
 
-    /* mark loaded files by remember the hash of relative path */
-    hash = U_hash_djb2(rel_path, U_strlen(rel_path));
+    U_bzero(&fl, sizeof(fl));
+    cat->dir = path;
 
-    for (i = 0; i < generic_item_cache_count; i++)
+    if (PL_ListDirectory(path, DDF_CatalogListCallback, &fl) == 0)
     {
-        if (generic_item_cache[i] == hash)
-        {
-            /*U_Printf("%s already known\n", rel_path);*/
-            U_ScratchRestore(scratch_pos);
-            return 1;
-        }
+        U_Printf("failed to open directory %s\n", path);
+        return 0;
     }
 
-    generic_item_cache[generic_item_cache_count] = hash;
-    generic_item_cache_count++;
-
-    if (PL_StatFile(item_path, &statbuf) == 0)
+    if (fl.count == 0)
     {
-        U_Printf("failed to resolve '%s'\n", item_path);
+        U_Printf("no bundles found in %s\n", path);
         return 0;
     }
 
-    data = U_ScratchAlloc(statbuf.size + 16);
+    U_qsort(fl.buf.buf, fl.count, sizeof(char*), DDF_ComparePaths);
+    U_HashMapInit(&cat->strings_map, &mem_arena, 256);
+    DDF_CatalogString(cat, ""); /* offset 0 */
 
-    if (PL_LoadFile(item_path, data, statbuf.size + 16) != (int)statbuf.size)
+    for (i = 0; i < fl.count; i++)
     {
-        U_Printf("failed to load: %s\n", item_path);
-        return 0;
-    }
+        scratch_pos = U_ScratchPos();
+        name = ((char**)fl.buf.buf)[i];
+        bundle_path = DDF_CatalogPath(cat, name);
 
-    /*U_Printf("add '%s' %u bytes\n", rel_path, statbuf.size);*/
+        if (bundle_path)
+            DDF_CatalogAddBundle(cat, bundle_path, name);
 
-    /*****************************************************************/
+        U_ScratchRestore(scratch_pos);
+    }
 
-    DDF_PutFourCC(bs, "EXTF");
-    extf_size_pos = bs->pos;
-    U_bstream_put_u32_le(bs, 0); /* chunk size dummy */
+    U_BufferFree(&fl.buf);
 
-    DDF_PutFourCC(bs, "JSON"); /* file type */
+    if (cat->bundle_count == 0)
+        return 0;
 
-    /* convert windows to unix path */
-    for (i = 0; rel_path[i]; i++)
-    {
-        if (rel_path[i] == '\\')
-            rel_path[i] = '/';
-    }
+    /* hash table with linear probing, at most half full */
+    for (cat->slot_count = 16; cat->slot_count < cat->entry_count * 2; cat->slot_count *= 2)
+        ;
 
-    /* put path without '\0' */
-    U_bstream_put_u16_le(bs, U_strlen(rel_path));
-    for (i = 0; i < U_strlen(rel_path); i++)
-        U_bstream_put_u8(bs, rel_path[i]);
+    cat->slots = U_ScratchAlloc(cat->slot_count * sizeof(u32));
+    U_bzero(cat->slots, cat->slot_count * sizeof(u32));
 
-    if (U_TimeToISO8601_UTC(statbuf.mtime, &mtime[0], sizeof(mtime)))
+    for (i = 0; i < cat->entry_count; i++)
     {
-        /* cut off milliseconds .000Z */
-        mtime[19] = 'Z';
-        mtime[20] = '\0';
+        entry = &((u32*)cat->entries.buf)[i * 4];
+        for (j = entry[0] & (cat->slot_count - 1); cat->slots[j] != 0; j = (j + 1) & (cat->slot_count - 1))
+            ;
+        cat->slots[j] = i + 1;
     }
 
-    /* modification time length without '\0' */
-    U_bstream_put_u16_le(bs, U_strlen(&mtime[0]));
-    /* modification time in ISO 8601 format */
-    for (i = 0; mtime[i]; i++)
-        U_bstream_put_u8(bs, (u8)mtime[i]);
-
-    U_bstream_put_u32_le(bs, statbuf.size);
-    for (i = 0; i < statbuf.size; i++)
-        U_bstream_put_u8(bs, data[i]);
+    /* strings are padded to keep the chunks 4 byte aligned */
+    if (cat->strings_size + 4 > cat->strings.size)
+        U_BufferResize(&cat->strings, cat->strings_size + 4);
 
-    /* EXTF chunk size */
-    i = (int)bs->pos;
-    bs->pos = extf_size_pos;
-    U_bstream_put_u32_le(bs, i - ((int)extf_size_pos + 4));
-    bs->pos = (unsigned)i;
-
-    U_ScratchRestore(scratch_pos);
+    for (; cat->strings_size & 3; cat->strings_size++)
+        cat->strings.buf[cat->strings_size] = '\0';
 
     return 1;
 }
 
-static int DDF_AddGenericItems(u8 *ddf, int ddf_size, U_BStream *bs)
+static void DDF_FreeCatalog(DDF_Catalog *cat)
 {
+    U_buffer *bufs[4];
     unsigned i;
-    cj_ctx cj;
-    cj_token *tok;
-    cj_token_ref ref_subdevices;
-    cj_token_ref ref_subdev;
-    cj_token_ref ref_items;
-    cj_token_ref ref_item_name;
-    char *valbuf;
-    unsigned scratch_pos;
-    unsigned tok_pos;
-    char *generic_items_path;
 
-    scratch_pos = U_ScratchPos();
-
-    valbuf = U_ScratchAlloc(VAL_BUF_SIZE);
+    bufs[0] = &cat->strings;
+    bufs[1] = &cat->entries;
+    bufs[2] = &cat->bundles;
+    bufs[3] = &cat->pack_bundles;
 
-    /*** search generic/items directory ******************************/
-    /* walk dir tree from DDF up and look for generic/items/attr_id_item.json file.
-     */
-    generic_items_path = U_ScratchAlloc(U_PATH_MAX);
+    for (i = 0; i < 4; i++)
+    {
+        if (bufs[i]->buf)
+            U_BufferFree(bufs[i]);
+    }
+}
 
-    i = U_strlen(&ddf_base_path[0]);
-    U_memcpy(generic_items_path, &ddf_base_path[0], i + 1);
-    U_memcpy(&generic_items_path[i], "generic" DIR_SEP_STR "items", U_strlen("generic" DIR_SEP_STR "items") + 1);
+/** Size of the chunks written by DDF_PutCatalog().
+ */
+static unsigned long DDF_CatalogSize(const DDF_Catalog *cat)
+{
+    return (8 + 16) + (8 + cat->slot_count * 4) + (8 + cat->entry_count * 16) +
+           (8 + cat->bundle_count * 16) + (8 + cat->strings_size);
+}
 
-    /*** parse JSON **************************************************/
-    cj.tokens = U_ScratchAlloc(MAX_CJ_TOKENS * sizeof(cj_token));
-    cj_parse_init(&cj, (char*)ddf, (unsigned)ddf_size, cj.tokens, MAX_CJ_TOKENS);
+static void DDF_PutCatalogTable(U_BStream *bs, const char *tag, const U_buffer *buf, unsigned count)
+{
+    unsigned i;
 
-    cj_parse(&cj);
-    if (cj.status != CJ_OK)
-    {
-        U_Printf("failed to parse JSON, status: %d\n", (int)cj.status);
-        goto err;
-    }
+    DDF_PutFourCC(bs, tag);
+    U_bstream_put_u32_le(bs, count * 4 * sizeof(u32));
 
-    ref_subdevices = cj_value_ref(&cj, 0, "subdevices");
-    if (cj_is_valid_ref(&cj, ref_subdevices) == 0)
-    {
-        U_Printf("key 'subdevices' not found\n");
-        goto err;
-    }
+    for (i = 0; i < count * 4; i++)
+        U_bstream_put_u32_le(bs, ((const u32*)buf->buf)[i]);
+}
 
-    for (tok_pos = ref_subdevices; tok_pos < cj.tokens_pos; tok_pos++)
-    {
-        tok = &cj.tokens[tok_pos];
-        if (tok->parent == ref_subdevices && tok->type == CJ_TOKEN_OBJECT_BEG)
-        {
-            ref_subdev = tok_pos;
+/** Writes the CATH, SLOT, ENTR, BNDL and STRS chunks.
+ */
+static void DDF_PutCatalog(U_BStream *bs, const DDF_Catalog *cat)
+{
+    unsigned i;
 
-            ref_items = cj_value_ref(&cj, ref_subdev, "items");
-            if (cj_is_valid_ref(&cj, ref_items) == 0)
-            {
-                U_Printf("key 'items' not found\n");
-                goto err;
-            }
+    DDF_PutFourCC(bs, "CATH");
+    U_bstream_put_u32_le(bs, 16);
+    U_bstream_put_u32_le(bs, DDFB_CATALOG_VERSION);
+    U_bstream_put_u32_le(bs, cat->slot_count);
+    U_bstream_put_u32_le(bs, cat->entry_count);
+    U_bstream_put_u32_le(bs, cat->bundle_count);
 
-            for (tok_pos = ref_items; tok_pos < cj.tokens_pos; tok_pos++)
-            {
-                tok = &cj.tokens[tok_pos];
-
-                if (tok->parent == ref_subdev && tok->type == CJ_TOKEN_OBJECT_END)
-                    break; /* end of items array */
-
-                if (tok->parent == ref_items && tok->type == CJ_TOKEN_OBJECT_BEG)
-                {
-                    ref_item_name = cj_value_ref(&cj, tok_pos, "name");
-                    if (cj_is_valid_ref(&cj, ref_item_name) == 0)
-                    {
-                        U_Printf("key item.'name' not found\n");
-                        goto err;
-                    }
-
-                    if (cj_copy_ref(&cj, valbuf, VAL_BUF_SIZE, ref_item_name) == 0)
-                        goto err;
-
-                    if (DDF_ResolveGenericItem(generic_items_path, valbuf, bs) == 0)
-                    {
-                        U_Printf("failed to resolve file for generic item: %s\n", valbuf);
-                        goto err;
-                    }
-                }
-            }
-        }
-    }
+    DDF_PutFourCC(bs, "SLOT");
+    U_bstream_put_u32_le(bs, cat->slot_count * 4);
+    for (i = 0; i < cat->slot_count; i++)
+        U_bstream_put_u32_le(bs, cat->slots[i]);
 
-    U_ScratchRestore(scratch_pos);
-    return 1;
+    DDF_PutCatalogTable(bs, "ENTR", &cat->entries, cat->entry_count);
+    DDF_PutCatalogTable(bs, "BNDL", &cat->bundles, cat->bundle_count);
 
-err:
-    U_ScratchRestore(scratch_pos);
-    return 0;
+    DDF_PutFourCC(bs, "STRS");
+    U_bstream_put_u32_le(bs, cat->strings_size);
+    U_bstream_put_bytes(bs, cat->strings.buf, cat->strings_size);
 }
 
-static int DDF_LoadConstants(void)
+/** Creates a catalog of the bundles in a directory, see README.md for the format.
+ *
+ * Each (manufacturername, modelid) pair of the bundle descriptors is put
+ * into a hash table, so a loader can find the bundles of a device from the
+ * mapped catalog file without reading the bundles.
+ */
+static int DDF_MakeCatalog(const char *path, const char *catalog_path)
 {
-    U_SStream ss;
-    PL_Stat statbuf;
-    char *constants_path;
+    int ret;
+    unsigned long size;
+    u8 *data;
+    DDF_Catalog cat;
+    U_BStream bs;
 
-    /*** search generic/items directory ******************************/
-    /* walk dir tree from DDF up and look for generic/items/attr_id_item.json file.
-     */
-    constants_content_size = 0;
-    constants_path = U_ScratchAlloc(U_PATH_MAX);
-    U_sstream_init(&ss, constants_path, U_PATH_MAX);
+    ret = 0;
+    U_bzero(&cat, sizeof(cat));
 
-    U_sstream_put_str(&ss, &ddf_base_path[0]);
-    U_sstream_put_str(&ss, "generic" DIR_SEP_STR "constants.json");
+    if (DDF_CollectCatalog(&cat, path) == 0)
+        goto out;
 
-     /*** load private key file ***************************************/
-    if (PL_StatFile(constants_path, &statbuf) != 1)
-    {
-        U_Printf("failed to open %s\n", constants_path);
-        return 0;
-    }
+    size = 8 + DDF_CatalogSize(&cat);
+    data = U_ScratchAlloc(size);
+    U_bstream_init(&bs, data, size);
 
-    if (statbuf.size < 8)
-        return 0;
+    DDF_PutFourCC(&bs, "RIFF");
+    U_bstream_put_u32_le(&bs, size - 8);
+    DDF_PutCatalog(&bs, &cat);
 
-    constants_content = U_ScratchAlloc(statbuf.size + 1);
+    U_ASSERT(bs.status == U_BSTREAM_OK && bs.pos == size);
 
-    if (PL_LoadFile(constants_path, constants_content, statbuf.size + 1) != (int)statbuf.size)
+    if (PL_WriteFile(catalog_path, data, size) == 0)
     {
-        U_Printf("failed to read %s\n", constants_path);
-        return 0;
+        U_Printf("failed to write %s\n", catalog_path);
+        goto out;
     }
 
-    if (U_TimeToISO8601_UTC(statbuf.mtime, &constants_mtime[0], sizeof(constants_mtime)))
-    {
-        /* cut off milliseconds .000Z */
-        constants_mtime[19] = 'Z';
-        constants_mtime[20] = '\0';
-    }
-    else
-    {
-        constants_mtime[0] = '\0';
-    }
+    U_Printf("catalog written to: %s (%u bundles, %u devices, %lu bytes)\n", catalog_path,
+             cat.bundle_count, cat.entry_count, size);
+    ret = 1;
 
-    constants_content_size = statbuf.size;
-    return 1;
+out:
+    DDF_FreeCatalog(&cat);
+    return ret;
+}
+
+static int DDF_ComparePackHashes(const void *a, const void *b)
+{
+    return U_memcmp(((const DDF_PackBundle*)a)->sha256, ((const DDF_PackBundle*)b)->sha256, 32);
 }
 
-/** Adds a EXTF chunk with filtered constants (only the ones used in the DDF).
+/** Copies the bundle files into the pack, the sizes must not have changed since
+ *  DDF_CollectCatalog().
  */
-static int DDF_AddConstants(u8 *ddf, int ddf_size, U_BStream *bs)
+static int DDF_WritePackBundles(DDF_Catalog *cat, PL_File *file, unsigned long pos)
 {
-    cj_ctx cj;
-    cj_token *tok;
-    char *valbuf0;
-    char *valbuf1;
-    const char *path;
+    int ret;
     unsigned i;
     unsigned scratch_pos;
-    unsigned tok_pos;
-    unsigned constants_cache_pos;
-    unsigned long *constants_cache;
-    unsigned long hash;
-    unsigned extf_size_pos;
-    unsigned len;
-    U_SStream ss;
-
-    scratch_pos = U_ScratchPos();
-
-    /* build filtered constants object */
-    ss.len = 16383; /* 16K should be enough */
-    ss.str = U_ScratchAlloc(ss.len);
-    U_sstream_init(&ss, ss.str, ss.len);
-
-    valbuf0 = U_ScratchAlloc(VAL_BUF_SIZE);
-    valbuf1 = U_ScratchAlloc(VAL_BUF_SIZE);
-    constants_cache_pos = 0;
-    constants_cache = U_ScratchAlloc(MAX_CONSTANTS * sizeof(*constants_cache));
-
-    /*** parse JSON **************************************************/
-    cj.tokens = U_ScratchAlloc(MAX_CJ_TOKENS * sizeof(cj_token));
-    cj_parse_init(&cj, (char*)ddf, (unsigned)ddf_size, cj.tokens, MAX_CJ_TOKENS);
-
-    cj_parse(&cj);
-    if (cj.status != CJ_OK)
-    {
-        U_Printf("failed to parse JSON, status: %d\n", (int)cj.status);
-        goto err;
-    }
+    const char *bundle_path;
+    const DDF_PackBundle *pb;
+    PL_MappedFile mf;
+    u8 zeros[DDF_PACK_ALIGN];
 
-    U_sstream_put_str(&ss, "{");
+    U_bzero(&zeros[0], sizeof(zeros));
 
-    for (tok_pos = 0; tok_pos < cj.tokens_pos; tok_pos++)
+    for (i = 0; i < cat->bundle_count; i++)
     {
-        tok = &cj.tokens[tok_pos];
-        if (tok[0].type != CJ_TOKEN_STRING)
-            continue;
+        pb = &((const DDF_PackBundle*)cat->pack_bundles.buf)[i];
+        U_ASSERT(pb->offset >= pos && pb->offset - pos < DDF_PACK_ALIGN);
 
-        if (cj_copy_ref(&cj, valbuf0, VAL_BUF_SIZE, tok_pos) == 0)
-            goto err;
+        scratch_pos = U_ScratchPos();
+        bundle_path = DDF_CatalogPath(cat, (const char*)&cat->strings.buf[((u32*)cat->bundles.buf)[i * 4]]);
 
-        if (valbuf0[0] == '$')
+        ret = 0;
+        if (bundle_path && PL_MapFile(&mf, bundle_path))
         {
-            if (valbuf0[1] < 'A' || valbuf0[1] > 'Z')
-                continue; /* only upper-case constants */
-
-            if (constants_cache_pos == MAX_CONSTANTS)
-            {
-                U_Printf("failed to add constant, cache size (%u) exhausted\n", MAX_CONSTANTS);
-                goto err;
-            }
+            if (mf.size != pb->size)
+                U_Printf("bundle changed: %s\n", bundle_path);
+            else if (PL_FileWrite(file, &zeros[0], pb->offset - pos) && PL_FileWrite(file, mf.data, mf.size))
+                ret = 1;
 
-            hash = U_hash_djb2(valbuf0, U_strlen(valbuf0));
-
-            for (i = 0; i < constants_cache_pos; i++)
-            {
-                if (constants_cache[i] == hash)
-                    break;
-            }
-
-            if (i == constants_cache_pos) /* not in cache yet */
-            {
-                if (DDF_ResolveConstant(valbuf0, valbuf1, VAL_BUF_SIZE) == 0)
-                    goto err;
-
-                if (constants_cache_pos)
-                    U_sstream_put_str(&ss, ",");
-
-                U_sstream_put_js_str(&ss, valbuf0);
-                U_sstream_put_str(&ss, ":");
-                U_sstream_put_js_str(&ss, valbuf1);
-
-                constants_cache[constants_cache_pos] = hash;
-                constants_cache_pos++;
-            }
+            PL_UnmapFile(&mf);
         }
-    }
-
-    U_sstream_put_str(&ss, "}");
 
-    /*** add EXTF chunk **********************************************/
-    DDF_PutFourCC(bs, "EXTF");
-    extf_size_pos = bs->pos;
-    U_bstream_put_u32_le(bs, 0); /* chunk size dummy */
+        U_ScratchRestore(scratch_pos);
 
-    DDF_PutFourCC(bs, "JSON"); /* file type */
+        if (ret == 0)
+            return 0;
 
-    path = "generic/constants_min.json";
-    len = U_strlen(path);
-    /* put path without '\0' */
-    U_bstream_put_u16_le(bs, len);
-    for (i = 0; i < len; i++)
-        U_bstream_put_u8(bs, path[i]);
-
-    /* modification time length without '\0' */
-    U_bstream_put_u16_le(bs, U_strlen(&constants_mtime[0]));
-    /* modification time in ISO 8601 format */
-    for (i = 0; constants_mtime[i]; i++)
-        U_bstream_put_u8(bs, (u8)constants_mtime[i]);
-
-    U_bstream_put_u32_le(bs, ss.pos);
-    for (i = 0; i < ss.pos; i++)
-        U_bstream_put_u8(bs, (u8)ss.str[i]);
-
-    /* EXTF chunk size */
-    i = (int)bs->pos;
-    bs->pos = extf_size_pos;
-    U_bstream_put_u32_le(bs, i - ((int)extf_size_pos + 4));
-    bs->pos = (unsigned)i;
+        pos = pb->offset + pb->size;
+    }
 
-    U_ScratchRestore(scratch_pos);
     return 1;
-
-err:
-    U_ScratchRestore(scratch_pos);
-    return 0;
 }
 
-static int DDF_CreateBundle(const char *path)
+/** Creates a pack of the bundles in a directory, see README.md for the format.
+ *
+ * The pack is a catalog with an additional index by bundle hash, followed
+ * by the unmodified bundle files. Each bundle starts at a DDF_PACK_ALIGN
+ * aligned offset.
+ */
+static int DDF_MakePack(const char *path, const char *pack_path)
 {
-    u8 *ddf;
-    U_SStream ss;
+    int ret;
+    unsigned i;
+    unsigned pad;
+    unsigned long pos;
+    unsigned long size;
+    unsigned long data_pos;
+    u8 *data;
+    DDF_PackBundle *pb;
+    DDF_PackBundle *hashes;
+    DDF_Catalog cat;
     U_BStream bs;
-    extfile extf;
-
-    u32 ddfb_size_pos;
-    int beg;
-    int end;
-    int ddf_size;
-    int tsize = U_MEGA_BYTES(1);
-    int slen;
-    int i;
-    char *str;
-    char *abs_path;
-    unsigned extf_size_pos;
+    PL_File file;
 
-    generic_item_cache_count = 0;
+    ret = 0;
+    U_bzero(&cat, sizeof(cat));
+    cat.pack = 1;
 
-    abs_path = U_ScratchAlloc(U_PATH_MAX);
-    U_ASSERT(abs_path);
+    if (DDF_CollectCatalog(&cat, path) == 0 || DDF_HashPackBundles(&cat) == 0)
+        goto out;
 
-    if (!PL_RealPath(path, abs_path, U_PATH_MAX))
-    {
-        U_Printf("failed to resolve: %s\n", path);
-        return 0;
-    }
+    pb = (DDF_PackBundle*)cat.pack_bundles.buf;
 
-    if (DDF_ResolveBasePath(abs_path) == 0)
-    {
-        return 0;
-    }
+    /* index chunks, JUNK padding and BNDS chunk header up to the first bundle */
+    pos = 8 + DDF_CatalogSize(&cat) + (8 + cat.bundle_count * 8) + (8 + cat.bundle_count * 36);
+    pad = (DDF_PACK_ALIGN - (pos + 16) % DDF_PACK_ALIGN) % DDF_PACK_ALIGN;
+    data_pos = pos + 8 + pad + 8;
 
-    if (DDF_LoadConstants() == 0)
+    for (i = 0, pos = data_pos; i < cat.bundle_count; i++)
     {
-        return 0;
+        pos = (pos + DDF_PACK_ALIGN - 1) & ~(unsigned long)(DDF_PACK_ALIGN - 1);
+        pb[i].offset = (u32)pos;
+        pos += pb[i].size;
     }
 
-    ddf = U_ScratchAlloc(tsize);
-    U_ASSERT(ddf);
-
-    ddf_size = PL_LoadFile(abs_path, ddf, tsize);
-    if (ddf_size <= 0)
+    if (pos > 0xFFFFFFFFUL)
     {
-        U_Printf("failed to read: %s\n", abs_path);
-        return 0;
+        U_Printf("pack exceeds 4 GB\n");
+        goto out;
     }
 
-    /* RIFF encoded output*/
-    bs.size = U_MEGA_BYTES(1);
-    bs.data = U_ScratchAlloc(bs.size);
-    U_ASSERT(bs.data);
-    U_bstream_init(&bs, bs.data, bs.size);
+    size = pos;
+    data = U_ScratchAlloc(data_pos);
+    U_bstream_init(&bs, data, data_pos);
 
-    /*** RIFF header *************************************************/
     DDF_PutFourCC(&bs, "RIFF");
-    U_ASSERT(bs.pos == 4);
-    U_bstream_put_u32_le(&bs, 0); /* dummy filled later */
-
-    /*** DDFB header *************************************************/
-    DDF_PutFourCC(&bs, "DDFB"); /* DDF_BUNDLE_MAGIC */
-    U_ASSERT(bs.pos == 12);
-    ddfb_size_pos = bs.pos;
-    U_bstream_put_u32_le(&bs, 0); /* dummy filled later */
+    U_bstream_put_u32_le(&bs, size - 8);
+    DDF_PutCatalog(&bs, &cat);
 
-    /*** DESC chunk **************************************************/
-    DDF_PutFourCC(&bs, "DESC");
+    DDF_PutFourCC(&bs, "BOFS");
+    U_bstream_put_u32_le(&bs, cat.bundle_count * 8);
+    for (i = 0; i < cat.bundle_count; i++)
+    {
+        U_bstream_put_u32_le(&bs, pb[i].offset);
+        U_bstream_put_u32_le(&bs, pb[i].size);
+    }
 
-    ss.len = U_KILO_BYTES(8192);
-    ss.str = U_ScratchAlloc(ss.len);
-    ss.pos = 0;
+    hashes = U_ScratchAlloc(cat.bundle_count * sizeof(*hashes));
+    U_memcpy(hashes, pb, cat.bundle_count * sizeof(*hashes));
+    U_qsort(hashes, cat.bundle_count, sizeof(*hashes), DDF_ComparePackHashes);
 
-    if (DDF_MakeDescriptor(abs_path, ddf, ddf_size, &ss) == 0)
+    DDF_PutFourCC(&bs, "HASH");
+    U_bstream_put_u32_le(&bs, cat.bundle_count * 36);
+    for (i = 0; i < cat.bundle_count; i++)
     {
-        U_Printf("failed to make DESC chunk\n");
-        return 0;
+        U_bstream_put_bytes(&bs, &hashes[i].sha256[0], 32);
+        U_bstream_put_u32_le(&bs, hashes[i].bundle);
     }
 
-    U_bstream_put_u32_le(&bs, ss.pos);
-    U_ASSERT(bs.pos == 24);
-    for (i = 0; i < (int)ss.pos; i++)
-        U_bstream_put_u8(&bs, ss.str[i]);
-
-    /*** DDFC chunk **************************************************/
-    /* Aka the base DDF JSON file. */
-    /* TODO compress */
-    DDF_PutFourCC(&bs, "DDFC");
-    U_bstream_put_u32_le(&bs, ddf_size);
-    for (i = 0; i < ddf_size; i++)
-        U_bstream_put_u8(&bs, ddf[i]);
-
-
-    /*** EXTF chunk(s) ***********************************************/
-    U_sstream_init(&ss, ddf, ddf_size);
-    while (U_sstream_at_end(&ss) == 0)
-    {
-       if (U_sstream_starts_with(&ss, "\"script\""))
-       {
-          ss.pos += 8; /* move behind "script" */
-          while (U_sstream_at_end(&ss) == 0 && U_sstream_peek_char(&ss) != '\"')
-          {
-            ss.pos++;
-          }
-
-          beg = 0;
-          end = 0;
-          if (U_sstream_peek_char(&ss) == '\"')
-          {
-            ss.pos++;
-            beg = ss.pos;
-          }
-
-          while (U_sstream_at_end(&ss) == 0 && U_sstream_peek_char(&ss) != '\"')
-          {
-            ss.pos++;
-          }
-
-          if (U_sstream_peek_char(&ss) == '\"')
-          {
-            end = ss.pos;
-            ss.pos++;
-          }
-
-          slen = end - beg;
-          if (beg && end && slen > 0 && slen < 1024)
-          {
-            str = U_ScratchAlloc(slen + 1);
-            U_ASSERT(str);
-            U_memcpy(str, &ddf[beg], slen);
-            str[slen] = '\0';
-
-            extf = DDF_ResolveExtFile(abs_path, str);
-            if (extf.size == 0)
-            {
-              U_Printf("failed to resolve %s\n", str);
-              return 0;
-            }
-            else
-            {
-                U_Printf("resolved %s (%d bytes)\n", str, extf.size);
-                DDF_PutFourCC(&bs, "EXTF");
-                extf_size_pos = bs.pos;
-                U_bstream_put_u32_le(&bs, 0); /* chunk size dummy */
-
-                DDF_PutFourCC(&bs, "SCJS"); /* file type */
-
-                /* put path without '\0' */
-                U_bstream_put_u16_le(&bs, slen);
-                for (i = 0; i < slen; i++)
-                    U_bstream_put_u8(&bs, str[i]);
-
-                /* modification time length without '\0' */
-                U_bstream_put_u16_le(&bs, U_strlen(&extf.mtime[0]));
-                /* modification time in ISO 8601 format */
-                for (i = 0; extf.mtime[i]; i++)
-                    U_bstream_put_u8(&bs, (u8)extf.mtime[i]);
-
-                U_bstream_put_u32_le(&bs, extf.size);
-                for (i = 0; i < extf.size; i++)
-                    U_bstream_put_u8(&bs, extf.mem[i]);
-
-                /* EXTF chunk size */
-                i = (int)bs.pos;
-                bs.pos = extf_size_pos;
-                U_bstream_put_u32_le(&bs, i - ((int)extf_size_pos + 4));
-                bs.pos = (unsigned)i;
-            }
-          }
-       }
+    DDF_PutFourCC(&bs, "JUNK");
+    U_bstream_put_u32_le(&bs, pad);
+    for (i = 0; i < pad; i++)
+        U_bstream_put_u8(&bs, 0);
 
-       ss.pos++;
-    }
+    DDF_PutFourCC(&bs, "BNDS");
+    U_bstream_put_u32_le(&bs, size - data_pos);
+
+    U_ASSERT(bs.status == U_BSTREAM_OK && bs.pos == data_pos);
 
-    /*** EXTF chunk(s) generic items *********************************/
-    if (DDF_AddGenericItems(ddf, ddf_size, &bs) == 0)
+    if (PL_FileOpen(&file, pack_path, PL_FILE_WRITE) == 0)
     {
-        U_Printf("failed to add generic items\n");
-        return 0;
+        U_Printf("failed to write %s\n", pack_path);
+        goto out;
     }
 
-    if (DDF_AddConstants(ddf, ddf_size, &bs) == 0)
+    ret = PL_FileWrite(&file, data, data_pos) && DDF_WritePackBundles(&cat, &file, data_pos);
+    PL_FileClose(&file);
+
+    if (ret == 0)
     {
-        U_Printf("failed to add constants\n");
-        return 0;
+        U_Printf("failed to write %s\n", pack_path);
+        PL_DeleteFile(pack_path);
+        goto out;
     }
 
-    /* DDFB chunk size */
-    i = (int)bs.pos;
-    bs.pos = ddfb_size_pos;
-    U_bstream_put_u32_le(&bs, i - ((int)ddfb_size_pos + 4));
-    bs.pos = (unsigned)i;
+    U_Printf("pack written to: %s (%u bundles, %u devices, %lu bytes)\n", pack_path,
+             cat.bundle_count, cat.entry_count, size);
 
-    return DDF_StoreBundle(abs_path, &bs);
+out:
+    DDF_FreeCatalog(&cat);
+    return ret;
 }
 
-static int uECC_RNG_Callback(uint8_t *dest, unsigned size)
+/** Prints the bundles of a device found in a catalog or pack.
+ */
+static int DDF_FindDevice(const char *catalog_path, const char *mfname, const char *modelid)
 {
-    if (PL_FillRandom(dest, size) == 0)
-        return 0;
-    return 1;
-}
+    int ret;
+    int is_pack;
+    unsigned long pos;
+    PL_MappedFile mf;
+    DDFB_Pack pack;
+    DDFB_Bundle bundle;
+    DDFB_CatalogMatch match;
 
-int ECC_CreateKeyPair(const char *path)
-{
-    int result;
-    U_SStream ss;
-    const struct uECC_Curve_t * curve;
-    unsigned char private_key[32];
-    unsigned char public_key[64];
-    unsigned char compressed_pubkey[33];
-    char outpath[U_PATH_MAX];
+    ret = 0;
 
-    uECC_set_rng(uECC_RNG_Callback);
+    if (PL_MapFile(&mf, catalog_path) == 0 || DDFB_CatalogOpen(&pack.catalog, mf.data, mf.size) == 0)
+    {
+        U_Printf("no valid catalog: %s\n", catalog_path);
+        goto out;
+    }
 
-    curve = uECC_secp256k1();
+    is_pack = DDFB_PackOpen(&pack, mf.data, mf.size);
 
-    if (uECC_make_key(public_key, private_key, curve) != 1)
+    pos = 0;
+    while (DDFB_CatalogFind(&pack.catalog, mfname, modelid, &pos, &match))
     {
-        printf("uECC_make_key() failed\n");
-        return 0;
+        if (is_pack && DDFB_PackBundle(&pack, match.bundle, &bundle))
+            U_Printf("%s version: %s, offset: %lu, size: %lu\n", match.path, match.version,
+                     (unsigned long)(bundle.data - mf.data), bundle.size);
+        else
+            U_Printf("%s version: %s\n", match.path, match.version);
+        ret = 1;
     }
 
-    uECC_compress(public_key, compressed_pubkey, curve);
-
-    U_sstream_init(&ss, &outpath[0], sizeof(outpath));
-    U_sstream_put_str(&ss, path);
+    if (ret == 0)
+        U_Printf("no bundle found for: %s, %s\n", mfname, modelid);
 
-    result = 0;
-    if (PL_WriteFile(ss.str, private_key, sizeof(private_key)) == 1)
-        result = 1;
+out:
+    PL_UnmapFile(&mf);
+    return ret;
+}
 
-    U_sstream_put_str(&ss, ".pub");
-    if (PL_WriteFile(ss.str, compressed_pubkey, sizeof(compressed_pubkey)) == 1)
-        result += 1;
+/*** trusted keyring *********************************************************/
 
-    U_Printf("private key: ");
-    print_hex(private_key, sizeof(private_key));
-    U_Printf("\n");
+/* Public keys of a keyring file, see README.md for the format.
+ *
+ * Each key is decompressed and prepared by the backend once when the
+ * keyring is loaded. Signatures by keys which aren't in the keyring are
+ * rejected by a binary search before any EC math.
+ */
+typedef struct
+{
+    const ECC_Backend *ecc;
+    unsigned count;
+    U_buffer pubkeys; /* count x 33 byte compressed keys, sorted */
+    U_buffer keys;    /* count x ecc->key_size prepared keys */
+} ECC_Keyring;
 
-    U_Printf("public key:  ");
-    print_hex(compressed_pubkey, sizeof(compressed_pubkey));
-    U_Printf("\n");
+static int ECC_ComparePubkeys(const void *a, const void *b)
+{
+    return U_memcmp(a, b, 33);
+}
 
-    return result == 2 ? 1 : 0;
+static void ECC_FreeKeyring(ECC_Keyring *ring)
+{
+    if (ring->pubkeys.buf)
+        U_BufferFree(&ring->pubkeys);
+    if (ring->keys.buf)
+        U_BufferFree(&ring->keys);
 }
 
-static ChunkRef GetChunkRef(u8 *data, u32 size, u32 offset, const char *fourcc)
+/** Loads a keyring file, the keys must be sorted and valid.
+ */
+static int ECC_LoadKeyring(ECC_Keyring *ring, const char *path)
 {
-    u32 tag;
-    u32 chunk_tag;
-    u32 chunk_size;
+    int ret;
+    unsigned i;
+    unsigned long count;
+    unsigned long keys_size;
+    u8 tag[4];
+    u8 public_key[64];
+    const u8 *pubkey;
+    PL_MappedFile mf;
     U_BStream bs;
-    unsigned len;
-    ChunkRef result;
 
-    U_bzero(&result, sizeof(result));
+    ret = 0;
+    U_bzero(ring, sizeof(*ring));
+    ring->ecc = ecc_backends[0];
+
+    if (PL_MapFile(&mf, path) == 0)
+    {
+        U_Printf("failed to read %s\n", path);
+        return 0;
+    }
+
+    /* RIFF, KRNH: version, key count, KEYS: the keys padded to 4 bytes */
+    U_bstream_init(&bs, (void*)mf.data, mf.size);
+    U_bstream_get_bytes(&bs, tag, 4);
+    if (bs.status != U_BSTREAM_OK || U_memcmp(tag, "RIFF", 4) != 0 ||
+        U_bstream_get_u32_le(&bs) != mf.size - 8)
+        goto invalid;
 
-    U_ASSERT(offset < size);
-    U_bstream_init(&bs, data, size);
-    bs.pos = offset;
+    U_bstream_get_bytes(&bs, tag, 4);
+    if (U_memcmp(tag, "KRNH", 4) != 0 || U_bstream_get_u32_le(&bs) != 8 ||
+        U_bstream_get_u32_le(&bs) != DDF_KEYRING_VERSION)
+        goto invalid;
+
+    count = U_bstream_get_u32_le(&bs);
+    keys_size = (count * 33 + 3) & ~3UL;
+    U_bstream_get_bytes(&bs, tag, 4);
+    if (bs.status != U_BSTREAM_OK || count == 0 || count > DDF_KEYRING_MAX_KEYS ||
+        U_memcmp(tag, "KEYS", 4) != 0 || U_bstream_get_u32_le(&bs) != keys_size ||
+        bs.pos + keys_size != mf.size)
+        goto invalid;
 
-    len = U_strlen(fourcc);
-    U_ASSERT(len == 4);
-    U_memcpy(&tag, fourcc, 4);
+    ring->count = (unsigned)count;
+    U_BufferInit(&ring->pubkeys, ring->count * 33);
+    U_BufferInit(&ring->keys, ring->count * ring->ecc->key_size);
+    U_bstream_get_bytes(&bs, ring->pubkeys.buf, ring->count * 33);
 
-    for (;bs.status == U_BSTREAM_OK;)
+    for (i = 0; i < ring->count; i++)
     {
-        chunk_tag = U_bstream_get_u32_le(&bs);
-        chunk_size = U_bstream_get_u32_le(&bs);
+        pubkey = &ring->pubkeys.buf[i * 33];
+        if (i > 0 && ECC_ComparePubkeys(pubkey - 33, pubkey) >= 0)
+            goto invalid;
 
-        if (chunk_tag == tag)
+        if (ring->ecc->decompress(pubkey, public_key) != 1 ||
+            ring->ecc->prepare_key(&ring->keys.buf[i * ring->ecc->key_size], public_key) != 1)
         {
-            result.tag = chunk_tag;
-            result.size = chunk_size;
-            result.offset = bs.pos;
-            U_Printf("TAG: %s, offset: %u, size: %u\n", fourcc, bs.pos, chunk_size);
-            break;
+            U_Printf("invalid public key in keyring: ");
+            print_hex((unsigned char*)pubkey, 33);
+            U_Printf("\n");
+            goto out;
         }
-
-        if (chunk_tag == 0)
-            break;
-
-        bs.pos += chunk_size;
-        if (bs.pos >= bs.size)
-            break;
     }
 
-    return result;
-}
+    ret = 1;
+    goto out;
 
-/* needed for uECC_sign_deterministic() */
-typedef struct SHA256_HashContext {
-    uECC_HashContext uECC;
-    unsigned long pos;
-    unsigned char buf[1 << 19];
-} SHA256_HashContext;
+invalid:
+    U_Printf("no valid keyring: %s\n", path);
 
-static void init_SHA256(const uECC_HashContext *base) {
-    SHA256_HashContext *ctx = (SHA256_HashContext *)base;
-    ctx->pos = 0;
+out:
+    PL_UnmapFile(&mf);
+    if (ret == 0)
+        ECC_FreeKeyring(ring);
+    return ret;
 }
 
-static void update_SHA256(const uECC_HashContext *base,
-                          const uint8_t *message,
-                          unsigned message_size) {
-    SHA256_HashContext *ctx = (SHA256_HashContext *)base;
+/** \return the index of a compressed public key in the keyring, or -1 if not found.
+ */
+static long ECC_KeyringFind(const ECC_Keyring *ring, const u8 *pubkey)
+{
+    int cmp;
+    unsigned long lo;
+    unsigned long hi;
+    unsigned long i;
 
-    if (ctx->pos + message_size < sizeof(ctx->buf))
-    {
-        if (message_size)
-        {
-            U_memcpy(&ctx->buf[ctx->pos], message, message_size);
-            ctx->pos += message_size;
-        }
-    }
-    else
+    lo = 0;
+    hi = ring->count;
+    while (lo < hi)
     {
-        assert(0 && "SHA256 buffer too small");
-    }
-}
+        i = lo + (hi - lo) / 2;
+        cmp = ECC_ComparePubkeys(&ring->pubkeys.buf[i * 33], pubkey);
+        if (cmp == 0)
+            return (long)i;
 
-static void finish_SHA256(const uECC_HashContext *base, uint8_t *hash_result) {
-    SHA256_HashContext *ctx = (SHA256_HashContext *)base;
+        if (cmp < 0)
+            lo = i + 1;
+        else
+            hi = i;
+    }
 
-    lonesha256(hash_result, &ctx->buf[0], ctx->pos);
+    return -1;
 }
 
-int ECC_FindSignature(const DDF_Signature *sig, u8 *ddf_data, u32 ddf_size, u8 *sha256, u8 *public_key)
+/** Checks the SIGN chunk of a bundle against the keyring.
+ *
+ * Without 'sha256' only the keys are looked up.
+ *
+ * \return keyring index + 1 of the first trusted key with a valid signature, or 0.
+ */
+static long ECC_FindTrustedSignature(const ECC_Keyring *ring, const DDFB_Bundle *bundle, const u8 *sha256)
 {
-    u32 i;
-    u16 len;
-    int offset;
-    U_BStream bs;
-    ChunkRef chunk;
-    DDF_Signature sig1;
-
-    U_bstream_init(&bs, ddf_data, ddf_size);
+    long k;
+    unsigned long pos;
+    DDFB_Chunk chunk;
+    DDFB_Signature sig;
 
-    offset = 8; /* inside RIFF container */
-    chunk = GetChunkRef(ddf_data, ddf_size, offset, "SIGN");
+    if (DDFB_FindChunk(bundle, "SIGN", &chunk) == 0)
+        return 0;
 
-    if (chunk.tag == 0) /* no SIGN chunk */
+    for (pos = 0; DDFB_NextSignature(&chunk, &pos, &sig);)
     {
-        return 0;
+        if (sig.pubkey_len != 33 || sig.signature_len != 64)
+            continue;
+
+        k = ECC_KeyringFind(ring, sig.pubkey);
+        if (k < 0)
+            continue;
+
+        if (!sha256 || ring->ecc->verify_key(&ring->keys.buf[k * ring->ecc->key_size], sha256, sig.signature) == 1)
+            return k + 1;
     }
 
-    bs.pos = chunk.offset;
+    return 0;
+}
 
-    for (;;)
-    {
-        if (bs.pos >= chunk.offset + chunk.size)
-            break;
+/** Verifies and prints up to U_SHA256_MULTI_MAX_LANES bundles.
+ *
+ * Only bundles signed by a trusted key are hashed, in parallel.
+ *
+ * \return the number of bundles with a valid signature by a trusted key.
+ */
+static unsigned ECC_VerifyBatch(const ECC_Keyring *ring, const DDFB_Bundle *bundles, const char **names, unsigned count)
+{
+    long k;
+    unsigned i;
+    unsigned j;
+    unsigned n;
+    unsigned trusted;
+    unsigned lane[U_SHA256_MULTI_MAX_LANES];
+    const void *data[U_SHA256_MULTI_MAX_LANES];
+    unsigned long size[U_SHA256_MULTI_MAX_LANES];
+    u8 digests[U_SHA256_MULTI_MAX_LANES * U_SHA256_DIGEST_SIZE];
 
-        len = U_bstream_get_u16_le(&bs);
-        if (len != sizeof(sig1.compressed_pubkey))
+    U_ASSERT(count <= U_SHA256_MULTI_MAX_LANES);
+
+    n = 0;
+    for (i = 0; i < count; i++)
+    {
+        if (ECC_FindTrustedSignature(ring, &bundles[i], NULL))
         {
-            U_Printf("unsupported public key length: %u\n", len);
-            return 0;
+            lane[n] = i;
+            data[n] = DDFB_SignedData(&bundles[i], &size[n]);
+            n++;
         }
+    }
 
-        for (i = 0; i < sizeof(sig1.compressed_pubkey); i++)
-            sig1.compressed_pubkey[i] = U_bstream_get_u8(&bs);
+    if (n)
+        U_sha256_multi(&data[0], &size[0], n, &digests[0]);
 
-        len = U_bstream_get_u16_le(&bs);
-        if (len != sizeof(sig1.serialized_signature))
+    trusted = 0;
+    for (i = 0, j = 0; i < count; i++)
+    {
+        k = 0;
+        if (j < n && lane[j] == i)
         {
-            U_Printf("unsupported signature length: %u\n", len);
-            return 0;
+            k = ECC_FindTrustedSignature(ring, &bundles[i], &digests[j * U_SHA256_DIGEST_SIZE]);
+            j++;
         }
 
-        for (i = 0; i < sizeof(sig1.serialized_signature); i++)
-            sig1.serialized_signature[i] = U_bstream_get_u8(&bs);
-
-        if (U_memcmp(sig1.compressed_pubkey, sig->compressed_pubkey, sizeof(sig->compressed_pubkey)) == 0)
+        if (k)
         {
-            if (uECC_verify(public_key, sha256, 32, sig1.serialized_signature, uECC_secp256k1()) == 1)
-                return 1;
+            U_Printf("%s: signed by ", names[i]);
+            print_hex(&ring->pubkeys.buf[(k - 1) * 33], 33);
+            U_Printf("\n");
+            trusted++;
+        }
+        else
+        {
+            U_Printf("%s: no valid signature by a trusted key\n", names[i]);
         }
     }
 
-    return 0;
+    return trusted;
 }
 
-int ECC_AppendSignature(const DDF_Signature *sig, u8 *ddf_data, u32 ddf_size, u32 *out_ddf_size)
+/** Verifies the bundles of a directory in batches.
+ */
+static void ECC_VerifyDirectory(const ECC_Keyring *ring, DDF_FileList *fl, const char *dir,
+                                unsigned *total, unsigned *trusted)
 {
-    u32 i;
-    u32 pos;
-    int offset;
-    U_BStream bs;
-    ChunkRef chunk;
-
-    U_bstream_init(&bs, ddf_data, ddf_size);
+    unsigned i;
+    unsigned n;
+    unsigned count;
+    unsigned scratch_pos;
+    const char *path;
+    const char *names[U_SHA256_MULTI_MAX_LANES];
+    DDFB_Bundle bundles[U_SHA256_MULTI_MAX_LANES];
+    PL_MappedFile mf[U_SHA256_MULTI_MAX_LANES];
+    DDF_Catalog cat;
 
-    offset = 8; /* inside RIFF container */
-    chunk = GetChunkRef(ddf_data, ddf_size, offset, "SIGN");
+    U_bzero(&cat, sizeof(cat));
+    cat.dir = dir;
 
-    if (chunk.tag == 0) /* no SIGN chunk, append one */
+    for (i = 0; i < fl->count; i += U_SHA256_MULTI_MAX_LANES)
     {
-        chunk = GetChunkRef(ddf_data, ddf_size, offset, "DDFB");
-        U_ASSERT(chunk.tag != 0);
-
-        bs.pos = chunk.offset + chunk.size;
-        DDF_PutFourCC(&bs, "SIGN");
-        U_bstream_put_u32_le(&bs, 0); /* initial size*/
-
-        chunk = GetChunkRef(ddf_data, ddf_size, offset, "SIGN");
-    }
+        scratch_pos = U_ScratchPos();
+        count = 0;
 
-    U_ASSERT(chunk.tag != 0);
-
-    /* append signature */
-    bs.pos = chunk.offset + chunk.size;
+        for (n = i; n < fl->count && n < i + U_SHA256_MULTI_MAX_LANES; n++)
+        {
+            names[count] = ((char**)fl->buf.buf)[n];
+            path = DDF_CatalogPath(&cat, names[count]);
+            *total += 1;
 
-    U_bstream_put_u16_le(&bs, sizeof(sig->compressed_pubkey));
-    for (i = 0; i < sizeof(sig->compressed_pubkey); i++)
-        U_bstream_put_u8(&bs, sig->compressed_pubkey[i]);
+            if (!path || PL_MapFile(&mf[count], path) == 0 ||
+                DDFB_Open(&bundles[count], mf[count].data, mf[count].size) == 0)
+            {
+                if (path)
+                    PL_UnmapFile(&mf[count]);
+                U_Printf("%s: no valid bundle\n", names[count]);
+                continue;
+            }
 
-    U_bstream_put_u16_le(&bs, sizeof(sig->serialized_signature));
-    for (i = 0; i < sizeof(sig->serialized_signature); i++)
-        U_bstream_put_u8(&bs, sig->serialized_signature[i]);
+            count++;
+        }
 
-    /* write new SIGN chunk size */
-    pos = bs.pos;
-    bs.pos = chunk.offset - 4;
-    U_bstream_put_u32_le(&bs, pos - chunk.offset);
+        *trusted += ECC_VerifyBatch(ring, &bundles[0], &names[0], count);
 
-    /* update RIFF chunk size*/
-    bs.pos = 4;
-    U_bstream_put_u32_le(&bs, pos - 8);
-    *out_ddf_size = pos;
+        for (n = 0; n < count; n++)
+            PL_UnmapFile(&mf[n]);
 
-    return 1;
+        U_ScratchRestore(scratch_pos);
+    }
 }
 
-int ECC_Sign(const char *ddfpath, const char *keypath)
+/** Verifies the signatures of a bundle, the bundles of a pack or a directory
+ * against the keys of a keyring.
+ *
+ * \return 1 if all bundles have a valid signature by a trusted key.
+ */
+static int ECC_VerifyBundles(const char *keyring_path, const char *path)
 {
-    int ret;
-    int offset;
-    u32 ddf_size;
-    u32 out_ddf_size;
-    u8 *ddf_data;
-    ChunkRef chunk;
-    U_BStream bs;
-    const struct uECC_Curve_t * curve;
-    /* buffers */
-    u8 sha256[32];
-    u8 private_key[32 + 1];
-    u8 public_key[64];
-    DDF_Signature ddf_sig;
+    unsigned long i;
+    unsigned n;
+    unsigned total;
+    unsigned trusted;
+    const char *names[U_SHA256_MULTI_MAX_LANES];
+    DDFB_Bundle bundles[U_SHA256_MULTI_MAX_LANES];
+    ECC_Keyring ring;
+    DDF_FileList fl;
+    PL_MappedFile mf;
+    DDFB_Pack pack;
+
+    if (ECC_LoadKeyring(&ring, keyring_path) == 0)
+        return 0;
 
-    PL_Stat statbuf;
+    total = 0;
+    trusted = 0;
+    U_bzero(&fl, sizeof(fl));
+    U_bzero(&mf, sizeof(mf));
 
-    /*** load private key file ***************************************/
-    if (PL_StatFile(keypath, &statbuf) != 1)
+    if (PL_ListDirectory(path, DDF_CatalogListCallback, &fl))
     {
-        U_Printf("failed to open %s\n", keypath);
-        return 0;
-    }
+        if (fl.count == 0)
+            U_Printf("no bundles found in %s\n", path);
+        else
+            U_qsort(fl.buf.buf, fl.count, sizeof(char*), DDF_ComparePaths);
 
-    if (statbuf.size != 32)
-    {
-        U_Printf("failed to load private key: %s, expected 32 bytes, got %u\n", keypath, (unsigned)statbuf.size);
-        return 0;
+        ECC_VerifyDirectory(&ring, &fl, path, &total, &trusted);
+        if (fl.buf.buf)
+            U_BufferFree(&fl.buf);
     }
-
-    ret = PL_LoadFile(keypath, &private_key[0], sizeof(private_key));
-    if (ret != (int)statbuf.size)
+    else if (PL_MapFile(&mf, path) == 0)
     {
-        U_Printf("failed to load private key: %s, ret: %d\n", keypath, ret);
-        return 0;
+        U_Printf("failed to read %s\n", path);
     }
+    else if (DDFB_PackOpen(&pack, mf.data, mf.size))
+    {
+        for (i = 0; i < pack.catalog.bundle_count; i += n)
+        {
+            for (n = 0; n < U_SHA256_MULTI_MAX_LANES && i + n < pack.catalog.bundle_count; n++)
+            {
+                names[n] = ddfb_catalog_string(&pack.catalog, ddfb_get_u32(&pack.catalog.bundles[(i + n) * 16]));
+                if (DDFB_PackBundle(&pack, i + n, &bundles[n]) == 0)
+                    break;
+            }
 
-    /*** load DDF file ***********************************************/
-    if (PL_StatFile(ddfpath, &statbuf) != 1)
+            total += n;
+            trusted += ECC_VerifyBatch(&ring, &bundles[0], &names[0], n);
+
+            if (i + n < pack.catalog.bundle_count && n < U_SHA256_MULTI_MAX_LANES)
+            {
+                U_Printf("%s: no valid bundle\n", names[n]);
+                total += 1;
+                n += 1;
+            }
+        }
+    }
+    else if (DDFB_Open(&bundles[0], mf.data, mf.size))
     {
-        U_Printf("failed to open %s\n", ddfpath);
-        return 0;
+        names[0] = path;
+        total = 1;
+        trusted = ECC_VerifyBatch(&ring, &bundles[0], &names[0], 1);
     }
-
-    ddf_size = statbuf.size;
-    ddf_size += 1024; /* some extra space for new signatures*/
-    ddf_data = U_ScratchAlloc(ddf_size);
-    ret = PL_LoadFile(ddfpath, ddf_data, ddf_size);
-    if (ret != (int)statbuf.size)
+    else
     {
-        U_Printf("failed to read %s (ret: %d), bytes: %u\n", ddfpath, ret, (unsigned)statbuf.size);
-        return 0;
+        U_Printf("no valid bundle or pack: %s\n", path);
     }
 
-    U_bstream_init(&bs, ddf_data, ddf_size);
+    PL_UnmapFile(&mf);
+    ECC_FreeKeyring(&ring);
 
-    /*** test for valid DDF file *************************************/
-    offset = 0;
-    chunk = GetChunkRef(bs.data, bs.size, offset, "RIFF");
-    if (chunk.tag == 0)
-    {
-        U_Printf("no RIFF chunk found in: %s\n", ddfpath);
-        return 0;
-    }
+    if (total)
+        U_Printf("%u of %u bundles signed by a trusted key\n", trusted, total);
 
-    offset = 8; /* inside RIFF container */
-    chunk = GetChunkRef(bs.data, bs.size, offset, "DDFB");
+    return total != 0 && trusted == total;
+}
 
-    if (chunk.tag == 0)
-    {
-        U_Printf("no DDFB chunk found in: %s\n", ddfpath);
-        return 0;
-    }
+/** Creates a keyring from compressed public key files as written by keygen.
+ */
+static int ECC_MakeKeyring(const char *keyring_path, int count, char **pubkey_paths)
+{
+    int i;
+    int ret;
+    unsigned n;
+    unsigned long size;
+    u8 *data;
+    u8 *pubkeys;
+    u8 pubkey[33 + 1]; /* PL_LoadFile() needs space for a '\0' */
+    u8 public_key[64];
+    PL_Stat statbuf;
+    U_BStream bs;
 
-    if (chunk.offset + chunk.size > statbuf.size)
+    if (count <= 0 || count > DDF_KEYRING_MAX_KEYS)
     {
-        U_Printf("invalid DDFB chunk size in: %s\n", ddfpath);
+        U_Printf("a keyring holds 1 to %u keys\n", DDF_KEYRING_MAX_KEYS);
         return 0;
     }
 
-    /*** generate SHA256 over DDFB chunk (header + data) *************/
-    lonesha256(&sha256[0], &bs.data[chunk.offset - 8], chunk.size + 8);
-
-    U_Printf("SHA256: ");
-    print_hex(&sha256[0], sizeof(sha256));
-    U_Printf("\n");
-
-    /*** create signature over DDFB data *****************************/
+    pubkeys = U_ScratchAlloc((unsigned)count * 33);
 
-    U_bzero(&ddf_sig, sizeof(ddf_sig));
+    for (i = 0; i < count; i++)
+    {
+        if (PL_StatFile(pubkey_paths[i], &statbuf) != 1 || statbuf.size != 33 ||
+            PL_LoadFile(pubkey_paths[i], &pubkey[0], sizeof(pubkey)) != 33 ||
+            ecc_backends[0]->decompress(&pubkey[0], public_key) != 1)
+        {
+            U_Printf("no valid public key: %s, expected 33 bytes compressed key\n", pubkey_paths[i]);
+            return 0;
+        }
 
-    curve = uECC_secp256k1();
-    uECC_set_rng(uECC_RNG_Callback);
+        U_memcpy(&pubkeys[i * 33], &pubkey[0], 33);
+    }
 
-    if (uECC_compute_public_key(private_key, public_key, curve) != 1)
+    /* sorted for binary search, duplicates are removed */
+    U_qsort(pubkeys, (unsigned)count, 33, ECC_ComparePubkeys);
+    for (i = 1, n = 1; i < count; i++)
     {
-        U_Printf("failed to compute public key from %s\n", keypath);
-        return 0;
+        if (ECC_ComparePubkeys(&pubkeys[(n - 1) * 33], &pubkeys[i * 33]) != 0)
+        {
+            U_memmove(&pubkeys[n * 33], &pubkeys[i * 33], 33);
+            n++;
+        }
     }
 
-    U_Printf("private key: ");
-    print_hex(&private_key[0], sizeof(private_key) - 1);
-    U_Printf("\n");
+    size = 32 + ((n * 33 + 3) & ~3UL);
+    data = U_ScratchAlloc(size);
+    U_bstream_init(&bs, data, size);
 
-    /* serialize the pubkey in a compressed form(33 bytes) */
-    uECC_compress(public_key, ddf_sig.compressed_pubkey, curve);
+    DDF_PutFourCC(&bs, "RIFF");
+    U_bstream_put_u32_le(&bs, size - 8);
+    DDF_PutFourCC(&bs, "KRNH");
+    U_bstream_put_u32_le(&bs, 8);
+    U_bstream_put_u32_le(&bs, DDF_KEYRING_VERSION);
+    U_bstream_put_u32_le(&bs, n);
+    DDF_PutFourCC(&bs, "KEYS");
+    U_bstream_put_u32_le(&bs, size - 32);
+    U_bstream_put_bytes(&bs, pubkeys, n * 33);
+    while (bs.pos < size)
+        U_bstream_put_u8(&bs, 0);
+
+    U_ASSERT(bs.status == U_BSTREAM_OK && bs.pos == size);
+
+    ret = PL_WriteFile(keyring_path, data, size);
+    if (ret == 0)
+        U_Printf("failed to write %s\n", keyring_path);
+    else
+        U_Printf("keyring written to: %s (%u keys)\n", keyring_path, n);
 
-    U_Printf("public key: ");
-    print_hex(&ddf_sig.compressed_pubkey[0], sizeof(ddf_sig.compressed_pubkey));
-    U_Printf("\n");
+    return ret;
+}
 
-    /* signing */
+static int IsArg(const char *arg, const char *str)
+{
+    unsigned len;
 
-    /*
-    if (uECC_sign(private_key, sha256, sizeof(sha256), ddf_sig.serialized_signature, curve) != 1)
-    {
-        return 0;
-    }
-    */
+    len = U_strlen(str);
+    if (U_strlen(arg) == len && U_memcmp(arg, str, len) == 0)
+        return 1;
+    return 0;
+}
 
-    {
-        uint8_t tmp[2 * SHA256_DIGEST_LENGTH + SHA256_BLOCK_LENGTH];
+/* options of DDF_ParseCreateArgs() which apply to a command */
+#define DDF_OPT_JOBS     0x01
+#define DDF_OPT_COMPRESS 0x02 /* --compress and --dict */
+#define DDF_OPT_MINIFY   0x04
+#define DDF_OPT_INDEX    0x08
 
-        /* note: uECC_HashContext is embedded in SHA256_HashContext */
-        uECC_HashContext *ctx = U_ScratchAlloc(sizeof(SHA256_HashContext));
+/** Parses options and the input path following the command name.
+ *
+ * \param options  DDF_OPT_ flags, other known options are rejected as well
+ */
+static int DDF_ParseCreateArgs(int argc, char **argv, unsigned options, DDF_CreateArgs *args)
+{
+    int i;
+    long n;
+    unsigned opt;
+    U_SStream ss;
 
-        ctx->init_hash = init_SHA256;
-        ctx->update_hash = update_SHA256;
-        ctx->finish_hash = finish_SHA256;
-        ctx->block_size = SHA256_BLOCK_LENGTH;
-        ctx->result_size = SHA256_DIGEST_LENGTH;
-        ctx->tmp = &tmp[0];
+    U_bzero(args, sizeof(*args));
+    args->jobs = 1;
 
-        if (uECC_sign_deterministic(private_key,
-                                &sha256[0],
-                                sizeof(sha256),
-                                ctx,
-                                ddf_sig.serialized_signature,
-                                curve) != 1)
+    for (i = 2; i < argc; i++)
+    {
+        opt = 0;
+        if (IsArg(argv[i], "--jobs"))
+            opt = DDF_OPT_JOBS;
+        else if (IsArg(argv[i], "--compress") || IsArg(argv[i], "--dict"))
+            opt = DDF_OPT_COMPRESS;
+        else if (IsArg(argv[i], "--minify"))
+            opt = DDF_OPT_MINIFY;
+        else if (IsArg(argv[i], "--index"))
+            opt = DDF_OPT_INDEX;
+
+        if (opt && (options & opt) == 0)
         {
+            U_Printf("option %s doesn't apply to %s\n", argv[i], argv[1]);
             return 0;
         }
-    }
-
-    U_Printf("signature: ");
-    print_hex(ddf_sig.serialized_signature, sizeof(ddf_sig.serialized_signature));
-    U_Printf("\n");
-
-    /* check if signature is already there */
-    if (ECC_FindSignature(&ddf_sig, ddf_data, statbuf.size, &sha256[0], &public_key[0]))
-    {
-        U_Printf("signature already present\n");
-        return 1;
-    }
 
-    if (ECC_AppendSignature(&ddf_sig, ddf_data, ddf_size, &out_ddf_size))
-    {
-        PL_WriteFile(ddfpath, ddf_data, out_ddf_size);
-        return 1;
+        if (IsArg(argv[i], "--jobs") && i + 1 < argc)
+        {
+            i++;
+            U_sstream_init(&ss, argv[i], U_strlen(argv[i]));
+            n = U_sstream_get_long(&ss);
+            if (ss.status != U_SSTREAM_OK || n < 0)
+            {
+                U_Printf("invalid --jobs value: %s\n", argv[i]);
+                return 0;
+            }
+            args->jobs = (unsigned)n;
+        }
+        else if (IsArg(argv[i], "--compress"))
+        {
+            args->flags |= DDF_CREATE_COMPRESS;
+        }
+        else if (IsArg(argv[i], "--dict") && i + 1 < argc)
+        {
+            i++;
+            args->dict_path = argv[i];
+            args->flags |= DDF_CREATE_COMPRESS;
+        }
+        else if (IsArg(argv[i], "--minify"))
+        {
+            args->flags |= DDF_CREATE_MINIFY;
+        }
+        else if (IsArg(argv[i], "--index"))
+        {
+            args->flags |= DDF_CREATE_INDEX;
+        }
+        else if (argv[i][0] == '-')
+        {
+            U_Printf("unknown option: %s\n", argv[i]);
+            return 0;
+        }
+        else if (args->path == NULL)
+        {
+            args->path = argv[i];
+        }
+        else if (args->out_path == NULL)
+        {
+            args->out_path = argv[i];
+        }
+        else
+        {
+            return 0;
+        }
     }
 
-    return 0;
+    return args->path ? 1 : 0;
 }
 
 int main(int argc, char **argv)
 {
     int result;
     int arg_len;
+    DDF_CreateArgs create_args;
     U_SStream ss;
 
     result = 1;
     U_MemoryInit();
-    U_ScratchInit(U_MEGA_BYTES(32));
+    U_ScratchInit(SCRATCH_SIZE);
     U_InitArena(&mem_arena, U_MEGA_BYTES(16));
 
     ss.len = 2048;
@@ -1618,9 +2944,41 @@ int main(int argc, char **argv)
     arg_len = ss.pos;
     ss.pos = 0;
 
-    if (argc == 3 && U_sstream_starts_with(&ss, "create") && arg_len == 6)
+    if (argc >= 3 && U_sstream_starts_with(&ss, "create") && arg_len == 6 &&
+        DDF_ParseCreateArgs(argc, argv, DDF_OPT_COMPRESS | DDF_OPT_MINIFY | DDF_OPT_INDEX, &create_args) &&
+        !create_args.out_path)
+    {
+        if ((!create_args.dict_path || DDF_LoadDictionary(create_args.dict_path)) &&
+            DDF_CreateBundle(create_args.path, create_args.flags) == 1)
+            result = 0;
+    }
+    else if (argc >= 3 && U_sstream_starts_with(&ss, "create-all") && arg_len == 10 &&
+             DDF_ParseCreateArgs(argc, argv, DDF_OPT_JOBS | DDF_OPT_COMPRESS | DDF_OPT_MINIFY | DDF_OPT_INDEX,
+                                 &create_args) && !create_args.out_path)
+    {
+        if ((!create_args.dict_path || DDF_LoadDictionary(create_args.dict_path)) &&
+            DDF_CreateAllBundles(create_args.path, create_args.jobs, create_args.flags) == 1)
+            result = 0;
+    }
+    else if (argc >= 4 && U_sstream_starts_with(&ss, "mkdict") && arg_len == 6 &&
+             DDF_ParseCreateArgs(argc, argv, DDF_OPT_MINIFY, &create_args) && create_args.out_path)
     {
-        if (DDF_CreateBundle(argv[2]) == 1)
+        if (DDF_MakeDictionary(create_args.path, create_args.out_path, create_args.flags) == 1)
+            result = 0;
+    }
+    else if (argc == 4 && U_sstream_starts_with(&ss, "catalog") && arg_len == 7)
+    {
+        if (DDF_MakeCatalog(argv[2], argv[3]) == 1)
+            result = 0;
+    }
+    else if (argc == 4 && U_sstream_starts_with(&ss, "pack") && arg_len == 4)
+    {
+        if (DDF_MakePack(argv[2], argv[3]) == 1)
+            result = 0;
+    }
+    else if (argc == 5 && U_sstream_starts_with(&ss, "find") && arg_len == 4)
+    {
+        if (DDF_FindDevice(argv[2], argv[3], argv[4]) == 1)
             result = 0;
     }
     else if (argc == 3 && U_sstream_starts_with(&ss, "keygen") && arg_len == 6)
@@ -1633,24 +2991,58 @@ int main(int argc, char **argv)
         if (ECC_Sign(argv[2], argv[3]) == 1)
             result = 0;
     }
+    else if (argc >= 4 && U_sstream_starts_with(&ss, "keyring") && arg_len == 7)
+    {
+        if (ECC_MakeKeyring(argv[2], argc - 3, &argv[3]) == 1)
+            result = 0;
+    }
+    else if (argc == 4 && U_sstream_starts_with(&ss, "verify") && arg_len == 6)
+    {
+        if (ECC_VerifyBundles(argv[2], argv[3]) == 1)
+            result = 0;
+    }
     else
     {
         U_Printf("Usage: %s <command> <arguments...>\n", argv[0]);
         U_Printf("commands:\n");
-        U_Printf("    create   <ddf.json>\n");
+        U_Printf("    create   [options] <ddf.json>\n");
         U_Printf("             Creates a .ddf bundle from a base JSON DDF file.\n");
+        U_Printf("             --compress stores the DDF and files LZ4 compressed.\n");
+        U_Printf("             --dict <dictfile> compresses with a dictionary created by mkdict.\n");
+        U_Printf("             --minify removes whitespace from the DDF and JSON files.\n");
+        U_Printf("             --index adds an INDX chunk to look up files by path.\n");
+        U_Printf("    create-all [--jobs N] [options] <directory|file-list>\n");
+        U_Printf("             Creates .ddf bundles for all DDF files in a directory tree,\n");
+        U_Printf("             or listed in a text file (one path per line).\n");
+        U_Printf("             --jobs N creates bundles with N threads (0 = CPU count),\n");
+        U_Printf("             each thread uses %u MB of memory.\n", (unsigned)(SCRATCH_SIZE / U_MEGA_BYTES(1)));
+        U_Printf("    mkdict   [--minify] <directory|file-list> <dictfile>\n");
+        U_Printf("             Creates a compression dictionary from files shared by the bundles.\n");
+        U_Printf("    catalog  <bundle-directory> <catalogfile>\n");
+        U_Printf("             Creates an index of the device identifiers of all bundles.\n");
+        U_Printf("    pack     <bundle-directory> <packfile>\n");
+        U_Printf("             Stores all bundles unmodified in one file with a catalog.\n");
+        U_Printf("    find     <catalogfile|packfile> <manufacturername> <modelid>\n");
+        U_Printf("             Prints the bundles of a device listed in a catalog.\n");
         U_Printf("    keygen   <keyname>\n");
         U_Printf("             Creates new key pair to sign bundles.\n");
         U_Printf("    sign     <bundle.ddf> <keyfile>\n");
         U_Printf("             Signs a bundle with a private key.\n");
         U_Printf("             The signature is appended only if it doesn't exist yet.\n");
+        U_Printf("    keyring  <keyringfile> <key.pub> [<key.pub> ...]\n");
+        U_Printf("             Creates a keyring of trusted public keys.\n");
+        U_Printf("    verify   <keyringfile> <bundle.ddf|packfile|bundle-directory>\n");
+        U_Printf("             Checks that bundles are signed by a key of the keyring.\n");
         if (argc == 1)
             result = 0;
     }
 
+    PL_UnmapFile(&ddf_dict);
     U_FreeArena(&mem_arena);
     U_ScratchFree();
     U_MemoryFree();
 
     return result;
 }
+
+#endif /* DDFB_NO_MAIN */
@@ -0,0 +1,286 @@
+/* Benchmark of the signature backends in ddfb.c.
+
+   Every backend runs public key computation, compress, decompress, sign,
+   verify and verification with prepared keys (as in a keyring) over the
+   same deterministic vectors. The results of each
+   backend are checked against micro-ecc before the timed runs, a
+   backend which disagrees or accepts a wrong hash is reported and the
+   exit code is 1. With 0 seconds only the results are checked, the
+   ecc_backends test runs it this way.
+
+   Usage: ddfb_bench [vectors] [seconds per operation]
+
+*/
+
+#define DDFB_NO_MAIN
+#include "ddfb.c"
+
+#define BENCH_MAX_VECTORS 256
+
+enum BenchOp
+{
+    BENCH_PUBKEY,
+    BENCH_COMPRESS,
+    BENCH_DECOMPRESS,
+    BENCH_SIGN,
+    BENCH_VERIFY,
+    BENCH_PREPARE_KEY,
+    BENCH_VERIFY_KEY,
+    BENCH_OP_COUNT
+};
+
+static const char *bench_op_names[BENCH_OP_COUNT] = {
+    "pubkey", "compress", "decompress", "sign", "verify", "prepare", "verify-key"
+};
+
+typedef struct BenchVector
+{
+    u8 private_key[32];
+    u8 hash[32];
+    u8 public_key[64];
+    u8 compressed[33];
+    u8 signature[64];
+} BenchVector;
+
+static BenchVector bench_vec[BENCH_MAX_VECTORS];
+static BenchVector bench_out[BENCH_MAX_VECTORS];
+static U_buffer bench_keys; /* prepared keys of the current backend */
+
+/* Runs one operation over all vectors, inputs come from 'bench_vec' and
+   outputs go to 'bench_out'. Returns the number of failed calls. */
+static unsigned Bench_RunOp(const ECC_Backend *ecc, unsigned op, unsigned count)
+{
+    unsigned i;
+    unsigned failed;
+    BenchVector *v;
+    BenchVector *out;
+
+    failed = 0;
+
+    for (i = 0; i < count; i++)
+    {
+        v = &bench_vec[i];
+        out = &bench_out[i];
+
+        switch (op)
+        {
+        case BENCH_PUBKEY:
+            failed += ecc->compute_public_key(v->private_key, out->public_key) != 1;
+            break;
+        case BENCH_COMPRESS:
+            ecc->compress(v->public_key, out->compressed);
+            break;
+        case BENCH_DECOMPRESS:
+            failed += ecc->decompress(v->compressed, out->public_key) != 1;
+            break;
+        case BENCH_SIGN:
+            failed += ecc->sign(v->private_key, v->hash, out->signature) != 1;
+            break;
+        case BENCH_VERIFY:
+            failed += ecc->verify(v->public_key, v->hash, v->signature) != 1;
+            break;
+        case BENCH_PREPARE_KEY:
+            failed += ecc->prepare_key(&bench_keys.buf[i * ecc->key_size], v->public_key) != 1;
+            break;
+        case BENCH_VERIFY_KEY:
+            failed += ecc->verify_key(&bench_keys.buf[i * ecc->key_size], v->hash, v->signature) != 1;
+            break;
+        default:
+            break;
+        }
+    }
+
+    return failed;
+}
+
+/* Returns the number of results which differ from 'bench_vec'. */
+static unsigned Bench_Compare(unsigned op, unsigned count)
+{
+    unsigned i;
+    unsigned diff;
+
+    diff = 0;
+    for (i = 0; i < count; i++)
+    {
+        if (op == BENCH_PUBKEY || op == BENCH_DECOMPRESS)
+            diff += U_memcmp(bench_out[i].public_key, bench_vec[i].public_key, 64) != 0;
+        else if (op == BENCH_COMPRESS)
+            diff += U_memcmp(bench_out[i].compressed, bench_vec[i].compressed, 33) != 0;
+        else if (op == BENCH_SIGN)
+            diff += U_memcmp(bench_out[i].signature, bench_vec[i].signature, 64) != 0;
+    }
+
+    return diff;
+}
+
+/* Returns the number of signatures accepted for a modified hash. */
+static unsigned Bench_VerifyWrongHash(const ECC_Backend *ecc, unsigned op, unsigned count)
+{
+    unsigned i;
+    unsigned accepted;
+    u8 hash[32];
+
+    accepted = 0;
+    for (i = 0; i < count; i++)
+    {
+        U_memcpy(hash, bench_vec[i].hash, sizeof(hash));
+        hash[i & 31] ^= 1;
+        if (op == BENCH_VERIFY)
+            accepted += ecc->verify(bench_vec[i].public_key, hash, bench_vec[i].signature) == 1;
+        else
+            accepted += ecc->verify_key(&bench_keys.buf[i * ecc->key_size], hash, bench_vec[i].signature) == 1;
+    }
+
+    return accepted;
+}
+
+/* Private keys and hashes are SHA-256 chains, public keys, compressed
+   keys and signatures are computed by the reference backend. */
+static int Bench_InitVectors(const ECC_Backend *ecc, unsigned count)
+{
+    unsigned i;
+    u8 seed[4];
+    BenchVector *v;
+
+    for (i = 0; i < count; i++)
+    {
+        v = &bench_vec[i];
+        seed[0] = (u8)(i >> 24);
+        seed[1] = (u8)(i >> 16);
+        seed[2] = (u8)(i >> 8);
+        seed[3] = (u8)i;
+        U_sha256(seed, sizeof(seed), v->private_key);
+        U_sha256(v->private_key, sizeof(v->private_key), v->hash);
+
+        if (ecc->compute_public_key(v->private_key, v->public_key) != 1 ||
+            ecc->sign(v->private_key, v->hash, v->signature) != 1)
+        {
+            U_Printf("%s: failed to create test vector %u\n", ecc->name, i);
+            return 0;
+        }
+
+        ecc->compress(v->public_key, v->compressed);
+    }
+
+    return 1;
+}
+
+static int Bench_ParseArg(const char *arg, long min, long *value)
+{
+    U_SStream ss;
+
+    U_sstream_init(&ss, (char *)arg, U_strlen(arg));
+    *value = U_sstream_get_long(&ss);
+    if (ss.status != U_SSTREAM_OK || *value < min)
+    {
+        U_Printf("invalid argument: %s\n", arg);
+        return 0;
+    }
+
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned i;
+    unsigned op;
+    unsigned count;
+    unsigned rounds;
+    unsigned errors;
+    unsigned n;
+    long value;
+    double seconds;
+    double t0;
+    double t;
+    const ECC_Backend *ecc;
+
+    count = 64;
+    seconds = 1.0;
+    U_bzero(&bench_keys, sizeof(bench_keys));
+
+    if (argc > 3 || (argc >= 2 && argv[1][0] == '-'))
+    {
+        U_Printf("Usage: %s [vectors] [seconds per operation]\n", argv[0]);
+        return 1;
+    }
+
+    if (argc >= 2)
+    {
+        if (Bench_ParseArg(argv[1], 1, &value) == 0)
+            return 1;
+        count = value > BENCH_MAX_VECTORS ? BENCH_MAX_VECTORS : (unsigned)value;
+    }
+
+    if (argc >= 3)
+    {
+        if (Bench_ParseArg(argv[2], 0, &value) == 0)
+            return 1;
+        seconds = (double)value;
+    }
+
+    if (Bench_InitVectors(&ecc_backend_uecc, count) == 0)
+        return 1;
+
+    U_MemoryInit();
+
+    U_Printf("%u vectors, reference: %s\n\n", count, ecc_backend_uecc.name);
+    U_Printf("%-12s", "ops/sec");
+    for (op = 0; op < BENCH_OP_COUNT; op++)
+        U_Printf("%12s", bench_op_names[op]);
+    U_Printf("\n");
+
+    errors = 0;
+
+    for (i = 0; ecc_backends[i]; i++)
+    {
+        ecc = ecc_backends[i];
+        U_Printf("%-12s", ecc->name);
+        U_BufferResize(&bench_keys, count * ecc->key_size);
+
+        for (op = 0; op < BENCH_OP_COUNT; op++)
+        {
+            /* untimed pass to check the results, also warms up tables */
+            n = Bench_RunOp(ecc, op, count) + Bench_Compare(op, count);
+            if (op == BENCH_VERIFY || op == BENCH_VERIFY_KEY)
+                n += Bench_VerifyWrongHash(ecc, op, count);
+
+            if (n != 0)
+            {
+                U_Printf("%12s", "MISMATCH");
+                errors += n;
+                continue;
+            }
+
+            if (seconds <= 0)
+            {
+                U_Printf("%12s", "ok");
+                continue;
+            }
+
+            rounds = 0;
+            t0 = PL_GetTime();
+            do
+            {
+                Bench_RunOp(ecc, op, count);
+                rounds++;
+                t = PL_GetTime() - t0;
+            }
+            while (t < seconds);
+
+            U_Printf("%12.0f", (double)rounds * count / t);
+        }
+
+        U_Printf("\n");
+    }
+
+    U_BufferFree(&bench_keys);
+    U_MemoryFree();
+
+    if (errors != 0)
+    {
+        U_Printf("\n%u results differ from the reference\n", errors);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,1681 @@
+/* DDF bundle builder, see ddfb_builder.h
+
+   Included after the utils by ddfb.c and by libddfb_builder.c. The ddfb
+   tool uses the DDF_ functions directly with its own DDF_CREATE_ flags and
+   resolvers, the library only exposes DDFB_BuilderInit(), DDFB_BuilderFree()
+   and DDFB_Build().
+*/
+
+#ifdef _WIN32
+  #define U_PATH_MAX MAX_PATH
+  #define DIR_SEP '\\'
+  #define DIR_SEP_STR "\\"
+#else
+  #define U_PATH_MAX PATH_MAX
+  #define DIR_SEP '/'
+  #define DIR_SEP_STR "/"
+#endif
+
+#define MAX_CJ_TOKENS 32766
+#define VAL_BUF_SIZE 4096
+#define BUNDLE_ARENA_SIZE U_MEGA_BYTES(1)
+#define SCRATCH_SIZE U_MEGA_BYTES(32)
+#define WRITER_BUF_SIZE U_KILO_BYTES(64)
+#define WRITER_MAX_IOV 64
+#define WRITER_REF_MIN 1024 /* smaller payloads are copied into the buffer */
+
+/* DDF JSON parsed once, shared by all stages of bundle creation */
+typedef struct
+{
+    PL_MappedFile file;
+    const u8 *data;
+    unsigned size;
+    cj_ctx cj;
+} DDF_Doc;
+
+#define DDF_CREATE_SKIP_NON_DDF 0x01
+#define DDF_CREATE_SHARED_BASE  0x02 /* base data is preloaded and read-only (worker threads) */
+#define DDF_CREATE_COMPRESS     DDFB_BUILD_COMPRESS
+#define DDF_CREATE_TRAIN        0x08 /* collect file content for mkdict, no bundle is written */
+#define DDF_CREATE_MINIFY       DDFB_BUILD_MINIFY
+#define DDF_CREATE_INDEX        DDFB_BUILD_INDEX
+#define DDF_CREATE_COUNT        0x40 /* count files for the INDX chunk, nothing is written */
+#define DDF_CREATE_LOG          0x80 /* print progress and errors, the ddfb tool only */
+
+#define DDF_DICT_MAX_SIZE 65535 /* LZ4 match offsets can't reach further */
+
+/* Streamed bundle output, chunks are written to the sink as they are
+   produced. Positions are file offsets, chunk size fields are backpatched
+   once the chunk is complete.
+
+   Chunk headers are collected in the buffer, payloads are only referenced
+   and written together with the headers by one gathered write. Referenced
+   memory must stay valid until the next DDF_WriterFlush().
+ */
+typedef struct
+{
+    DDFB_Sink sink;
+    U_BStream bs;            /* headers and small payloads */
+    DDFB_IoVec iov[WRITER_MAX_IOV]; /* pending output, buffer segments and payloads */
+    unsigned iov_count;
+    unsigned long seg_start; /* begin of the buffer segment not yet in iov */
+    unsigned long pending;   /* bytes in iov */
+    unsigned long flushed;   /* bytes written to the file */
+    int status;              /* 1 ok, 0 write error */
+} DDF_Writer;
+
+/* INDX chunk entry, the data is written as 4 x u32 */
+typedef struct
+{
+    u32 hash;              /* DDFB_PathHash() of the EXTF path, "" for the DDF */
+    u8 tag[4];             /* chunk tag: DDFC, EXTF, ... */
+    unsigned long offset;  /* file offset of the chunk header */
+    unsigned long size;    /* chunk data size */
+} DDF_IndexEntry;
+
+/* per bundle state, each worker thread creates bundles with its own context */
+typedef struct
+{
+    unsigned flags;
+    const DDFB_BuildInput *in; /* DDF, resolver callbacks and dictionary */
+    u32 dict_id;
+    DDF_Writer w;
+    /* INDX entries, the number of files is counted in a DDF_CREATE_COUNT pass */
+    unsigned file_count;
+    unsigned index_count;
+    unsigned index_size;
+    DDF_IndexEntry *index;
+    /* set of generic items (without duplicates) in the bundle */
+    U_HashMap generic_items;
+    /* per bundle data structures, not affected by U_ScratchRestore() of nested stages */
+    U_Arena arena;
+} DDF_BundleCtx;
+
+/** Prints like U_Printf() for the ddfb tool, DDFB_Build() doesn't log.
+ */
+static void DDF_Log(const DDF_BundleCtx *ctx, const char *format, ...)
+{
+    va_list args;
+
+    if ((ctx->flags & DDF_CREATE_LOG) == 0)
+        return;
+
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+}
+
+static U_Arena mem_arena; /* for non scratch memory */
+
+/* mkdict: bundled file content -> number of bundles containing it */
+static U_HashMap dict_samples;
+
+static void DDF_PutFourCC(U_BStream *bs, const char *tag)
+{
+    int i;
+    unsigned len;
+
+    len = U_strlen(tag);
+    U_ASSERT(len == 4);
+
+    if (len != 4)
+        tag = "ERR0";
+
+    for (i = 0; i < 4; i++)
+    {
+        U_bstream_put_u8(bs, (u8)*tag);
+        tag++;
+    }
+}
+
+static void DDF_WriterInit(DDF_Writer *w, const DDFB_Sink *sink)
+{
+    U_bzero(w, sizeof(*w));
+    U_bstream_init(&w->bs, U_ScratchAlloc(WRITER_BUF_SIZE), WRITER_BUF_SIZE);
+    w->sink = *sink;
+    w->status = 1;
+}
+
+static unsigned long DDF_WriterPos(DDF_Writer *w)
+{
+    return w->flushed + w->pending + (w->bs.pos - w->seg_start);
+}
+
+/* Moves the open buffer segment to the iov list. */
+static void DDF_WriterEndSegment(DDF_Writer *w)
+{
+    if (w->bs.pos > w->seg_start)
+    {
+        U_ASSERT(w->iov_count < WRITER_MAX_IOV);
+        w->iov[w->iov_count].data = &w->bs.data[w->seg_start];
+        w->iov[w->iov_count].size = w->bs.pos - w->seg_start;
+        w->pending += w->iov[w->iov_count].size;
+        w->iov_count++;
+        w->seg_start = w->bs.pos;
+    }
+}
+
+static void DDF_WriterFlush(DDF_Writer *w)
+{
+    DDF_WriterEndSegment(w);
+
+    if (w->status && w->iov_count)
+        w->status = w->sink.write(w->sink.user, &w->iov[0], w->iov_count);
+
+    w->flushed += w->pending;
+    w->pending = 0;
+    w->iov_count = 0;
+    w->seg_start = 0;
+    w->bs.pos = 0;
+}
+
+/** Copies data into the buffer, for headers and small payloads.
+ */
+static void DDF_WriterPut(DDF_Writer *w, const void *data, unsigned long size)
+{
+    DDFB_IoVec iov;
+
+    if (w->bs.pos + size > w->bs.size)
+        DDF_WriterFlush(w);
+
+    if (size > w->bs.size)
+    {
+        iov.data = data;
+        iov.size = size;
+        if (w->status)
+            w->status = w->sink.write(w->sink.user, &iov, 1);
+        w->flushed += size;
+    }
+    else
+    {
+        U_bstream_put_bytes(&w->bs, data, size);
+    }
+}
+
+/** Adds a payload without copying it, 'data' must stay valid until the next flush.
+ */
+static void DDF_WriterPutRef(DDF_Writer *w, const void *data, unsigned long size)
+{
+    if (size < WRITER_REF_MIN)
+    {
+        DDF_WriterPut(w, data, size);
+        return;
+    }
+
+    /* room for the open segment, the payload and the segment after it */
+    if (w->iov_count + 3 > WRITER_MAX_IOV)
+        DDF_WriterFlush(w);
+
+    DDF_WriterEndSegment(w);
+    w->iov[w->iov_count].data = data;
+    w->iov[w->iov_count].size = size;
+    w->pending += size;
+    w->iov_count++;
+}
+
+static void DDF_WriterPutU16(DDF_Writer *w, unsigned v)
+{
+    u8 buf[2];
+
+    buf[0] = v & 0xFF;
+    buf[1] = (v >> 8) & 0xFF;
+    DDF_WriterPut(w, buf, sizeof(buf));
+}
+
+static void DDF_WriterPutU32(DDF_Writer *w, unsigned long v)
+{
+    u8 buf[4];
+
+    buf[0] = v & 0xFF;
+    buf[1] = (v >> 8) & 0xFF;
+    buf[2] = (v >> 16) & 0xFF;
+    buf[3] = (v >> 24) & 0xFF;
+    DDF_WriterPut(w, buf, sizeof(buf));
+}
+
+static void DDF_WriterPutFourCC(DDF_Writer *w, const char *tag)
+{
+    U_ASSERT(U_strlen(tag) == 4);
+    DDF_WriterPut(w, tag, 4);
+}
+
+/** Overwrites a u32 at an earlier position, either in the pending buffer or in the file.
+ */
+static void DDF_WriterPatchU32(DDF_Writer *w, unsigned long pos, unsigned long v)
+{
+    u8 *p;
+    u8 buf[4];
+    unsigned i;
+
+    U_ASSERT(pos + 4 <= DDF_WriterPos(w));
+
+    buf[0] = v & 0xFF;
+    buf[1] = (v >> 8) & 0xFF;
+    buf[2] = (v >> 16) & 0xFF;
+    buf[3] = (v >> 24) & 0xFF;
+
+    if (pos < w->flushed)
+    {
+        if (w->status)
+            w->status = w->sink.write_at(w->sink.user, pos, buf, 4);
+        return;
+    }
+
+    /* u32 fields are always buffered as a whole, never split into segments */
+    pos -= w->flushed;
+    for (i = 0; i < w->iov_count; i++)
+    {
+        if (pos < w->iov[i].size)
+        {
+            p = (u8*)w->iov[i].data + pos;
+            U_ASSERT(p >= w->bs.data && p + 4 <= &w->bs.data[w->seg_start]);
+            U_memcpy(p, buf, 4);
+            return;
+        }
+        pos -= w->iov[i].size;
+    }
+
+    U_memcpy(&w->bs.data[w->seg_start + pos], buf, 4);
+}
+
+/** Overwrites previously written u32 fields, 'size' is a multiple of 4.
+ */
+static void DDF_WriterPatch(DDF_Writer *w, unsigned long pos, const u8 *data, unsigned long size)
+{
+    unsigned long i;
+
+    U_ASSERT((size & 3) == 0);
+
+    if (pos + size <= w->flushed)
+    {
+        if (w->status)
+            w->status = w->sink.write_at(w->sink.user, pos, data, size);
+        return;
+    }
+
+    for (i = 0; i < size; i += 4)
+        DDF_WriterPatchU32(w, pos + i, (unsigned long)data[i] | (unsigned long)data[i + 1] << 8 |
+                           (unsigned long)data[i + 2] << 16 | (unsigned long)data[i + 3] << 24);
+}
+
+/** Starts a chunk, returns the position of the size field for DDF_EndChunk().
+ */
+static unsigned long DDF_BeginChunk(DDF_Writer *w, const char *tag)
+{
+    unsigned long size_pos;
+
+    DDF_WriterPutFourCC(w, tag);
+    size_pos = DDF_WriterPos(w);
+    DDF_WriterPutU32(w, 0); /* chunk size dummy */
+    return size_pos;
+}
+
+static void DDF_EndChunk(DDF_Writer *w, unsigned long size_pos)
+{
+    DDF_WriterPatchU32(w, size_pos, DDF_WriterPos(w) - (size_pos + 4));
+}
+
+/** Counts a bundled file for the mkdict dictionary training.
+ *
+ * Samples are keyed by content, identical files of different bundles
+ * are counted together.
+ */
+static void DDF_AddDictSample(const void *data, unsigned size)
+{
+    int inserted;
+    unsigned long *count;
+    U_HashMapEntry *e;
+
+    if (size > DDF_DICT_MAX_SIZE)
+        return; /* wouldn't fit in the dictionary anyway */
+
+    e = U_HashMapInsert(&dict_samples, data, size, &inserted);
+    if (!e)
+        return;
+
+    if (inserted)
+    {
+        count = U_AllocArena(&mem_arena, sizeof(*count), U_ARENA_ALIGN_8);
+        *count = 0;
+        e->value = count;
+    }
+
+    count = e->value;
+    *count += 1;
+}
+
+/** Compresses data for the compressed chunk variants DDFZ and EXTZ.
+ *
+ * With a dictionary the data is compressed against it for DDFD and EXTD
+ * chunks. The result is in scratch memory. Returns NULL if compression
+ * doesn't pay off or the data doesn't fit in scratch memory, the plain
+ * chunk is written then.
+ */
+static u8 *DDF_Compress(DDF_BundleCtx *ctx, const u8 *data, unsigned size, unsigned *comp_size)
+{
+    u8 *comp;
+    u8 *check;
+    u8 *src;
+    unsigned n;
+    unsigned bound;
+    unsigned dict_size;
+
+    dict_size = (unsigned)ctx->in->dict_size;
+    bound = U_LZ4_COMPRESS_BOUND(size);
+    if (size < 64 || dict_size + bound + size * 2 >= U_ScratchRemaining())
+        return NULL;
+
+    comp = U_ScratchAlloc(bound);
+
+    if (dict_size)
+    {
+        /* the compressor expects the dictionary in front of the data */
+        src = U_ScratchAlloc(dict_size + size);
+        U_memcpy(src, ctx->in->dict, dict_size);
+        U_memcpy(&src[dict_size], data, size);
+        n = U_lz4_compress_prefix(src, dict_size, size, comp, bound);
+    }
+    else
+    {
+        n = U_lz4_compress(data, size, comp, bound);
+    }
+
+    if (n == 0 || n + (dict_size ? 8 : 4) >= size)
+        return NULL;
+
+    /* verify, a broken chunk would only show up when loaded on the gateway */
+    check = U_ScratchAlloc(size);
+    if (U_lz4_decompress_dict(ctx->in->dict, dict_size, comp, n, check, size) != (int)size ||
+        U_memcmp(check, data, size) != 0)
+    {
+        DDF_Log(ctx, "compression round trip failed, store uncompressed\n");
+        return NULL;
+    }
+
+    *comp_size = n;
+    return comp;
+}
+
+/** Writes the chunk data of DDF_Compress() output.
+ *
+ * DDFZ, EXTZ: u32 uncompressed size, LZ4 block.
+ * DDFD, EXTD: u32 dictionary id, u32 uncompressed size, LZ4 block.
+ */
+static void DDF_PutCompressed(DDF_BundleCtx *ctx, const u8 *comp, unsigned comp_size, unsigned size)
+{
+    DDF_Writer *w;
+
+    w = &ctx->w;
+    if (ctx->in->dict_size)
+    {
+        DDF_WriterPutU32(w, comp_size + 8);
+        DDF_WriterPutU32(w, ctx->dict_id);
+    }
+    else
+    {
+        DDF_WriterPutU32(w, comp_size + 4);
+    }
+
+    DDF_WriterPutU32(w, size);
+    DDF_WriterPut(w, comp, comp_size);
+}
+
+/** Remembers a chunk for the INDX chunk, 'offset' is the position of the chunk tag.
+ */
+static void DDF_IndexAdd(DDF_BundleCtx *ctx, const char *tag, const char *path, unsigned long offset)
+{
+    DDF_IndexEntry *e;
+
+    if ((ctx->flags & DDF_CREATE_INDEX) == 0)
+        return;
+
+    /* more entries than counted is checked in DDF_WriteIndex() */
+    if (ctx->index_count < ctx->index_size)
+    {
+        e = &ctx->index[ctx->index_count];
+        e->hash = DDFB_PathHash(path, U_strlen(path));
+        U_memcpy(&e->tag[0], tag, 4);
+        e->offset = offset;
+        e->size = DDF_WriterPos(&ctx->w) - (offset + 8);
+    }
+
+    ctx->index_count++;
+}
+
+static int DDF_CompareIndexEntries(const void *a, const void *b)
+{
+    const DDF_IndexEntry *ea;
+    const DDF_IndexEntry *eb;
+
+    ea = a;
+    eb = b;
+
+    if (ea->hash != eb->hash)
+        return ea->hash < eb->hash ? -1 : 1;
+    if (ea->offset != eb->offset)
+        return ea->offset < eb->offset ? -1 : 1;
+    return 0;
+}
+
+/** Reserves the INDX chunk, the entries are filled in by DDF_WriteIndex().
+ *
+ * INDX data: u32 entry count, entries sorted by hash (and offset)
+ *   u32 path hash, FourCC chunk tag, u32 chunk offset, u32 chunk size
+ */
+static unsigned long DDF_ReserveIndex(DDF_BundleCtx *ctx)
+{
+    unsigned i;
+    unsigned long size_pos;
+
+    size_pos = DDF_BeginChunk(&ctx->w, "INDX");
+    DDF_WriterPutU32(&ctx->w, ctx->index_size);
+
+    for (i = 0; i < ctx->index_size * 4; i++)
+        DDF_WriterPutU32(&ctx->w, 0);
+
+    DDF_EndChunk(&ctx->w, size_pos);
+    return size_pos + 8; /* first entry */
+}
+
+static int DDF_WriteIndex(DDF_BundleCtx *ctx, unsigned long entries_pos)
+{
+    u8 *buf;
+    unsigned i;
+    unsigned scratch_pos;
+    U_BStream bs;
+    DDF_IndexEntry *e;
+
+    if (ctx->index_count != ctx->index_size)
+    {
+        DDF_Log(ctx, "INDX has %u entries, expected %u\n", ctx->index_count, ctx->index_size);
+        return 0;
+    }
+
+    U_qsort(ctx->index, ctx->index_count, sizeof(*ctx->index), DDF_CompareIndexEntries);
+
+    scratch_pos = U_ScratchPos();
+    buf = U_ScratchAlloc(ctx->index_count * 16 + 1);
+    U_bstream_init(&bs, buf, ctx->index_count * 16);
+
+    for (i = 0; i < ctx->index_count; i++)
+    {
+        e = &ctx->index[i];
+        U_bstream_put_u32_le(&bs, e->hash);
+        U_bstream_put_u8(&bs, e->tag[0]);
+        U_bstream_put_u8(&bs, e->tag[1]);
+        U_bstream_put_u8(&bs, e->tag[2]);
+        U_bstream_put_u8(&bs, e->tag[3]);
+        U_bstream_put_u32_le(&bs, e->offset);
+        U_bstream_put_u32_le(&bs, e->size);
+    }
+
+    U_ASSERT(bs.status == U_BSTREAM_OK);
+    DDF_WriterPatch(&ctx->w, entries_pos, buf, bs.pos);
+    U_ScratchRestore(scratch_pos);
+    return 1;
+}
+
+/** Writes the JSON of a parsed document without whitespace.
+ *
+ * Tokens are copied verbatim, strings including their escape sequences.
+ * The result is parsed again and must give the same tokens, otherwise
+ * NULL is returned and the original is used. The result is in scratch
+ * memory and never larger than the input.
+ */
+static u8 *DDF_MinifyJSON(const DDF_BundleCtx *ctx, cj_ctx *cj, unsigned *size)
+{
+    unsigned i;
+    unsigned pos;
+    unsigned len;
+    u8 *out;
+    cj_ctx check;
+    cj_token *tok;
+
+    if (cj->tokens_pos == 0 || cj->size + cj->tokens_pos * sizeof(cj_token) + 64 >= U_ScratchRemaining())
+        return NULL;
+
+    out = U_ScratchAlloc((unsigned)cj->size);
+
+    for (i = 0, pos = 0; i < cj->tokens_pos; i++)
+    {
+        tok = &cj->tokens[i];
+        len = (unsigned)tok->len;
+        if (tok->type == CJ_TOKEN_STRING)
+            len += 2; /* the token excludes the quotes */
+
+        if (pos + len > cj->size)
+            return NULL;
+
+        if (tok->type == CJ_TOKEN_STRING)
+        {
+            out[pos] = '"';
+            U_memcpy(&out[pos + 1], &cj->buf[tok->pos], tok->len);
+            out[pos + len - 1] = '"';
+        }
+        else
+        {
+            U_memcpy(&out[pos], &cj->buf[tok->pos], len);
+        }
+        pos += len;
+    }
+
+    /* same token types, contents and tree structure */
+    check.tokens = U_ScratchAlloc((unsigned)cj->tokens_pos * sizeof(cj_token));
+    cj_parse_init(&check, (const char*)out, pos, check.tokens, cj->tokens_pos);
+    cj_parse(&check);
+
+    for (i = 0; check.status == CJ_OK && i < cj->tokens_pos; i++)
+    {
+        tok = &cj->tokens[i];
+        if (check.tokens_pos != cj->tokens_pos ||
+            check.tokens[i].type != tok->type || check.tokens[i].parent != tok->parent ||
+            check.tokens[i].len != tok->len ||
+            U_memcmp(&out[check.tokens[i].pos], &cj->buf[tok->pos], tok->len) != 0)
+        {
+            check.status = CJ_ERROR;
+        }
+    }
+
+    if (check.status != CJ_OK)
+    {
+        DDF_Log(ctx, "minified JSON differs, store original\n");
+        return NULL;
+    }
+
+    *size = pos;
+    return out;
+}
+
+/** Parses and minifies a JSON file, returns NULL if it can't be minified. */
+static u8 *DDF_MinifyFile(const DDF_BundleCtx *ctx, const u8 *data, unsigned size, unsigned *min_size)
+{
+    cj_ctx cj;
+
+    if (MAX_CJ_TOKENS * sizeof(cj_token) >= U_ScratchRemaining())
+        return NULL;
+
+    cj.tokens = U_ScratchAlloc(MAX_CJ_TOKENS * sizeof(cj_token));
+    cj_parse_init(&cj, (const char*)data, size, cj.tokens, MAX_CJ_TOKENS);
+    cj_parse(&cj);
+
+    if (cj.status != CJ_OK)
+        return NULL;
+
+    return DDF_MinifyJSON(ctx, &cj, min_size);
+}
+
+/** Writes the DDF JSON as DDFC chunk, or DDFZ/DDFD if compressed.
+ */
+static void DDF_PutDDF(DDF_BundleCtx *ctx, DDF_Doc *doc)
+{
+    u8 *min;
+    u8 *comp;
+    const u8 *data;
+    unsigned size;
+    unsigned comp_size;
+    unsigned scratch_pos;
+    unsigned long chunk_pos;
+    DDF_Writer *w;
+
+    w = &ctx->w;
+    chunk_pos = DDF_WriterPos(w);
+    scratch_pos = U_ScratchPos();
+    comp = NULL;
+    min = NULL;
+    data = doc->data;
+    size = doc->size;
+
+    if (ctx->flags & DDF_CREATE_MINIFY)
+        min = DDF_MinifyJSON(ctx, &doc->cj, &size);
+
+    if (min)
+        data = min;
+    else
+        size = doc->size;
+
+    if (ctx->flags & DDF_CREATE_COMPRESS)
+        comp = DDF_Compress(ctx, data, size, &comp_size);
+
+    if (comp)
+    {
+        DDF_WriterPutFourCC(w, ctx->in->dict_size ? "DDFD" : "DDFZ");
+        DDF_PutCompressed(ctx, comp, comp_size, size);
+    }
+    else
+    {
+        DDF_WriterPutFourCC(w, "DDFC");
+        DDF_WriterPutU32(w, size);
+        if (min)
+            DDF_WriterPut(w, data, size); /* scratch memory, can't be referenced */
+        else
+            DDF_WriterPutRef(w, data, size);
+    }
+
+    DDF_IndexAdd(ctx, comp ? (ctx->in->dict_size ? "DDFD" : "DDFZ") : "DDFC", "", chunk_pos);
+    U_ScratchRestore(scratch_pos);
+}
+
+/** Writes a EXTF chunk, or EXTZ/EXTD if compressed. 'type' is the file type "SCJS" or "JSON".
+ *
+ * EXTZ and EXTD have the EXTF layout, with the file data of DDF_PutCompressed().
+ */
+static void DDF_PutExtFile(DDF_BundleCtx *ctx, const char *type, const char *path,
+                           const char *mtime, const void *data, unsigned size)
+{
+    u8 *min;
+    u8 *comp;
+    unsigned comp_size;
+    unsigned min_size;
+    unsigned scratch_pos;
+    unsigned long extf_size_pos;
+    const char *tag;
+    DDF_Writer *w;
+
+    if (ctx->flags & DDF_CREATE_COUNT)
+    {
+        ctx->file_count++;
+        return;
+    }
+
+    w = &ctx->w;
+    scratch_pos = U_ScratchPos();
+    comp = NULL;
+    min = NULL;
+
+    if ((ctx->flags & DDF_CREATE_MINIFY) && U_memcmp(type, "JSON", 4) == 0)
+        min = DDF_MinifyFile(ctx, data, size, &min_size);
+
+    if (min)
+    {
+        data = min;
+        size = min_size;
+    }
+
+    if (ctx->flags & DDF_CREATE_TRAIN)
+    {
+        DDF_AddDictSample(data, size);
+        U_ScratchRestore(scratch_pos);
+        return;
+    }
+
+    if (ctx->flags & DDF_CREATE_COMPRESS)
+        comp = DDF_Compress(ctx, data, size, &comp_size);
+
+    if (!comp)
+        tag = "EXTF";
+    else
+        tag = ctx->in->dict_size ? "EXTD" : "EXTZ";
+
+    extf_size_pos = DDF_BeginChunk(w, tag);
+    DDF_WriterPutFourCC(w, type);
+
+    /* put path without '\0' */
+    DDF_WriterPutU16(w, U_strlen(path));
+    DDF_WriterPut(w, path, U_strlen(path));
+
+    /* modification time in ISO 8601 format, length without '\0' */
+    DDF_WriterPutU16(w, U_strlen(mtime));
+    DDF_WriterPut(w, mtime, U_strlen(mtime));
+
+    if (comp)
+    {
+        DDF_PutCompressed(ctx, comp, comp_size, size);
+    }
+    else
+    {
+        DDF_WriterPutU32(w, size);
+        if (min)
+            DDF_WriterPut(w, data, size); /* scratch memory, can't be referenced */
+        else
+            DDF_WriterPutRef(w, data, size);
+    }
+
+    DDF_EndChunk(w, extf_size_pos);
+    DDF_IndexAdd(ctx, tag, path, extf_size_pos - 4);
+    U_ScratchRestore(scratch_pos);
+}
+
+static int cj_is_valid_ref(cj_ctx *cj, cj_token_ref ref)
+{
+    if (ref >= 0 && ref < (cj_token_ref)cj->tokens_pos)
+        return 1;
+    return 0;
+}
+
+static int cj_is_array(cj_ctx *cj, cj_token_ref ref)
+{
+    if (cj_is_valid_ref(cj, ref))
+    {
+        if (cj->tokens[ref].type == CJ_TOKEN_ARRAY_BEG)
+            return 1;
+    }
+
+    return 0;
+}
+
+static void U_sstream_put_js_str(U_SStream *ss, const char *str)
+{
+    U_sstream_put_str(ss, "\"");
+    U_sstream_put_str(ss, str);
+    U_sstream_put_str(ss, "\"");
+}
+
+static int DDF_ResolveConstant(DDF_BundleCtx *ctx, const char *constant, char *buf, unsigned bufsize)
+{
+    unsigned len;
+    const char *value;
+    const DDFB_Resolver *res;
+
+    U_ASSERT(U_strlen(constant) > 0);
+
+    buf[0] = '\0';
+    res = &ctx->in->resolver;
+
+    if (res->constant && res->constant(res->user, constant, &value, &len) &&
+        len > 0 && len < bufsize)
+    {
+        U_memcpy(buf, value, len);
+        buf[len] = '\0';
+        DDF_Log(ctx, "resolved: %s -> %s\n", constant, buf);
+        return 1;
+    }
+
+    DDF_Log(ctx, "failed to resolve constant: %s\n", constant);
+    return 0;
+}
+
+static int DDF_MakeDescriptor(DDF_BundleCtx *ctx, DDF_Doc *doc, U_SStream *ss)
+{
+    cj_ctx *cj;
+    cj_token_ref ref_modelid0;
+    cj_token_ref ref_modelid1;
+    cj_token_ref ref_mfname0;
+    cj_token_ref ref_mfname1;
+    char *valbuf;
+    char *valbuf1;
+    const char *mtime;
+    int devid_count;
+    unsigned scratch_pos;
+
+    scratch_pos = U_ScratchPos();
+    cj = &doc->cj;
+
+    U_ASSERT(ss->pos == 0);
+
+    valbuf = U_ScratchAlloc(VAL_BUF_SIZE);
+    valbuf1 = U_ScratchAlloc(VAL_BUF_SIZE);
+
+    /* start descriptor object */
+    U_sstream_put_str(ss, "{");
+
+    /* version (required) */
+    if (cj_copy_value(cj, valbuf, VAL_BUF_SIZE, 0, "version"))
+    {
+        U_sstream_put_js_str(ss, "version");
+        U_sstream_put_str(ss, ":");
+        U_sstream_put_js_str(ss, valbuf);
+        U_sstream_put_str(ss, ",");
+    }
+    else
+    {
+        /* temporary use version "0.0.0" until we have actual versions */
+        U_sstream_put_js_str(ss, "version");
+        U_sstream_put_str(ss, ":");
+        U_sstream_put_js_str(ss, "0.0.0");
+        U_sstream_put_str(ss, ",");
+    }
+    /*
+    else
+    {
+        DDF_Log(ctx, "key 'version' not found\n");
+        goto err;
+    }
+    */
+
+    /*** version_deconz (required) ***********************************/
+    if (cj_copy_value(cj, valbuf, VAL_BUF_SIZE, 0, "version_deconz"))
+    {
+        U_sstream_put_js_str(ss, "version_deconz");
+        U_sstream_put_str(ss, ":");
+        U_sstream_put_js_str(ss, valbuf);
+        U_sstream_put_str(ss, ",");
+    }
+    else
+    {
+        /* temporary use version "2.19.3" until we have actual versions */
+        U_sstream_put_js_str(ss, "version_deconz");
+        U_sstream_put_str(ss, ":");
+        U_sstream_put_js_str(ss, ">2.19.3");
+        U_sstream_put_str(ss, ",");
+    }
+    /*
+    else
+    {
+        DDF_Log(ctx, "key 'version_deconz' not found\n");
+        goto err;
+    }
+    */
+
+    /*** last_modified (required) ************************************/
+    mtime = ctx->in->ddf_mtime;
+
+    if (mtime && mtime[0])
+    {
+        U_sstream_put_js_str(ss, "last_modified");
+        U_sstream_put_str(ss, ":");
+        U_sstream_put_js_str(ss, mtime);
+        U_sstream_put_str(ss, ",");
+    }
+
+
+    /* product (required) */
+    if (cj_copy_value(cj, valbuf, VAL_BUF_SIZE, 0, "product"))
+    {
+        U_sstream_put_js_str(ss, "product");
+        U_sstream_put_str(ss, ":");
+        U_sstream_put_js_str(ss, valbuf);
+        U_sstream_put_str(ss, ",");
+    }
+    else
+    {
+        DDF_Log(ctx, "key 'product' not found\n");
+        goto err;
+    }
+
+    /*** device_identifiers (required) *********************************/
+    /*
+        Processes both, modelid and mfname, arrays in parallel.
+    */
+    ref_modelid0 = cj_value_ref(cj, 0, "modelid");
+    if (cj_is_valid_ref(cj, ref_modelid0) == 0)
+    {
+        DDF_Log(ctx, "key 'modelid' not found\n");
+        goto err;
+    }
+
+    ref_mfname0 = cj_value_ref(cj, 0, "manufacturername");
+    if (cj_is_valid_ref(cj, ref_mfname0) == 0)
+    {
+        DDF_Log(ctx, "key 'manufacturername' not found\n");
+        goto err;
+    }
+
+    U_sstream_put_js_str(ss, "device_identifiers");
+    U_sstream_put_str(ss, ":[");
+
+    devid_count = 0;
+    if (cj_is_array(cj, ref_modelid0) && cj_is_array(cj, ref_mfname0))
+    {
+        ref_modelid1 = ref_modelid0 + 1;
+        ref_mfname1 = ref_mfname0 + 1;
+
+        for (; ;ref_modelid1++, ref_mfname1++)
+        {
+            if (cj_is_valid_ref(cj, ref_modelid1) == 0)
+                goto err_invalid_model_mfname;
+
+            if (cj_is_valid_ref(cj, ref_mfname1) == 0)
+                goto err_invalid_model_mfname;
+
+            /* arrays must have equal arity */
+            if (cj->tokens[ref_modelid1].type != cj->tokens[ref_mfname1].type)
+                goto err_invalid_model_mfname;
+
+            if (cj->tokens[ref_modelid1].type == CJ_TOKEN_ARRAY_END)
+                break;
+
+            if (cj->tokens[ref_modelid1].parent != ref_modelid0)
+                goto err_invalid_model_mfname;
+
+            if (cj->tokens[ref_mfname1].parent != ref_mfname0)
+                goto err_invalid_model_mfname;
+
+            if (cj->tokens[ref_modelid1].type == CJ_TOKEN_ITEM_SEP)
+                continue;
+
+            if (cj->tokens[ref_modelid1].type != CJ_TOKEN_STRING)
+                goto err_invalid_model_mfname;
+
+
+            if (devid_count > 0)
+                U_sstream_put_str(ss, ",");
+
+            /* [ mfname, modelid ] */
+            U_sstream_put_str(ss, "[");
+
+            if (cj_copy_ref(cj, valbuf, VAL_BUF_SIZE, ref_mfname1) == 0)
+                goto err_invalid_model_mfname;
+
+            if (valbuf[0] == '$') /* resolve constant to actual mfname */
+            {
+                if (DDF_ResolveConstant(ctx, valbuf, valbuf1, VAL_BUF_SIZE) == 0)
+                    goto err_invalid_model_mfname;
+                U_sstream_put_js_str(ss, valbuf1);
+            }
+            else
+            {
+                U_sstream_put_js_str(ss, valbuf);
+            }
+
+            U_sstream_put_str(ss, ",");
+
+            if (cj_copy_ref(cj, valbuf, VAL_BUF_SIZE, ref_modelid1) == 0)
+                goto err_invalid_model_mfname;
+            U_sstream_put_js_str(ss, valbuf);
+
+            U_sstream_put_str(ss, "]");
+
+            devid_count++;
+        }
+    }
+    else if (cj->tokens[ref_modelid0].type == CJ_TOKEN_STRING &&
+             cj->tokens[ref_mfname0].type == CJ_TOKEN_STRING)
+    {
+        /* [ mfname, modelid ] */
+        U_sstream_put_str(ss, "[");
+
+        if (cj_copy_ref(cj, valbuf, VAL_BUF_SIZE, ref_mfname0) == 0)
+            goto err_invalid_model_mfname;
+
+        if (valbuf[0] == '$') /* resolve constant to actual mfname */
+        {
+            if (DDF_ResolveConstant(ctx, valbuf, valbuf1, VAL_BUF_SIZE) == 0)
+                goto err_invalid_model_mfname;
+            U_sstream_put_js_str(ss, valbuf1);
+        }
+        else
+        {
+            U_sstream_put_js_str(ss, valbuf);
+        }
+
+        U_sstream_put_str(ss, ",");
+
+        if (cj_copy_ref(cj, valbuf, VAL_BUF_SIZE, ref_modelid0) == 0)
+            goto err_invalid_model_mfname;
+        U_sstream_put_js_str(ss, valbuf);
+
+        U_sstream_put_str(ss, "]");
+
+        devid_count++;
+    }
+    else
+    {
+        goto err_invalid_model_mfname;
+    }
+
+    if (devid_count == 0)
+        goto err_invalid_model_mfname;
+
+    /*** end device_identifiers ********************************************************/
+    U_sstream_put_str(ss, "]");
+
+    /* end descriptor object */
+    U_sstream_put_str(ss, "}");
+
+    if (ss->status != U_SSTREAM_OK)
+    {
+        DDF_Log(ctx, "descriptor too large\n");
+        goto err;
+    }
+
+    DDF_Log(ctx, "\n%s\n", ss->str);
+
+    U_ScratchRestore(scratch_pos);
+    return 1;
+
+err:
+    return 0;
+
+err_invalid_model_mfname:
+    DDF_Log(ctx, "key 'manufacturername' or 'modelid' invalid\n");
+    return 0;
+}
+
+/** Gives a DDFB_Input back to the resolver, pending references to it are flushed first.
+ */
+static void DDF_ReleaseInput(DDF_BundleCtx *ctx, DDFB_Input *file)
+{
+    const DDFB_Resolver *res;
+
+    res = &ctx->in->resolver;
+    if (file->handle && res->release)
+    {
+        DDF_WriterFlush(&ctx->w);
+        res->release(res->user, file);
+    }
+}
+
+static int DDF_ResolveGenericItem(DDF_BundleCtx *ctx, const char *item_name)
+{
+    unsigned i;
+    char *rel_path;
+    unsigned scratch_pos;
+    int inserted;
+    DDFB_Input file;
+    const DDFB_Resolver *res;
+    U_SStream ss;
+
+    scratch_pos = U_ScratchPos();
+    res = &ctx->in->resolver;
+
+    rel_path = U_ScratchAlloc(U_PATH_MAX);
+
+    U_sstream_init(&ss, rel_path, U_PATH_MAX);
+    U_sstream_put_str(&ss, "generic/items/");
+
+    i = ss.pos;
+    U_sstream_put_str(&ss, item_name);
+
+    for (; i < ss.pos; i++)
+    {
+        if (ss.str[i] == '/')
+            ss.str[i] = '_';
+    }
+
+    U_sstream_put_str(&ss, "_item.json");
+
+    /* mark added files by remember the relative path */
+    if (U_HashMapInsert(&ctx->generic_items, rel_path, U_strlen(rel_path), &inserted) == NULL)
+    {
+        U_ScratchRestore(scratch_pos);
+        return 0;
+    }
+
+    if (inserted == 0)
+    {
+        /*U_Printf("%s already known\n", rel_path);*/
+        U_ScratchRestore(scratch_pos);
+        return 1;
+    }
+
+    if (ctx->flags & DDF_CREATE_COUNT)
+    {
+        ctx->file_count++; /* the file is resolved in the writing pass */
+        U_ScratchRestore(scratch_pos);
+        return 1;
+    }
+
+    U_bzero(&file, sizeof(file));
+    if (!res->generic_item || res->generic_item(res->user, rel_path, &file) == 0)
+        return 0;
+
+    /*U_Printf("add '%s' %u bytes\n", rel_path, file->size);*/
+
+    DDF_PutExtFile(ctx, "JSON", rel_path, file.mtime ? file.mtime : "", file.data, (unsigned)file.size);
+    DDF_ReleaseInput(ctx, &file);
+
+    U_ScratchRestore(scratch_pos);
+
+    return 1;
+}
+
+static int DDF_AddGenericItems(DDF_BundleCtx *ctx, DDF_Doc *doc)
+{
+    cj_ctx *cj;
+    cj_token *tok;
+    cj_token_ref ref_subdevices;
+    cj_token_ref ref_subdev;
+    cj_token_ref ref_items;
+    cj_token_ref ref_item_name;
+    char *valbuf;
+    unsigned scratch_pos;
+    unsigned tok_pos;
+
+    scratch_pos = U_ScratchPos();
+    cj = &doc->cj;
+
+    valbuf = U_ScratchAlloc(VAL_BUF_SIZE);
+
+    ref_subdevices = cj_value_ref(cj, 0, "subdevices");
+    if (cj_is_valid_ref(cj, ref_subdevices) == 0)
+    {
+        DDF_Log(ctx, "key 'subdevices' not found\n");
+        goto err;
+    }
+
+    for (tok_pos = ref_subdevices; tok_pos < cj->tokens_pos; tok_pos++)
+    {
+        tok = &cj->tokens[tok_pos];
+        if (tok->parent == ref_subdevices && tok->type == CJ_TOKEN_OBJECT_BEG)
+        {
+            ref_subdev = tok_pos;
+
+            ref_items = cj_value_ref(cj, ref_subdev, "items");
+            if (cj_is_valid_ref(cj, ref_items) == 0)
+            {
+                DDF_Log(ctx, "key 'items' not found\n");
+                goto err;
+            }
+
+            for (tok_pos = ref_items; tok_pos < cj->tokens_pos; tok_pos++)
+            {
+                tok = &cj->tokens[tok_pos];
+
+                if (tok->parent == ref_subdev && tok->type == CJ_TOKEN_OBJECT_END)
+                    break; /* end of items array */
+
+                if (tok->parent == ref_items && tok->type == CJ_TOKEN_OBJECT_BEG)
+                {
+                    ref_item_name = cj_value_ref(cj, tok_pos, "name");
+                    if (cj_is_valid_ref(cj, ref_item_name) == 0)
+                    {
+                        DDF_Log(ctx, "key item.'name' not found\n");
+                        goto err;
+                    }
+
+                    if (cj_copy_ref(cj, valbuf, VAL_BUF_SIZE, ref_item_name) == 0)
+                        goto err;
+
+                    if (DDF_ResolveGenericItem(ctx, valbuf) == 0)
+                    {
+                        DDF_Log(ctx, "failed to resolve file for generic item: %s\n", valbuf);
+                        goto err;
+                    }
+                }
+            }
+        }
+    }
+
+    U_ScratchRestore(scratch_pos);
+    return 1;
+
+err:
+    U_ScratchRestore(scratch_pos);
+    return 0;
+}
+
+/* constant used in the DDF and its value, in order of first use */
+typedef struct DDF_UsedConstant
+{
+    struct DDF_UsedConstant *next;
+    char *name;
+    char *value;
+} DDF_UsedConstant;
+
+/** Adds a EXTF chunk with filtered constants (only the ones used in the DDF).
+ *
+ * The used constants are resolved first, the output buffer then gets the
+ * exact size of the filtered JSON object.
+ */
+static int DDF_AddConstants(DDF_BundleCtx *ctx, DDF_Doc *doc)
+{
+    cj_ctx *cj;
+    cj_token *tok;
+    char *valbuf0;
+    char *valbuf1;
+    unsigned size;
+    unsigned name_len;
+    unsigned value_len;
+    unsigned scratch_pos;
+    unsigned tok_pos;
+    int inserted;
+    U_HashMap constants_cache;
+    DDF_UsedConstant *c;
+    DDF_UsedConstant *first;
+    DDF_UsedConstant **last;
+    U_SStream ss;
+
+    scratch_pos = U_ScratchPos();
+    cj = &doc->cj;
+    first = NULL;
+    last = &first;
+    size = 3; /* "{}" and '\0' of the stream */
+
+    valbuf0 = U_ScratchAlloc(VAL_BUF_SIZE);
+    valbuf1 = U_ScratchAlloc(VAL_BUF_SIZE);
+    U_HashMapInit(&constants_cache, U_ScratchArena(), 64);
+
+    for (tok_pos = 0; tok_pos < cj->tokens_pos; tok_pos++)
+    {
+        tok = &cj->tokens[tok_pos];
+        if (tok[0].type != CJ_TOKEN_STRING)
+            continue;
+
+        if (cj_copy_ref(cj, valbuf0, VAL_BUF_SIZE, tok_pos) == 0)
+            goto err;
+
+        if (valbuf0[0] == '$')
+        {
+            if (valbuf0[1] < 'A' || valbuf0[1] > 'Z')
+                continue; /* only upper-case constants */
+
+            name_len = U_strlen(valbuf0);
+            if (U_HashMapInsert(&constants_cache, valbuf0, name_len, &inserted) == NULL)
+                goto err;
+
+            if (inserted) /* not in cache yet */
+            {
+                if (DDF_ResolveConstant(ctx, valbuf0, valbuf1, VAL_BUF_SIZE) == 0)
+                    goto err;
+
+                value_len = U_strlen(valbuf1);
+                c = U_ScratchAlloc(sizeof(*c));
+                if (c)
+                {
+                    c->name = U_ScratchAlloc(name_len + 1);
+                    c->value = U_ScratchAlloc(value_len + 1);
+                }
+
+                if (!c || !c->name || !c->value)
+                {
+                    DDF_Log(ctx, "constants too large\n");
+                    goto err;
+                }
+
+                U_memcpy(c->name, valbuf0, name_len + 1);
+                U_memcpy(c->value, valbuf1, value_len + 1);
+                c->next = NULL;
+                *last = c;
+                last = &c->next;
+
+                /* "name":"value" and ',' before all but the first */
+                size += name_len + value_len + 5 + (c != first ? 1 : 0);
+            }
+        }
+    }
+
+    /* build filtered constants object */
+    ss.len = size;
+    ss.str = U_ScratchAlloc(ss.len);
+    if (!ss.str)
+    {
+        DDF_Log(ctx, "constants too large\n");
+        goto err;
+    }
+    U_sstream_init(&ss, ss.str, ss.len);
+
+    U_sstream_put_str(&ss, "{");
+
+    for (c = first; c; c = c->next)
+    {
+        if (c != first)
+            U_sstream_put_str(&ss, ",");
+
+        U_sstream_put_js_str(&ss, c->name);
+        U_sstream_put_str(&ss, ":");
+        U_sstream_put_js_str(&ss, c->value);
+    }
+
+    U_sstream_put_str(&ss, "}");
+    U_ASSERT(ss.status == U_SSTREAM_OK && ss.pos + 1 == ss.len);
+
+    /*** add EXTF chunk **********************************************/
+    DDF_PutExtFile(ctx, "JSON", "generic/constants_min.json",
+                   ctx->in->constants_mtime ? ctx->in->constants_mtime : "", ss.str, ss.pos);
+    DDF_WriterFlush(&ctx->w); /* before the referenced scratch memory is released */
+
+    U_ScratchRestore(scratch_pos);
+    return 1;
+
+err:
+    U_ScratchRestore(scratch_pos);
+    return 0;
+}
+
+/** Normalizes a path for comparison.
+ *
+ * Converts '\\' to '/', removes empty and "." segments and resolves ".."
+ * segments, e.g. "./a/../b.js" -> "b.js". A leading separator is kept, so
+ * "/a/b.js" and "a/b.js" stay distinct, resolvers may map them to different
+ * files. 'out' needs the size of 'path'.
+ */
+static void DDF_NormalizePath(const char *path, char *out)
+{
+    unsigned i;
+    unsigned j;
+    unsigned k;
+    unsigned seg;
+    unsigned len;
+    unsigned root;
+
+    i = 0;
+    j = 0;
+    root = 0;
+
+    if (path[0] == '/' || path[0] == '\\')
+    {
+        out[j++] = '/';
+        root = 1;
+    }
+
+    while (path[i])
+    {
+        seg = i;
+        while (path[i] && path[i] != '/' && path[i] != '\\')
+            i++;
+
+        len = i - seg;
+        if (path[i])
+            i++; /* skip separator */
+
+        if (len == 0 || (len == 1 && path[seg] == '.'))
+            continue;
+
+        if (len == 2 && path[seg] == '.' && path[seg + 1] == '.' && j > root)
+        {
+            for (k = j; k && out[k - 1] != '/'; k--)
+                ;
+
+            /* drop previous segment, unless it is ".." as well */
+            if (j - k != 2 || out[k] != '.' || out[k + 1] != '.')
+            {
+                j = k > root ? k - 1 : root;
+                continue;
+            }
+        }
+
+        if (j > root)
+            out[j++] = '/';
+
+        U_memcpy(&out[j], &path[seg], len);
+        j += len;
+    }
+
+    out[j] = '\0';
+}
+
+/** Adds a EXTF chunk for each script referenced in the DDF.
+ *
+ * Script paths are taken from "script" keys in the token tree, each file
+ * is only added once even if it is referenced by multiple items.
+ */
+static int DDF_AddScripts(DDF_BundleCtx *ctx, DDF_Doc *doc)
+{
+    cj_ctx *cj;
+    cj_token *tok;
+    DDFB_Input file;
+    const DDFB_Resolver *res;
+    char *str;
+    char *norm;
+    int inserted;
+    unsigned slen;
+    unsigned tok_pos;
+    unsigned scratch_pos;
+    unsigned file_pos;
+    U_HashMap scripts; /* normalized paths of added scripts */
+
+    scratch_pos = U_ScratchPos();
+    cj = &doc->cj;
+    res = &ctx->in->resolver;
+
+    U_HashMapInit(&scripts, U_ScratchArena(), 16);
+
+    for (tok_pos = 0; tok_pos + 2 < cj->tokens_pos; tok_pos++)
+    {
+        tok = &cj->tokens[tok_pos];
+        if (tok[0].type != CJ_TOKEN_STRING || tok[0].len != 6)
+            continue;
+        if (tok[1].type != CJ_TOKEN_NAME_SEP || tok[2].type != CJ_TOKEN_STRING)
+            continue;
+        if (U_memcmp(&cj->buf[tok[0].pos], "script", 6) != 0)
+            continue;
+
+        slen = tok[2].len;
+        if (slen == 0)
+            continue;
+
+        if (slen >= U_PATH_MAX || slen > 0xFFFF)
+        {
+            DDF_Log(ctx, "script path too long (%u bytes)\n", slen);
+            goto err;
+        }
+
+        str = U_ScratchAlloc(slen + 1);
+        norm = U_ScratchAlloc(slen + 1);
+        U_ASSERT(str && norm);
+        U_memcpy(str, &cj->buf[tok[2].pos], slen);
+        str[slen] = '\0';
+        DDF_NormalizePath(str, norm);
+
+        if (U_HashMapInsert(&scripts, norm, U_strlen(norm), &inserted) == NULL)
+            goto err;
+
+        if (inserted == 0)
+            continue; /* already added */
+
+        if (ctx->flags & DDF_CREATE_COUNT)
+        {
+            ctx->file_count++; /* the file is resolved in the writing pass */
+            continue;
+        }
+
+        file_pos = U_ScratchPos();
+        U_bzero(&file, sizeof(file));
+
+        if (!res->script || res->script(res->user, str, &file) == 0 || file.size == 0)
+        {
+            DDF_ReleaseInput(ctx, &file);
+            DDF_Log(ctx, "failed to resolve %s\n", str);
+            goto err;
+        }
+
+        DDF_Log(ctx, "resolved %s (%lu bytes)\n", str, file.size);
+        DDF_PutExtFile(ctx, "SCJS", str, file.mtime ? file.mtime : "", file.data, (unsigned)file.size);
+        DDF_ReleaseInput(ctx, &file);
+        U_ScratchRestore(file_pos);
+    }
+
+    U_ScratchRestore(scratch_pos);
+    return 1;
+
+err:
+    U_ScratchRestore(scratch_pos);
+    return 0;
+}
+
+/** Parses the DDF JSON, the tokens are used by all following stages.
+ *
+ * Returns 0 if the JSON is invalid, doc->cj.status has the error.
+ */
+static int DDF_ParseDoc(DDF_Doc *doc, const u8 *data, unsigned size)
+{
+    doc->data = data;
+    doc->size = size;
+    doc->cj.tokens = U_ScratchAlloc(MAX_CJ_TOKENS * sizeof(cj_token));
+    U_ASSERT(doc->cj.tokens);
+
+    cj_parse_init(&doc->cj, (const char*)data, size, doc->cj.tokens, MAX_CJ_TOKENS);
+    cj_parse(&doc->cj);
+
+    return doc->cj.status == CJ_OK ? 1 : 0;
+}
+
+/** Adds the EXTF chunks of scripts, generic items and constants.
+ */
+static int DDF_AddFiles(DDF_BundleCtx *ctx, DDF_Doc *doc)
+{
+    if (DDF_AddScripts(ctx, doc) == 0)
+    {
+        DDF_Log(ctx, "failed to add scripts\n");
+        return 0;
+    }
+
+    if (DDF_AddGenericItems(ctx, doc) == 0)
+    {
+        DDF_Log(ctx, "failed to add generic items\n");
+        return 0;
+    }
+
+    if (DDF_AddConstants(ctx, doc) == 0)
+    {
+        DDF_Log(ctx, "failed to add constants\n");
+        return 0;
+    }
+
+    return 1;
+}
+
+/** Allocates the per bundle context in scratch memory.
+ */
+static DDF_BundleCtx *DDF_InitBundleCtx(const DDFB_BuildInput *in, unsigned flags)
+{
+    DDF_BundleCtx *ctx;
+
+    ctx = U_ScratchAlloc(sizeof(*ctx));
+    U_bzero(ctx, sizeof(*ctx));
+    ctx->flags = flags;
+    ctx->in = in;
+    U_InitArenaStatic(&ctx->arena, U_ScratchAlloc(BUNDLE_ARENA_SIZE), BUNDLE_ARENA_SIZE);
+    U_HashMapInit(&ctx->generic_items, &ctx->arena, 64);
+    return ctx;
+}
+
+/** Writes the bundle of a parsed DDF to the sink of ctx->w.
+ *
+ * Returns 0 on errors, incomplete output may have been written then.
+ */
+static int DDF_WriteBundle(DDF_BundleCtx *ctx, DDF_Doc *doc)
+{
+    U_SStream ss;
+    DDF_Writer *w;
+    unsigned flags;
+    unsigned long ddfb_size_pos;
+    unsigned long index_pos;
+
+    flags = ctx->flags;
+
+    if (flags & DDF_CREATE_TRAIN)
+    {
+        /* only collect the files which would be bundled, see DDF_PutExtFile() */
+        return DDF_AddFiles(ctx, doc);
+    }
+
+    if (flags & DDF_CREATE_INDEX)
+    {
+        /* the INDX chunk is written before the files, count them first */
+        ctx->flags |= DDF_CREATE_COUNT;
+        if (DDF_AddFiles(ctx, doc) == 0)
+            return 0;
+
+        /* the arena only holds the generic items map of the counting
+           pass, start over with an empty map in the same memory */
+        ctx->flags = flags;
+        U_InitArenaStatic(&ctx->arena, ctx->arena.buf, BUNDLE_ARENA_SIZE);
+        U_HashMapInit(&ctx->generic_items, &ctx->arena, 64);
+
+        ctx->index_size = ctx->file_count + 1; /* + DDF */
+        ctx->index = U_AllocArena(&ctx->arena, ctx->index_size * sizeof(*ctx->index), U_ARENA_ALIGN_8);
+        if (!ctx->index)
+            return 0;
+    }
+
+    /* the descriptor is a subset of the DDF, with resolved constants */
+    ss.len = doc->size + U_KILO_BYTES(64);
+    U_sstream_init(&ss, U_ScratchAlloc(ss.len), ss.len);
+
+    if (DDF_MakeDescriptor(ctx, doc, &ss) == 0)
+    {
+        DDF_Log(ctx, "failed to make DESC chunk\n");
+        return 0;
+    }
+
+    /* RIFF encoded output, streamed to the sink */
+    w = &ctx->w;
+
+    /*** RIFF header *************************************************/
+    DDF_WriterPutFourCC(w, "RIFF");
+    U_ASSERT(DDF_WriterPos(w) == 4);
+    DDF_WriterPutU32(w, 0); /* dummy filled later */
+
+    /*** DDFB header *************************************************/
+    ddfb_size_pos = DDF_BeginChunk(w, "DDFB"); /* DDF_BUNDLE_MAGIC */
+    U_ASSERT(ddfb_size_pos == 12);
+
+    /*** DESC chunk **************************************************/
+    DDF_WriterPutFourCC(w, "DESC");
+    DDF_WriterPutU32(w, ss.pos);
+    U_ASSERT(DDF_WriterPos(w) == 24);
+    DDF_WriterPutRef(w, ss.str, ss.pos);
+
+    /*** INDX chunk **************************************************/
+    index_pos = 0;
+    if (flags & DDF_CREATE_INDEX)
+        index_pos = DDF_ReserveIndex(ctx);
+
+    /*** DDFC chunk **************************************************/
+    /* Aka the base DDF JSON file. */
+    DDF_PutDDF(ctx, doc);
+
+    /*** EXTF chunk(s) scripts, generic items and constants **********/
+    if (DDF_AddFiles(ctx, doc) == 0)
+        return 0;
+
+    if ((flags & DDF_CREATE_INDEX) && DDF_WriteIndex(ctx, index_pos) == 0)
+        return 0;
+
+    DDF_EndChunk(w, ddfb_size_pos);
+    /* file size in RIFF header */
+    DDF_WriterPatchU32(w, 4, DDF_WriterPos(w) - 8);
+
+    DDF_WriterFlush(w);
+    return w->status;
+}
+
+/** Returns the id by which bundles refer to a dictionary: the first
+ *  4 bytes of its SHA-256 hash as little endian u32.
+ */
+static u32 DDF_DictionaryId(const u8 *data, unsigned size)
+{
+    u8 sha256[32];
+
+    U_sha256(data, size, &sha256[0]);
+    return (u32)sha256[0] | (u32)sha256[1] << 8 | (u32)sha256[2] << 16 | (u32)sha256[3] << 24;
+}
+
+int DDFB_BuilderInit(void)
+{
+    void *mem;
+
+    /* not U_ScratchInit(), U_AllocManaged() is only for the main thread */
+    mem = malloc(SCRATCH_SIZE);
+    if (!mem)
+        return 0;
+
+    U_ScratchInitStatic(mem, SCRATCH_SIZE);
+    return 1;
+}
+
+void DDFB_BuilderFree(void)
+{
+    void *mem;
+
+    mem = U_ScratchArena()->buf;
+    U_ScratchFree();
+    free(mem);
+}
+
+int DDFB_Build(const DDFB_BuildInput *in, const DDFB_Sink *sink, unsigned flags)
+{
+    int ret;
+    unsigned scratch_pos;
+    DDF_Doc doc;
+    DDF_BundleCtx *ctx;
+
+    flags &= DDFB_BUILD_COMPRESS | DDFB_BUILD_MINIFY | DDFB_BUILD_INDEX;
+
+    if (!in->ddf || in->ddf_size == 0 || in->ddf_size > 0x7FFFFFFF)
+        return 0;
+
+    if (in->dict_size > DDF_DICT_MAX_SIZE)
+        return 0;
+
+    if (in->dict_size)
+        flags |= DDFB_BUILD_COMPRESS;
+
+    ret = 0;
+    scratch_pos = U_ScratchPos();
+    U_bzero(&doc, sizeof(doc));
+
+    if (DDF_ParseDoc(&doc, in->ddf, (unsigned)in->ddf_size))
+    {
+        ctx = DDF_InitBundleCtx(in, flags);
+        if (in->dict_size)
+            ctx->dict_id = DDF_DictionaryId(in->dict, (unsigned)in->dict_size);
+
+        DDF_WriterInit(&ctx->w, sink);
+        ret = DDF_WriteBundle(ctx, &doc);
+    }
+
+    U_ScratchRestore(scratch_pos);
+    return ret;
+}
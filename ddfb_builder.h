@@ -0,0 +1,104 @@
+#ifndef DDFB_BUILDER_H
+#define DDFB_BUILDER_H
+
+/* Creates DDF bundles from memory.
+
+   The builder takes the DDF JSON as buffer, all files referenced by it are
+   requested from resolver callbacks and the bundle is written to a sink.
+   No files are accessed unless the callbacks do so. The ddfb tool uses the
+   same code with resolvers reading from the DDF base directory.
+
+   Every thread calling DDFB_Build() needs to call DDFB_BuilderInit() first.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* the library is compiled with hidden visibility, only the API is exported */
+#ifndef DDFB_API
+  #if defined(__GNUC__)
+    #define DDFB_API __attribute__ ((visibility("default")))
+  #else
+    #define DDFB_API
+  #endif
+#endif
+
+#define DDFB_BUILD_COMPRESS 0x04 /* LZ4 compressed DDFZ, EXTZ chunks, DDFD, EXTD with dictionary */
+#define DDFB_BUILD_MINIFY   0x10 /* strip whitespace from DDF and JSON files */
+#define DDFB_BUILD_INDEX    0x20 /* write INDX chunk after DESC */
+
+/* A file returned by a resolver. */
+typedef struct DDFB_Input
+{
+    const void *data;
+    unsigned long size;
+    const char *mtime;  /* ISO 8601 "2023-01-08T17:24:24Z" */
+    void *handle;       /* if set, release() is called when the file isn't needed anymore */
+} DDFB_Input;
+
+/* Resolves the files referenced by a DDF, callbacks return 1 on success.
+
+   Files without 'handle' must stay valid until DDFB_Build() returns.
+ */
+typedef struct DDFB_Resolver
+{
+    void *user;
+    /* script as referenced in the DDF, relative to the DDF file */
+    int (*script)(void *user, const char *path, DDFB_Input *file);
+    /* generic item, 'path' is relative to the base directory "generic/items/state_on_item.json" */
+    int (*generic_item)(void *user, const char *path, DDFB_Input *file);
+    /* value of a constant "$MF_IKEA" from generic/constants.json, without quotes */
+    int (*constant)(void *user, const char *name, const char **value, unsigned *value_len);
+    /* optional, for files with 'handle' */
+    void (*release)(void *user, DDFB_Input *file);
+} DDFB_Resolver;
+
+typedef struct DDFB_BuildInput
+{
+    const void *ddf;              /* DDF JSON */
+    unsigned long ddf_size;
+    const char *ddf_mtime;        /* ISO 8601, "last_modified" of the descriptor */
+    const char *constants_mtime;  /* ISO 8601, of generic/constants.json */
+    const void *dict;             /* optional dictionary of 'ddfb mkdict', implies DDFB_BUILD_COMPRESS */
+    unsigned long dict_size;
+    DDFB_Resolver resolver;
+} DDFB_BuildInput;
+
+typedef struct DDFB_IoVec
+{
+    const void *data;
+    unsigned long size;
+} DDFB_IoVec;
+
+/* Receives the bundle, callbacks return 1 on success.
+
+   Data is appended in order. Chunk size fields are written as placeholder
+   and later overwritten by write_at(), so the sink must keep written data
+   accessible, e.g. a file or memory buffer.
+ */
+typedef struct DDFB_Sink
+{
+    void *user;
+    int (*write)(void *user, const DDFB_IoVec *iov, unsigned iov_count);
+    int (*write_at)(void *user, unsigned long pos, const void *data, unsigned long size);
+} DDFB_Sink;
+
+/** Allocates the 32 MB scratch memory of the calling thread, returns 0 if out of memory. */
+DDFB_API int DDFB_BuilderInit(void);
+DDFB_API void DDFB_BuilderFree(void);
+
+/** Creates a bundle, 'flags' is a combination of DDFB_BUILD_ flags.
+ *
+ * Nothing is printed, errors are only reported by the return value.
+ *
+ * \return 1 on success, 0 if the DDF is invalid, a file can't be resolved
+ *         or the sink failed.
+ */
+DDFB_API int DDFB_Build(const DDFB_BuildInput *in, const DDFB_Sink *sink, unsigned flags);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DDFB_BUILDER_H */
@@ -0,0 +1,638 @@
+
+#define DDFB_INDEX_ENTRY_SIZE 16
+#define DDFB_CATALOG_VERSION 1
+#define DDFB_CATALOG_ENTRY_SIZE 16
+#define DDFB_CATALOG_BUNDLE_SIZE 16
+#define DDFB_PACK_OFFSET_SIZE 8
+#define DDFB_PACK_HASH_SIZE 36
+
+static unsigned ddfb_get_u16(const unsigned char *p)
+{
+    return (unsigned)p[0] | (unsigned)p[1] << 8;
+}
+
+static unsigned long ddfb_get_u32(const unsigned char *p)
+{
+    return (unsigned long)p[0] | (unsigned long)p[1] << 8 |
+           (unsigned long)p[2] << 16 | (unsigned long)p[3] << 24;
+}
+
+static int ddfb_is_tag(const unsigned char *p, const char *tag)
+{
+    return p[0] == (unsigned char)tag[0] && p[1] == (unsigned char)tag[1] &&
+           p[2] == (unsigned char)tag[2] && p[3] == (unsigned char)tag[3];
+}
+
+/* Reads the chunk header at 'pos', the chunk must end before 'end'. */
+static int ddfb_get_chunk(const unsigned char *data, unsigned long pos, unsigned long end, DDFB_Chunk *chunk)
+{
+    if (pos > end || end - pos < 8)
+        return 0;
+
+    chunk->tag = &data[pos];
+    chunk->size = ddfb_get_u32(&data[pos + 4]);
+    chunk->data = &data[pos + 8];
+    chunk->offset = pos;
+
+    if (chunk->size > end - pos - 8)
+        return 0;
+
+    return 1;
+}
+
+int DDFB_Open(DDFB_Bundle *bundle, const void *data, unsigned long size)
+{
+    unsigned long pos;
+    DDFB_Chunk chunk;
+
+    bundle->data = data;
+    bundle->size = 0;
+    bundle->ddfb_offset = 0;
+    bundle->ddfb_size = 0;
+
+    if (!data || !ddfb_get_chunk(bundle->data, 0, size, &chunk) || !ddfb_is_tag(chunk.tag, "RIFF"))
+        return 0;
+
+    bundle->size = 8 + chunk.size;
+
+    for (pos = 8; ddfb_get_chunk(bundle->data, pos, bundle->size, &chunk); pos += 8 + chunk.size)
+    {
+        if (ddfb_is_tag(chunk.tag, "DDFB"))
+        {
+            bundle->ddfb_offset = pos;
+            bundle->ddfb_size = chunk.size;
+            return 1;
+        }
+    }
+
+    bundle->size = 0;
+    return 0;
+}
+
+const unsigned char *DDFB_SignedData(const DDFB_Bundle *bundle, unsigned long *size)
+{
+    *size = 8 + bundle->ddfb_size;
+    return &bundle->data[bundle->ddfb_offset];
+}
+
+void DDFB_IterInit(DDFB_Iter *it, const DDFB_Bundle *bundle)
+{
+    it->bundle = bundle;
+    it->pos = bundle->ddfb_offset + 8;
+    it->end = it->pos + bundle->ddfb_size;
+}
+
+int DDFB_IterNext(DDFB_Iter *it, DDFB_Chunk *chunk)
+{
+    const DDFB_Bundle *b;
+
+    b = it->bundle;
+
+    if (it->pos == it->end && it->end != b->size)
+    {
+        /* continue after DDFB in the RIFF container */
+        it->end = b->size;
+    }
+
+    if (it->pos == it->end)
+        return 0;
+
+    if (!ddfb_get_chunk(b->data, it->pos, it->end, chunk))
+    {
+        it->pos = b->size; /* malformed, stop */
+        it->end = b->size;
+        return 0;
+    }
+
+    it->pos += 8 + chunk->size;
+    return 1;
+}
+
+int DDFB_IsTag(const DDFB_Chunk *chunk, const char *tag)
+{
+    return ddfb_is_tag(chunk->tag, tag);
+}
+
+int DDFB_FindChunk(const DDFB_Bundle *bundle, const char *tag, DDFB_Chunk *chunk)
+{
+    DDFB_Iter it;
+
+    DDFB_IterInit(&it, bundle);
+
+    while (DDFB_IterNext(&it, chunk))
+    {
+        if (ddfb_is_tag(chunk->tag, tag))
+            return 1;
+    }
+
+    return 0;
+}
+
+int DDFB_ParseFile(const DDFB_Chunk *chunk, DDFB_File *file)
+{
+    unsigned long pos;
+    unsigned long size;
+    const unsigned char *p;
+
+    p = chunk->data;
+    size = chunk->size;
+    pos = 0;
+
+    file->chunk = *chunk;
+    file->type = (const unsigned char*)"DDFC";
+    file->path = "";
+    file->path_len = 0;
+    file->mtime = "";
+    file->mtime_len = 0;
+    file->dict_id = 0;
+    file->compressed = 0;
+
+    if (ddfb_is_tag(chunk->tag, "EXTF") || ddfb_is_tag(chunk->tag, "EXTZ") || ddfb_is_tag(chunk->tag, "EXTD"))
+    {
+        if (size < 4 + 2)
+            return 0;
+
+        file->type = &p[0];
+        file->path_len = ddfb_get_u16(&p[4]);
+        file->path = (const char*)&p[6];
+        pos = 6;
+
+        if (size - pos < file->path_len + 2UL)
+            return 0;
+
+        pos += file->path_len;
+        file->mtime_len = ddfb_get_u16(&p[pos]);
+        file->mtime = (const char*)&p[pos + 2];
+        pos += 2;
+
+        if (size - pos < file->mtime_len + 4UL)
+            return 0;
+
+        pos += file->mtime_len;
+
+        /* the data size field of EXTZ, EXTD includes the header of the compressed data */
+        size = ddfb_get_u32(&p[pos]);
+        pos += 4;
+
+        if (size > chunk->size - pos)
+            return 0;
+    }
+    else if (!ddfb_is_tag(chunk->tag, "DDFC") && !ddfb_is_tag(chunk->tag, "DDFZ") &&
+             !ddfb_is_tag(chunk->tag, "DDFD"))
+    {
+        return 0;
+    }
+
+    /* pos, size: file data in the chunk, the last tag character tells the variant */
+    if (chunk->tag[3] == 'D')
+    {
+        if (size < 8)
+            return 0;
+
+        file->dict_id = ddfb_get_u32(&p[pos]);
+        pos += 4;
+        size -= 4;
+    }
+
+    if (chunk->tag[3] == 'D' || chunk->tag[3] == 'Z')
+    {
+        if (size < 4)
+            return 0;
+
+        file->raw_size = ddfb_get_u32(&p[pos]);
+        file->compressed = 1;
+        pos += 4;
+        size -= 4;
+    }
+    else
+    {
+        file->raw_size = size;
+    }
+
+    file->data = &p[pos];
+    file->size = size;
+
+    return 1;
+}
+
+static int ddfb_is_path(const DDFB_File *file, const char *path, unsigned path_len)
+{
+    unsigned i;
+
+    if (file->path_len != path_len)
+        return 0;
+
+    for (i = 0; i < path_len; i++)
+    {
+        if (file->path[i] != path[i])
+            return 0;
+    }
+
+    return 1;
+}
+
+int DDFB_FindFile(const DDFB_Bundle *bundle, const char *path, unsigned path_len, DDFB_File *file)
+{
+    unsigned long i;
+    unsigned long lo;
+    unsigned long hi;
+    unsigned long hash;
+    unsigned long count;
+    unsigned long ddfb_end;
+    const unsigned char *e;
+    const unsigned char *index;
+    DDFB_Iter it;
+    DDFB_Chunk chunk;
+
+    /* INDX is the first chunk after DESC */
+    DDFB_IterInit(&it, bundle);
+    if (DDFB_IterNext(&it, &chunk) && ddfb_is_tag(chunk.tag, "DESC") &&
+        DDFB_IterNext(&it, &chunk) && ddfb_is_tag(chunk.tag, "INDX") && chunk.size >= 4)
+    {
+        count = ddfb_get_u32(chunk.data);
+
+        if (count <= (chunk.size - 4) / DDFB_INDEX_ENTRY_SIZE)
+        {
+            index = chunk.data + 4;
+            hash = DDFB_PathHash(path, path_len);
+            ddfb_end = bundle->ddfb_offset + 8 + bundle->ddfb_size;
+
+            /* first entry with 'hash' */
+            lo = 0;
+            hi = count;
+            while (lo < hi)
+            {
+                i = lo + (hi - lo) / 2;
+                if (ddfb_get_u32(&index[i * DDFB_INDEX_ENTRY_SIZE]) < hash)
+                    lo = i + 1;
+                else
+                    hi = i;
+            }
+
+            for (i = lo; i < count; i++)
+            {
+                e = &index[i * DDFB_INDEX_ENTRY_SIZE];
+                if (ddfb_get_u32(&e[0]) != hash)
+                    break;
+
+                /* the entry may point anywhere, check it's a chunk in DDFB */
+                if (ddfb_get_u32(&e[8]) < bundle->ddfb_offset + 8 ||
+                    !ddfb_get_chunk(bundle->data, ddfb_get_u32(&e[8]), ddfb_end, &chunk) ||
+                    !ddfb_is_tag(chunk.tag, (const char*)&e[4]))
+                    continue;
+
+                if (DDFB_ParseFile(&chunk, file) && ddfb_is_path(file, path, path_len))
+                    return 1;
+            }
+
+            return 0;
+        }
+    }
+
+    /* no index, search all chunks */
+    DDFB_IterInit(&it, bundle);
+
+    while (DDFB_IterNext(&it, &chunk))
+    {
+        if (DDFB_ParseFile(&chunk, file) && ddfb_is_path(file, path, path_len))
+            return 1;
+    }
+
+    return 0;
+}
+
+long DDFB_ReadFile(const DDFB_File *file, const void *dict, unsigned long dict_size,
+                   void *dst, unsigned long dst_size)
+{
+    int n;
+
+    if (file->raw_size > dst_size || file->raw_size > 0x7FFFFFFF)
+        return -1;
+
+    if (!file->compressed)
+    {
+        if (file->size)
+            U_memcpy(dst, file->data, file->size);
+        return (long)file->size;
+    }
+
+    if (file->dict_id == 0)
+    {
+        dict = NULL;
+        dict_size = 0;
+    }
+    else if (!dict || dict_size == 0)
+    {
+        return -1;
+    }
+
+    n = U_lz4_decompress_dict(dict, (unsigned)dict_size, file->data, (unsigned)file->size,
+                              dst, (unsigned)file->raw_size);
+
+    if (n < 0 || (unsigned long)n != file->raw_size)
+        return -1;
+
+    return n;
+}
+
+int DDFB_NextSignature(const DDFB_Chunk *sign, unsigned long *pos, DDFB_Signature *sig)
+{
+    unsigned long p;
+    const unsigned char *data;
+
+    p = *pos;
+    data = sign->data;
+
+    if (p > sign->size || sign->size - p < 2)
+        return 0;
+
+    sig->pubkey_len = ddfb_get_u16(&data[p]);
+    sig->pubkey = &data[p + 2];
+    p += 2;
+
+    if (sign->size - p < sig->pubkey_len + 2UL)
+        return 0;
+
+    p += sig->pubkey_len;
+    sig->signature_len = ddfb_get_u16(&data[p]);
+    sig->signature = &data[p + 2];
+    p += 2;
+
+    if (sign->size - p < sig->signature_len)
+        return 0;
+
+    *pos = p + sig->signature_len;
+    return 1;
+}
+
+static unsigned long ddfb_fnv1a(unsigned long h, const char *str, unsigned long len)
+{
+    unsigned long i;
+
+    for (i = 0; i < len; i++)
+    {
+        h ^= (unsigned char)str[i];
+        h = (h * 16777619UL) & 0xFFFFFFFFUL;
+    }
+
+    return h;
+}
+
+unsigned long DDFB_PathHash(const char *path, unsigned path_len)
+{
+    return ddfb_fnv1a(2166136261UL, path, path_len);
+}
+
+unsigned long DDFB_DeviceHash(const char *mfname, const char *modelid)
+{
+    unsigned long h;
+    unsigned long len;
+
+    for (len = 0; mfname[len]; len++)
+        ;
+    h = ddfb_fnv1a(2166136261UL, mfname, len + 1); /* including '\0' */
+
+    for (len = 0; modelid[len]; len++)
+        ;
+    return ddfb_fnv1a(h, modelid, len);
+}
+
+/* The last byte of STRS is checked to be '\0' in DDFB_CatalogOpen(). */
+static const char *ddfb_catalog_string(const DDFB_Catalog *cat, unsigned long offset)
+{
+    if (offset >= cat->strings_size)
+        return 0;
+
+    return &cat->strings[offset];
+}
+
+static int ddfb_str_equal(const char *a, const char *b)
+{
+    for (; *a && *a == *b; a++, b++)
+        ;
+
+    return *a == *b;
+}
+
+int DDFB_CatalogOpen(DDFB_Catalog *cat, const void *data, unsigned long size)
+{
+    unsigned long pos;
+    unsigned long end;
+    const unsigned char *p;
+    DDFB_Chunk chunk;
+    DDFB_Chunk head;
+
+    p = data;
+    head.data = 0;
+    cat->slots = 0;
+    cat->entries = 0;
+    cat->bundles = 0;
+    cat->strings = 0;
+    cat->slot_count = 0;
+    cat->entry_count = 0;
+    cat->bundle_count = 0;
+    cat->strings_size = 0;
+
+    if (!p || !ddfb_get_chunk(p, 0, size, &chunk) || !ddfb_is_tag(chunk.tag, "RIFF"))
+        return 0;
+
+    end = 8 + chunk.size;
+
+    for (pos = 8; ddfb_get_chunk(p, pos, end, &chunk); pos += 8 + chunk.size)
+    {
+        if (ddfb_is_tag(chunk.tag, "CATH") && chunk.size >= 16)
+        {
+            head = chunk;
+        }
+        else if (ddfb_is_tag(chunk.tag, "SLOT"))
+        {
+            cat->slots = chunk.data;
+            cat->slot_count = chunk.size / 4;
+        }
+        else if (ddfb_is_tag(chunk.tag, "ENTR"))
+        {
+            cat->entries = chunk.data;
+            cat->entry_count = chunk.size / DDFB_CATALOG_ENTRY_SIZE;
+        }
+        else if (ddfb_is_tag(chunk.tag, "BNDL"))
+        {
+            cat->bundles = chunk.data;
+            cat->bundle_count = chunk.size / DDFB_CATALOG_BUNDLE_SIZE;
+        }
+        else if (ddfb_is_tag(chunk.tag, "STRS"))
+        {
+            cat->strings = (const char*)chunk.data;
+            cat->strings_size = chunk.size;
+        }
+    }
+
+    if (!head.data || ddfb_get_u32(&head.data[0]) != DDFB_CATALOG_VERSION)
+        return 0;
+
+    /* the counts of the header must match the tables */
+    if (ddfb_get_u32(&head.data[4]) != cat->slot_count || cat->slot_count == 0 ||
+        (cat->slot_count & (cat->slot_count - 1)) != 0 ||
+        ddfb_get_u32(&head.data[8]) != cat->entry_count ||
+        ddfb_get_u32(&head.data[12]) != cat->bundle_count)
+        return 0;
+
+    if (cat->strings_size == 0 || cat->strings[cat->strings_size - 1] != '\0')
+        return 0;
+
+    return 1;
+}
+
+int DDFB_CatalogFind(const DDFB_Catalog *cat, const char *mfname, const char *modelid,
+                     unsigned long *pos, DDFB_CatalogMatch *match)
+{
+    unsigned long i;
+    unsigned long h;
+    unsigned long slot;
+    unsigned long entry;
+    unsigned long bundle;
+    const unsigned char *e;
+    const unsigned char *b;
+
+    if (cat->slot_count == 0)
+        return 0;
+
+    h = DDFB_DeviceHash(mfname, modelid);
+
+    /* linear probing, '*pos' is the number of probed slots */
+    for (i = *pos; i < cat->slot_count; i++)
+    {
+        slot = (h + i) & (cat->slot_count - 1);
+        entry = ddfb_get_u32(&cat->slots[slot * 4]);
+        if (entry == 0)
+            break; /* empty slot */
+
+        entry--;
+        if (entry >= cat->entry_count)
+            break;
+
+        e = &cat->entries[entry * DDFB_CATALOG_ENTRY_SIZE];
+        if (ddfb_get_u32(&e[0]) != h)
+            continue;
+
+        bundle = ddfb_get_u32(&e[4]);
+        if (bundle >= cat->bundle_count)
+            continue;
+
+        match->mfname = ddfb_catalog_string(cat, ddfb_get_u32(&e[8]));
+        match->modelid = ddfb_catalog_string(cat, ddfb_get_u32(&e[12]));
+        if (!match->mfname || !match->modelid ||
+            !ddfb_str_equal(match->mfname, mfname) || !ddfb_str_equal(match->modelid, modelid))
+            continue;
+
+        b = &cat->bundles[bundle * DDFB_CATALOG_BUNDLE_SIZE];
+        match->path = ddfb_catalog_string(cat, ddfb_get_u32(&b[0]));
+        match->version = ddfb_catalog_string(cat, ddfb_get_u32(&b[4]));
+        match->desc_offset = ddfb_get_u32(&b[8]);
+        match->desc_size = ddfb_get_u32(&b[12]);
+        match->bundle = bundle;
+        if (!match->path || !match->version)
+            continue;
+
+        *pos = i + 1;
+        return 1;
+    }
+
+    *pos = cat->slot_count;
+    return 0;
+}
+
+int DDFB_PackOpen(DDFB_Pack *pack, const void *data, unsigned long size)
+{
+    unsigned long pos;
+    DDFB_Chunk chunk;
+
+    pack->data = data;
+    pack->size = 0;
+    pack->offsets = 0;
+    pack->hashes = 0;
+
+    if (!DDFB_CatalogOpen(&pack->catalog, data, size))
+        return 0;
+
+    ddfb_get_chunk(pack->data, 0, size, &chunk);
+    pack->size = 8 + chunk.size;
+
+    for (pos = 8; ddfb_get_chunk(pack->data, pos, pack->size, &chunk); pos += 8 + chunk.size)
+    {
+        if (ddfb_is_tag(chunk.tag, "BOFS") &&
+            chunk.size == pack->catalog.bundle_count * DDFB_PACK_OFFSET_SIZE)
+            pack->offsets = chunk.data;
+        else if (ddfb_is_tag(chunk.tag, "HASH") &&
+                 chunk.size == pack->catalog.bundle_count * DDFB_PACK_HASH_SIZE)
+            pack->hashes = chunk.data;
+    }
+
+    if (!pack->offsets || !pack->hashes)
+    {
+        pack->size = 0;
+        return 0;
+    }
+
+    return 1;
+}
+
+int DDFB_PackBundle(const DDFB_Pack *pack, unsigned long index, DDFB_Bundle *bundle)
+{
+    unsigned long offset;
+    unsigned long size;
+
+    if (index >= pack->catalog.bundle_count)
+        return 0;
+
+    offset = ddfb_get_u32(&pack->offsets[index * DDFB_PACK_OFFSET_SIZE]);
+    size = ddfb_get_u32(&pack->offsets[index * DDFB_PACK_OFFSET_SIZE + 4]);
+
+    if (offset > pack->size || size > pack->size - offset)
+        return 0;
+
+    return DDFB_Open(bundle, &pack->data[offset], size);
+}
+
+static int ddfb_compare_hash(const unsigned char *a, const unsigned char *b)
+{
+    unsigned i;
+
+    for (i = 0; i < 32; i++)
+    {
+        if (a[i] != b[i])
+            return a[i] < b[i] ? -1 : 1;
+    }
+
+    return 0;
+}
+
+long DDFB_PackFindHash(const DDFB_Pack *pack, const unsigned char *sha256)
+{
+    int cmp;
+    unsigned long lo;
+    unsigned long hi;
+    unsigned long i;
+    const unsigned char *e;
+
+    /* HASH entries are sorted by hash */
+    lo = 0;
+    hi = pack->catalog.bundle_count;
+    while (lo < hi)
+    {
+        i = lo + (hi - lo) / 2;
+        e = &pack->hashes[i * DDFB_PACK_HASH_SIZE];
+        cmp = ddfb_compare_hash(e, sha256);
+        if (cmp == 0)
+        {
+            i = ddfb_get_u32(&e[32]);
+            return i < pack->catalog.bundle_count ? (long)i : -1;
+        }
+
+        if (cmp < 0)
+            lo = i + 1;
+        else
+            hi = i;
+    }
+
+    return -1;
+}
@@ -0,0 +1,211 @@
+#ifndef DDFB_READER_H
+#define DDFB_READER_H
+
+/* Read-only access to DDF bundles.
+
+   The reader works on a bundle in memory, e.g. a mapped file. It doesn't
+   allocate, copy or modify anything: chunks, paths and file contents are
+   returned as pointer + length views into the bundle data, which must stay
+   valid while they are used. All sizes and offsets are checked against the
+   bundle size, the reader can be used on untrusted input.
+
+   Bundle layout:
+
+     RIFF
+       DDFB
+         DESC  descriptor JSON
+         INDX  optional index, see DDFB_FindFile()
+         DDFC  DDF JSON (DDFZ, DDFD compressed)
+         EXTF  files (EXTZ, EXTD compressed)
+         ...
+       SIGN    optional signatures over the DDFB chunk
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct DDFB_Bundle
+{
+    const unsigned char *data;
+    unsigned long size;         /* end of the RIFF chunk */
+    unsigned long ddfb_offset;  /* file offset of the DDFB chunk header */
+    unsigned long ddfb_size;    /* DDFB chunk data size */
+} DDFB_Bundle;
+
+typedef struct DDFB_Chunk
+{
+    const unsigned char *tag;   /* FourCC, 4 bytes not '\0' terminated */
+    const unsigned char *data;
+    unsigned long size;
+    unsigned long offset;       /* file offset of the chunk header */
+} DDFB_Chunk;
+
+/* Iterates the chunks inside DDFB, followed by the chunks after DDFB (SIGN). */
+typedef struct DDFB_Iter
+{
+    const DDFB_Bundle *bundle;
+    unsigned long pos;
+    unsigned long end;
+} DDFB_Iter;
+
+/* Content of a DDFC, EXTF chunk or one of the compressed variants. */
+typedef struct DDFB_File
+{
+    DDFB_Chunk chunk;
+    const unsigned char *type;  /* FourCC file type "SCJS", "JSON", "DDFC" for the DDF */
+    const char *path;           /* not '\0' terminated, empty for the DDF */
+    unsigned path_len;
+    const char *mtime;          /* ISO 8601, not '\0' terminated, empty for the DDF */
+    unsigned mtime_len;
+    const unsigned char *data;  /* file data, LZ4 block if compressed */
+    unsigned long size;
+    unsigned long raw_size;     /* uncompressed size */
+    unsigned long dict_id;      /* dictionary id of DDFD, EXTD, else 0 */
+    int compressed;
+} DDFB_File;
+
+/* One entry of a SIGN chunk. */
+typedef struct DDFB_Signature
+{
+    const unsigned char *pubkey;    /* compressed public key */
+    unsigned pubkey_len;
+    const unsigned char *signature; /* signature over the DDFB chunk */
+    unsigned signature_len;
+} DDFB_Signature;
+
+/** Opens a bundle from memory.
+ *
+ * \return 1 if data is a RIFF file with a DDFB chunk, 0 otherwise.
+ */
+int DDFB_Open(DDFB_Bundle *bundle, const void *data, unsigned long size);
+
+/** Returns the signed range: DDFB chunk header and data. */
+const unsigned char *DDFB_SignedData(const DDFB_Bundle *bundle, unsigned long *size);
+
+void DDFB_IterInit(DDFB_Iter *it, const DDFB_Bundle *bundle);
+
+/** Gets the next chunk.
+ *
+ * \return 1 on success, 0 at the end or if a chunk exceeds its parent.
+ */
+int DDFB_IterNext(DDFB_Iter *it, DDFB_Chunk *chunk);
+
+/** Checks the chunk tag, 'tag' is a 4 character string like "EXTF". */
+int DDFB_IsTag(const DDFB_Chunk *chunk, const char *tag);
+
+/** Finds the first chunk with 'tag'. */
+int DDFB_FindChunk(const DDFB_Bundle *bundle, const char *tag, DDFB_Chunk *chunk);
+
+/** Parses a DDFC, DDFZ, DDFD, EXTF, EXTZ or EXTD chunk.
+ *
+ * \return 1 on success, 0 for other or malformed chunks.
+ */
+int DDFB_ParseFile(const DDFB_Chunk *chunk, DDFB_File *file);
+
+/** Finds a file by its path, an empty path gets the DDF.
+ *
+ * Uses the INDX chunk if present, otherwise all chunks are searched.
+ */
+int DDFB_FindFile(const DDFB_Bundle *bundle, const char *path, unsigned path_len, DDFB_File *file);
+
+/** Copies or decompresses the file data into dst.
+ *
+ * For DDFD, EXTD chunks 'dict' must be the dictionary with file->dict_id.
+ *
+ * \return the file size, or -1 on error or if dst_size is too small.
+ */
+long DDFB_ReadFile(const DDFB_File *file, const void *dict, unsigned long dict_size,
+                   void *dst, unsigned long dst_size);
+
+/** Iterates the signatures of a SIGN chunk, '*pos' starts at 0.
+ *
+ * \return 1 on success, 0 at the end or on malformed entries.
+ */
+int DDFB_NextSignature(const DDFB_Chunk *sign, unsigned long *pos, DDFB_Signature *sig);
+
+/** 32-bit FNV-1a hash of a file path as used in the INDX chunk. */
+unsigned long DDFB_PathHash(const char *path, unsigned path_len);
+
+/* Device catalog created by 'ddfb catalog', see README.md.
+
+   Maps (manufacturername, modelid) pairs to the bundles of a directory,
+   the catalog file can be used directly from a mapped file.
+*/
+typedef struct DDFB_Catalog
+{
+    const unsigned char *slots;
+    unsigned long slot_count;
+    const unsigned char *entries;
+    unsigned long entry_count;
+    const unsigned char *bundles;
+    unsigned long bundle_count;
+    const char *strings;
+    unsigned long strings_size;
+} DDFB_Catalog;
+
+typedef struct DDFB_CatalogMatch
+{
+    const char *path;           /* bundle file, relative to the catalog directory */
+    const char *version;        /* DESC "version" */
+    const char *mfname;
+    const char *modelid;
+    unsigned long desc_offset;  /* file offset of the DESC chunk data in the bundle */
+    unsigned long desc_size;
+    unsigned long bundle;       /* bundle index, see DDFB_PackBundle() */
+} DDFB_CatalogMatch;
+
+/** Opens a catalog from memory.
+ *
+ * \return 1 if data is a valid catalog, 0 otherwise.
+ */
+int DDFB_CatalogOpen(DDFB_Catalog *cat, const void *data, unsigned long size);
+
+/** Finds the bundles of a device, '*pos' starts at 0.
+ *
+ * Multiple bundles can have the same device identifiers, call again
+ * for the next match.
+ *
+ * \return 1 on success, 0 if there are no (more) matches.
+ */
+int DDFB_CatalogFind(const DDFB_Catalog *cat, const char *mfname, const char *modelid,
+                     unsigned long *pos, DDFB_CatalogMatch *match);
+
+/** 32-bit FNV-1a hash of mfname, '\0' and modelid as used in catalogs. */
+unsigned long DDFB_DeviceHash(const char *mfname, const char *modelid);
+
+/* Bundle pack created by 'ddfb pack', see README.md.
+
+   A pack is a catalog followed by the bundle files, which are stored
+   unmodified so their signatures stay valid. The DDFB_Catalog functions
+   work on packs as well.
+*/
+typedef struct DDFB_Pack
+{
+    DDFB_Catalog catalog;
+    const unsigned char *data;
+    unsigned long size;
+    const unsigned char *offsets;   /* BOFS */
+    const unsigned char *hashes;    /* HASH */
+} DDFB_Pack;
+
+/** Opens a pack from memory.
+ *
+ * \return 1 if data is a valid pack, 0 otherwise.
+ */
+int DDFB_PackOpen(DDFB_Pack *pack, const void *data, unsigned long size);
+
+/** Opens the bundle with 'index' of a pack. */
+int DDFB_PackBundle(const DDFB_Pack *pack, unsigned long index, DDFB_Bundle *bundle);
+
+/** Finds a bundle by the SHA-256 hash over its DDFB chunk (the signed data).
+ *
+ * \return the bundle index, or -1 if not found.
+ */
+long DDFB_PackFindHash(const DDFB_Pack *pack, const unsigned char *sha256);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DDFB_READER_H */
@@ -0,0 +1,16 @@
+/* libddfb: read-only access to DDF bundles, see ddfb_reader.h
+ *
+ * Unity build of the library, the ddfb tool includes ddfb_reader.c directly.
+ * The library doesn't depend on utils.c, the few helpers map to libc.
+ */
+#include <string.h>
+
+#include "utils/u_types.h"
+#include "utils/u_lz4.h"
+#include "ddfb_reader.h"
+
+#define U_memcpy(dst, src, size) memcpy(dst, src, size)
+#define U_bzero(dst, size) memset(dst, 0, size)
+
+#include "utils/u_lz4.c"
+#include "ddfb_reader.c"
@@ -0,0 +1,47 @@
+/* ddfb_builder: creates DDF bundles from memory, see ddfb_builder.h
+ *
+ * Unity build of the library, the ddfb tool includes ddfb_builder.c directly.
+ * Only the DDFB_ builder API is visible, the utils are compiled with hidden
+ * visibility. The reader and LZ4 code come from libddfb.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <limits.h>
+
+#ifdef PL_POSIX
+  #include <unistd.h>
+#endif
+
+#include <time.h>
+
+#include "utils/u_types.h"
+#include "utils/u_assert.h"
+#include "utils/u_sstream.h"
+#include "utils/u_bstream.h"
+#include "utils/u_math.h"
+#include "utils/u_memory.h"
+#include "utils/u_arena.h"
+#include "utils/u_scratch.h"
+#include "utils/u_hashmap.h"
+#include "utils/u_lz4.h"
+#include "utils/u_sha256.h"
+#include "utils/utils.h"
+#include "utils/cj.h"
+#include "ddfb_reader.h"
+#include "ddfb_builder.h"
+
+#include "utils/utils.c"
+#include "utils/u_arena.c"
+#include "utils/u_math.c"
+#include "utils/u_memory.c"
+#include "utils/u_scratch.c"
+#include "utils/u_hashmap.c"
+#include "utils/u_sha256.c"
+#include "utils/u_sstream.c"
+#include "utils/u_bstream.c"
+#include "utils/cj.c"
+#include "ddfb_builder.c"
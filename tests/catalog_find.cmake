@@ -0,0 +1,37 @@
+# create-all -> catalog -> find on tests/data, run by ctest:
+#   cmake -DDDFB=<ddfb> -DDATA=<tests/data> -DWORK=<dir> -P catalog_find.cmake
+#
+# The manufacturer names of both DDFs are constants, the catalog must
+# contain the resolved names a gateway looks up.
+
+function(ddfb_run expect_result)
+    execute_process(COMMAND ${DDFB} ${ARGN}
+                    WORKING_DIRECTORY ${WORK}
+                    RESULT_VARIABLE result
+                    OUTPUT_VARIABLE output
+                    ERROR_VARIABLE output)
+    if (NOT result EQUAL expect_result)
+        message(FATAL_ERROR "ddfb ${ARGN}: exit code ${result}, expected ${expect_result}\n${output}")
+    endif()
+    set(output "${output}" PARENT_SCOPE)
+endfunction()
+
+function(ddfb_find manufacturer modelid bundle)
+    ddfb_run(0 find cat.bin "${manufacturer}" "${modelid}")
+    string(FIND "${output}" "${bundle}" pos)
+    if (pos EQUAL -1)
+        message(FATAL_ERROR "find '${manufacturer}' '${modelid}' didn't return ${bundle}\n${output}")
+    endif()
+endfunction()
+
+file(REMOVE_RECURSE ${WORK})
+file(MAKE_DIRECTORY ${WORK})
+
+ddfb_run(0 create-all ${DATA}/devices)
+ddfb_run(0 catalog . cat.bin)
+
+ddfb_find("LUMI" "lumi.weather" "temp.ddf")
+ddfb_find("IKEA of Sweden" "TRADFRI bulb E14 CWS opal 600lm" "bulb.ddf")
+
+# unresolved constants must not end up in the catalog
+ddfb_run(1 find cat.bin "$MF_XIAOMI" "lumi.weather")
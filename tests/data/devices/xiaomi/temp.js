@@ -0,0 +1 @@
+R.item.val = Attr.val / 100;
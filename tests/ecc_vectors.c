@@ -0,0 +1,177 @@
+/* Known answer test of the signature backends in ddfb.c.
+
+   Every backend must derive the public key, compress and decompress it,
+   create the same deterministic signature and verify it, with and
+   without a prepared key, for all vectors of secp256k1_vectors.txt.
+   A modified hash must be rejected. The exit code is 1 on any mismatch.
+
+   Usage: ecc_vectors <secp256k1_vectors.txt>
+
+*/
+
+#define DDFB_NO_MAIN
+#include "../ddfb.c"
+
+#define VEC_MAX_KEY_SIZE 8192
+
+typedef struct EccVector
+{
+    u8 private_key[32];
+    u8 hash[32];
+    u8 public_key[64];
+    u8 signature[64];
+} EccVector;
+
+static u64 vec_key[VEC_MAX_KEY_SIZE / sizeof(u64)]; /* prepared key of a backend */
+
+static int Vec_HexValue(char ch)
+{
+    if (ch >= '0' && ch <= '9') return ch - '0';
+    if (ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+    if (ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
+    return -1;
+}
+
+/* Reads 'size' bytes of hex digits followed by a space or line end. */
+static int Vec_ParseHex(const char **str, const char *end, u8 *out, unsigned size)
+{
+    int hi;
+    int lo;
+    unsigned i;
+    const char *p;
+
+    p = *str;
+    for (i = 0; i < size; i++, p += 2)
+    {
+        if (end - p < 2)
+            return 0;
+        hi = Vec_HexValue(p[0]);
+        lo = Vec_HexValue(p[1]);
+        if (hi < 0 || lo < 0)
+            return 0;
+        out[i] = (u8)(hi << 4 | lo);
+    }
+
+    if (p < end && *p != ' ' && *p != '\n' && *p != '\r')
+        return 0;
+
+    while (p < end && *p == ' ')
+        p++;
+
+    *str = p;
+    return 1;
+}
+
+/* Returns the number of failed checks of one vector. */
+static unsigned Vec_Check(const ECC_Backend *ecc, const EccVector *v)
+{
+    unsigned failed;
+    u8 hash[32];
+    u8 public_key[64];
+    u8 compressed[33];
+    u8 signature[64];
+
+    failed = 0;
+
+    if (ecc->compute_public_key(v->private_key, public_key) != 1 ||
+        U_memcmp(public_key, v->public_key, 64) != 0)
+        failed++;
+
+    ecc->compress(v->public_key, compressed);
+    if (compressed[0] != (2 | (v->public_key[63] & 1)) ||
+        U_memcmp(&compressed[1], v->public_key, 32) != 0)
+        failed++;
+
+    if (ecc->decompress(compressed, public_key) != 1 ||
+        U_memcmp(public_key, v->public_key, 64) != 0)
+        failed++;
+
+    if (ecc->sign(v->private_key, v->hash, signature) != 1 ||
+        U_memcmp(signature, v->signature, 64) != 0)
+        failed++;
+
+    U_memcpy(hash, v->hash, sizeof(hash));
+    hash[31] ^= 1;
+
+    if (ecc->verify(v->public_key, v->hash, v->signature) != 1 ||
+        ecc->verify(v->public_key, hash, v->signature) != 0)
+        failed++;
+
+    if (ecc->key_size > sizeof(vec_key) ||
+        ecc->prepare_key(vec_key, v->public_key) != 1 ||
+        ecc->verify_key(vec_key, v->hash, v->signature) != 1 ||
+        ecc->verify_key(vec_key, hash, v->signature) != 0)
+        failed++;
+
+    return failed;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned i;
+    unsigned line;
+    unsigned count;
+    unsigned failed;
+    unsigned errors;
+    const char *p;
+    const char *end;
+    PL_MappedFile mf;
+    EccVector v;
+
+    if (argc != 2)
+    {
+        U_Printf("Usage: %s <secp256k1_vectors.txt>\n", argv[0]);
+        return 1;
+    }
+
+    if (PL_MapFile(&mf, argv[1]) == 0 || mf.size == 0)
+    {
+        U_Printf("failed to read %s\n", argv[1]);
+        return 1;
+    }
+
+    errors = 0;
+
+    for (i = 0; ecc_backends[i]; i++)
+    {
+        p = (const char*)mf.data;
+        end = p + mf.size;
+        count = 0;
+        failed = 0;
+
+        for (line = 1; p < end; line++)
+        {
+            if (*p != '#' && *p != '\n' && *p != '\r')
+            {
+                if (Vec_ParseHex(&p, end, v.private_key, 32) == 0 ||
+                    Vec_ParseHex(&p, end, v.hash, 32) == 0 ||
+                    Vec_ParseHex(&p, end, v.public_key, 64) == 0 ||
+                    Vec_ParseHex(&p, end, v.signature, 64) == 0)
+                {
+                    U_Printf("%s:%u: invalid vector\n", argv[1], line);
+                    PL_UnmapFile(&mf);
+                    return 1;
+                }
+
+                if (Vec_Check(ecc_backends[i], &v) != 0)
+                {
+                    U_Printf("%s: vector at line %u failed\n", ecc_backends[i]->name, line);
+                    failed++;
+                }
+                count++;
+            }
+
+            while (p < end && *p != '\n')
+                p++;
+            p++;
+        }
+
+        U_Printf("%s: %u of %u vectors passed\n", ecc_backends[i]->name, count - failed, count);
+        if (count == 0)
+            failed++;
+        errors += failed;
+    }
+
+    PL_UnmapFile(&mf);
+    return errors == 0 ? 0 : 1;
+}
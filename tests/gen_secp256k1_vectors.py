@@ -0,0 +1,97 @@
+#!/usr/bin/env python3
+"""Writes tests/secp256k1_vectors.txt, the known answers of ecc_vectors.c.
+
+Plain integer model of secp256k1 and of uECC_sign_deterministic() with
+SHA-256 (micro-ecc v1.1 on a little endian host), independent of the C
+code. Unlike RFC 6979 uECC feeds the unreduced hash into the HMAC, which
+only matters for hashes >= n, and takes k from V in native word order.
+
+    python3 tests/gen_secp256k1_vectors.py > tests/secp256k1_vectors.txt
+"""
+import hashlib
+import hmac
+import random
+
+P = 2**256 - 2**32 - 977
+N = 0xFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFEBAAEDCE6AF48A03BBFD25E8CD0364141
+G = (0x79BE667EF9DCBBAC55A06295CE870B07029BFCDB2DCE28D959F2815B16F81798,
+     0x483ADA7726A3C4655DA4FBFC0E1108A8FD17B448A68554199C47D08FFB10D4B8)
+
+
+def add(a, b):
+    if a is None:
+        return b
+    if b is None:
+        return a
+    if a[0] == b[0]:
+        if (a[1] + b[1]) % P == 0:
+            return None
+        lam = 3 * a[0] * a[0] * pow(2 * a[1], P - 2, P) % P
+    else:
+        lam = (b[1] - a[1]) * pow(b[0] - a[0], P - 2, P) % P
+    x = (lam * lam - a[0] - b[0]) % P
+    return (x, (lam * (a[0] - x) - a[1]) % P)
+
+
+def mul(k, p):
+    r = None
+    while k:
+        if k & 1:
+            r = add(r, p)
+        p = add(p, p)
+        k >>= 1
+    return r
+
+
+def hm(key, msg):
+    return hmac.new(key, msg, hashlib.sha256).digest()
+
+
+def sign(d, h):
+    x = d.to_bytes(32, 'big')
+    K = b'\0' * 32
+    V = b'\1' * 32
+    K = hm(K, V + b'\0' + x + h)
+    V = hm(K, V)
+    K = hm(K, V + b'\1' + x + h)
+    V = hm(K, V)
+    while True:
+        V = hm(K, V)
+        k = int.from_bytes(V, 'little')
+        if 0 < k < N:
+            r = mul(k, G)[0] % N
+            e = int.from_bytes(h, 'big') % N
+            s = pow(k, N - 2, N) * (e + r * d) % N
+            if r and s:
+                return r.to_bytes(32, 'big') + s.to_bytes(32, 'big')
+        K = hm(K, V + b'\0')
+        V = hm(K, V)
+
+
+def h32(v):
+    return v.to_bytes(32, 'big').hex()
+
+
+def main():
+    random.seed(2024)
+    keys = [1, 2, 3, N - 1, N - 2, N // 2, 2**128, 2**255]
+    hashes = [b'\0' * 32, b'\xff' * 32, N.to_bytes(32, 'big'), (N - 1).to_bytes(32, 'big'),
+              (N + 1).to_bytes(32, 'big'), b'\0' * 31 + b'\1']
+
+    vectors = []
+    for d in keys:
+        vectors.append((d, hashes[len(vectors) % len(hashes)]))
+    for h in hashes:
+        vectors.append((1, h))
+    while len(vectors) < 64:
+        vectors.append((random.randrange(1, N), random.randbytes(32)))
+
+    print("# secp256k1 known answers: private key, SHA-256 hash, public key x | y,")
+    print("# signature r | s of uECC_sign_deterministic(), see gen_secp256k1_vectors.py")
+    for d, h in vectors:
+        Q = mul(d, G)
+        print(h32(d), h.hex(), h32(Q[0]) + h32(Q[1]), sign(d, h).hex())
+
+
+if __name__ == '__main__':
+    main()
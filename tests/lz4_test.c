@@ -0,0 +1,247 @@
+/* Tests of the LZ4 block codec in utils/u_lz4.c.
+
+   Round trips with and without dictionary, hand written blocks in the
+   reference block format, and malformed blocks which the decoder must
+   reject without reading or writing out of bounds (run with the address
+   sanitizer in debug builds). The exit code is 1 if any check fails.
+
+   Usage: lz4_test
+
+*/
+#include <stdio.h>
+#include <string.h>
+
+#include "../utils/u_types.h"
+#include "../utils/u_lz4.h"
+
+#define U_memcpy(dst, src, size) memcpy(dst, src, size)
+#define U_bzero(dst, size) memset(dst, 0, size)
+
+#include "../utils/u_lz4.c"
+
+#define LZ4T_MAX_SIZE (96 * 1024)
+
+static unsigned lz4t_failed;
+static u32 lz4t_seed = 1;
+
+static u8 lz4t_src[LZ4T_MAX_SIZE];
+static u8 lz4t_comp[U_LZ4_COMPRESS_BOUND(LZ4T_MAX_SIZE)];
+static u8 lz4t_out[LZ4T_MAX_SIZE];
+static u8 lz4t_block[U_LZ4_COMPRESS_BOUND(LZ4T_MAX_SIZE)];
+
+static void Lz4t_Check(int ok, const char *name)
+{
+    if (!ok)
+    {
+        printf("FAILED: %s\n", name);
+        lz4t_failed++;
+    }
+}
+
+static u32 Lz4t_Rand(void)
+{
+    lz4t_seed = lz4t_seed * 1103515245U + 12345U;
+    return lz4t_seed >> 8;
+}
+
+/* Text like data: words of a small vocabulary with random bytes in between. */
+static void Lz4t_FillText(u8 *buf, unsigned size)
+{
+    static const char *words[] = {
+        "\"attributes\"", "\"cluster\"", "\"endpoint\"", "0x0006", "\"parse\"",
+        "\"read\"", "\"state/on\"", "\"config/battery\"", "\"refresh.interval\""
+    };
+    unsigned i;
+    unsigned n;
+    const char *w;
+
+    for (i = 0; i < size; )
+    {
+        if ((Lz4t_Rand() & 7) == 0)
+        {
+            buf[i++] = (u8)Lz4t_Rand();
+            continue;
+        }
+
+        w = words[Lz4t_Rand() % (sizeof(words) / sizeof(words[0]))];
+        for (n = 0; w[n] && i < size; n++)
+            buf[i++] = (u8)w[n];
+    }
+}
+
+static int Lz4t_RoundTrip(const u8 *src, unsigned size)
+{
+    unsigned n;
+
+    n = U_lz4_compress(src, size, lz4t_comp, U_LZ4_COMPRESS_BOUND(size));
+    if (n == 0 || n > U_LZ4_COMPRESS_BOUND(size))
+        return 0;
+
+    if (U_lz4_decompress(lz4t_comp, n, lz4t_out, size) != (int)size)
+        return 0;
+
+    if (memcmp(lz4t_out, src, size) != 0)
+        return 0;
+
+    /* output buffer one byte too small */
+    if (size > 0 && U_lz4_decompress(lz4t_comp, n, lz4t_out, size - 1) != -1)
+        return 0;
+
+    return 1;
+}
+
+static void Lz4t_TestRoundTrip(void)
+{
+    unsigned i;
+    unsigned j;
+    unsigned size;
+    static const unsigned sizes[] = { 0, 1, 4, 12, 13, 17, 64, 255, 256, 4096, 65535, 65536, LZ4T_MAX_SIZE };
+
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+        size = sizes[i];
+
+        memset(lz4t_src, 'a', size);
+        Lz4t_Check(Lz4t_RoundTrip(lz4t_src, size), "round trip repeated byte");
+
+        Lz4t_FillText(lz4t_src, size);
+        Lz4t_Check(Lz4t_RoundTrip(lz4t_src, size), "round trip text");
+
+        for (j = 0; j < size; j++)
+            lz4t_src[j] = (u8)Lz4t_Rand();
+        Lz4t_Check(Lz4t_RoundTrip(lz4t_src, size), "round trip random bytes");
+    }
+
+    /* incompressible data doesn't fit a buffer of its own size */
+    Lz4t_Check(U_lz4_compress(lz4t_src, 4096, lz4t_comp, 4096) == 0, "compress into small buffer");
+}
+
+static void Lz4t_TestDictionary(void)
+{
+    unsigned n;
+    unsigned n_plain;
+    unsigned dict_size;
+    unsigned size;
+
+    /* dictionary in front of the input, as expected by the compressor */
+    dict_size = 70000; /* more than the 64K window */
+    size = 8192;
+    Lz4t_FillText(lz4t_src, dict_size);
+    memcpy(&lz4t_src[dict_size], &lz4t_src[dict_size - 20000], size);
+
+    n = U_lz4_compress_prefix(lz4t_src, dict_size, size, lz4t_comp, U_LZ4_COMPRESS_BOUND(size));
+    Lz4t_Check(n != 0, "compress with dictionary");
+
+    Lz4t_Check(U_lz4_decompress_dict(lz4t_src, dict_size, lz4t_comp, n, lz4t_out, size) == (int)size &&
+               memcmp(lz4t_out, &lz4t_src[dict_size], size) == 0, "round trip with dictionary");
+
+    /* the input is a copy of dictionary data */
+    n_plain = U_lz4_compress(&lz4t_src[dict_size], size, lz4t_out, U_LZ4_COMPRESS_BOUND(size));
+    Lz4t_Check(n < n_plain / 4, "dictionary improves compression");
+
+    /* matches need the dictionary */
+    Lz4t_Check(U_lz4_decompress(lz4t_comp, n, lz4t_out, size) == -1, "decompress without dictionary");
+}
+
+/* Hand written blocks in the LZ4 block format. */
+static void Lz4t_TestReferenceBlocks(void)
+{
+    /* 1 literal, match offset 1 length 4 + 15 + 7, 5 final literals */
+    static const u8 run32[] = { 0x1F, 'a', 0x01, 0x00, 0x07, 0x50, 'a', 'a', 'a', 'a', 'a' };
+    /* "abcd", match offset 4 length 8, final literals "abcde" */
+    static const u8 repeat[] = { 0x44, 'a', 'b', 'c', 'd', 0x04, 0x00, 0x50, 'a', 'b', 'c', 'd', 'e' };
+    /* empty input is a single token */
+    static const u8 empty[] = { 0x00 };
+    /* match offset 3 into the dictionary "xyz", length 6 continues into dst */
+    static const u8 dict_block[] = { 0x02, 0x03, 0x00, 0x50, '1', '2', '3', '4', '5' };
+    u8 out[64];
+
+    Lz4t_Check(U_lz4_decompress(run32, sizeof(run32), out, sizeof(out)) == 32 &&
+               memcmp(out, "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa", 32) == 0, "reference block run");
+
+    Lz4t_Check(U_lz4_decompress(repeat, sizeof(repeat), out, sizeof(out)) == 17 &&
+               memcmp(out, "abcdabcdabcdabcde", 17) == 0, "reference block repeat");
+
+    Lz4t_Check(U_lz4_decompress(empty, sizeof(empty), out, sizeof(out)) == 0, "reference block empty");
+
+    Lz4t_Check(U_lz4_decompress_dict("xyz", 3, dict_block, sizeof(dict_block), out, sizeof(out)) == 11 &&
+               memcmp(out, "xyzxyz12345", 11) == 0, "reference block dictionary");
+}
+
+static void Lz4t_TestMalformed(void)
+{
+    u8 out[64];
+    u8 block[300];
+    unsigned i;
+
+    static const u8 truncated_literals[] = { 0x50, 'h', 'e' };
+    static const u8 truncated_literal_length[] = { 0xF0, 0xFF };
+    static const u8 missing_offset[] = { 0x10, 'a', 0x01 };
+    static const u8 zero_offset[] = { 0x10, 'a', 0x00, 0x00, 0x50, 'a', 'a', 'a', 'a', 'a' };
+    static const u8 offset_beyond_output[] = { 0x10, 'a', 0x02, 0x00, 0x50, 'a', 'a', 'a', 'a', 'a' };
+    static const u8 offset_beyond_dict[] = { 0x10, 'a', 0x05, 0x00, 0x50, 'a', 'a', 'a', 'a', 'a' };
+    static const u8 truncated_match_length[] = { 0x1F, 'a', 0x01, 0x00, 0xFF };
+    static const u8 overlong_match[] = { 0x1F, 'a', 0x01, 0x00, 0x40, 0x50, 'a', 'a', 'a', 'a', 'a' };
+    static const u8 run32[] = { 0x1F, 'a', 0x01, 0x00, 0x07, 0x50, 'a', 'a', 'a', 'a', 'a' };
+
+    Lz4t_Check(U_lz4_decompress(run32, 0, out, sizeof(out)) == -1, "empty input");
+    Lz4t_Check(U_lz4_decompress(truncated_literals, sizeof(truncated_literals), out, sizeof(out)) == -1, "truncated literals");
+    Lz4t_Check(U_lz4_decompress(truncated_literal_length, sizeof(truncated_literal_length), out, sizeof(out)) == -1, "truncated literal length");
+    Lz4t_Check(U_lz4_decompress(missing_offset, sizeof(missing_offset), out, sizeof(out)) == -1, "missing offset");
+    Lz4t_Check(U_lz4_decompress(zero_offset, sizeof(zero_offset), out, sizeof(out)) == -1, "zero offset");
+    Lz4t_Check(U_lz4_decompress(offset_beyond_output, sizeof(offset_beyond_output), out, sizeof(out)) == -1, "offset beyond output");
+    Lz4t_Check(U_lz4_decompress_dict("xyz", 3, offset_beyond_dict, sizeof(offset_beyond_dict), out, sizeof(out)) == -1, "offset beyond dictionary");
+    Lz4t_Check(U_lz4_decompress_dict("xyzw", 4, offset_beyond_dict, sizeof(offset_beyond_dict), out, sizeof(out)) == 10, "offset at dictionary start");
+    Lz4t_Check(U_lz4_decompress(truncated_match_length, sizeof(truncated_match_length), out, sizeof(out)) == -1, "truncated match length");
+    Lz4t_Check(U_lz4_decompress(overlong_match, sizeof(overlong_match), out, sizeof(out)) == -1, "match longer than output");
+
+    /* literal length of 15 + 298 * 255 which exceeds the input */
+    block[0] = 0xF0;
+    for (i = 1; i < sizeof(block) - 1; i++)
+        block[i] = 0xFF;
+    block[i] = 0x00;
+    Lz4t_Check(U_lz4_decompress(block, sizeof(block), out, sizeof(out)) == -1, "overlong literal length");
+}
+
+/* Corrupted blocks must fail or stay within the output buffer. */
+static void Lz4t_TestCorrupted(void)
+{
+    unsigned i;
+    unsigned n;
+    unsigned size;
+    unsigned pos;
+    int ret;
+
+    size = 2048;
+    Lz4t_FillText(lz4t_src, size);
+    n = U_lz4_compress(lz4t_src, size, lz4t_block, U_LZ4_COMPRESS_BOUND(size));
+
+    for (i = 0; i < 20000; i++)
+    {
+        memcpy(lz4t_comp, lz4t_block, n);
+        pos = Lz4t_Rand() % n;
+        lz4t_comp[pos] ^= (u8)(1 + Lz4t_Rand() % 255);
+
+        /* every second block is also truncated */
+        ret = U_lz4_decompress(lz4t_comp, (i & 1) ? n : 1 + Lz4t_Rand() % n, lz4t_out, size);
+        Lz4t_Check(ret >= -1 && ret <= (int)size, "corrupted block");
+    }
+}
+
+int main(void)
+{
+    Lz4t_TestRoundTrip();
+    Lz4t_TestDictionary();
+    Lz4t_TestReferenceBlocks();
+    Lz4t_TestMalformed();
+    Lz4t_TestCorrupted();
+
+    if (lz4t_failed != 0)
+    {
+        printf("%u checks failed\n", lz4t_failed);
+        return 1;
+    }
+
+    printf("all checks passed\n");
+    return 0;
+}
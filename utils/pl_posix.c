@@ -1,6 +1,11 @@
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
 #include <time.h>
 #include <unistd.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
 
 static char _pl_config_dir_path[256];
 
@@ -141,6 +146,204 @@ int PL_WriteFile(const char *path, const void *buf, unsigned bufsize)
 }
 #endif
 
+#ifndef _PL_FILE_
+#define _PL_FILE_
+int PL_FileOpen(PL_File *file, const char *path, unsigned mode)
+{
+    U_ASSERT(file);
+    U_ASSERT(path);
+
+    if (mode == PL_FILE_WRITE)
+        file->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    else if (mode == PL_FILE_UPDATE)
+        file->fd = open(path, O_WRONLY);
+    else
+        file->fd = open(path, O_RDONLY);
+
+    return file->fd == -1 ? 0 : 1;
+}
+
+int PL_FileWrite(PL_File *file, const void *buf, unsigned long size)
+{
+    ssize_t n;
+    const char *p;
+
+    U_ASSERT(file->fd != -1);
+
+    for (p = buf; size; )
+    {
+        n = write(file->fd, p, size);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return 0;
+
+        p += n;
+        size -= (unsigned long)n;
+    }
+
+    return 1;
+}
+
+int PL_FileWriteAt(PL_File *file, unsigned long offset, const void *buf, unsigned long size)
+{
+    ssize_t n;
+    const char *p;
+
+    U_ASSERT(file->fd != -1);
+
+    for (p = buf; size; )
+    {
+        n = pwrite(file->fd, p, size, (off_t)offset);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return 0;
+
+        p += n;
+        offset += (unsigned long)n;
+        size -= (unsigned long)n;
+    }
+
+    return 1;
+}
+
+int PL_FileWriteV(PL_File *file, const PL_IoVec *iov, unsigned count)
+{
+    unsigned i;
+    unsigned n;
+    ssize_t ret;
+    struct iovec v[64];
+
+    U_ASSERT(file->fd != -1);
+
+    while (count)
+    {
+        n = count < U_ARRAY_SIZE(v) ? count : U_ARRAY_SIZE(v);
+        for (i = 0; i < n; i++)
+        {
+            v[i].iov_base = (void*)iov[i].data;
+            v[i].iov_len = iov[i].size;
+        }
+
+        for (i = 0; i < n;)
+        {
+            ret = writev(file->fd, &v[i], (int)(n - i));
+            if (ret < 0 && errno == EINTR)
+                continue;
+            if (ret <= 0)
+                return 0;
+
+            /* skip written vectors, partial writes continue in v[i] */
+            for (; i < n && (size_t)ret >= v[i].iov_len; i++)
+                ret -= (ssize_t)v[i].iov_len;
+
+            if (i < n)
+            {
+                v[i].iov_base = (char*)v[i].iov_base + ret;
+                v[i].iov_len -= (size_t)ret;
+            }
+        }
+
+        iov += n;
+        count -= n;
+    }
+
+    return 1;
+}
+
+void PL_FileClose(PL_File *file)
+{
+    if (file->fd != -1)
+        close(file->fd);
+    file->fd = -1;
+}
+#endif
+
+#ifndef _PL_MAP_FILE_
+#define _PL_MAP_FILE_
+int PL_MapFile(PL_MappedFile *mf, const char *path)
+{
+    int fd;
+    void *p;
+    ssize_t n;
+    unsigned long pos;
+    struct stat st;
+
+    U_ASSERT(mf);
+    U_ASSERT(path);
+    U_bzero(mf, sizeof(*mf));
+
+    fd = open(path, O_RDONLY);
+    if (fd == -1)
+        return 0;
+
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        close(fd);
+        return 0;
+    }
+
+    mf->size = (unsigned long)st.st_size;
+    if (mf->size == 0)
+    {
+        /* mmap() doesn't support empty mappings */
+        mf->data = (const unsigned char*)"";
+        close(fd);
+        return 1;
+    }
+
+    p = mmap(NULL, mf->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p != MAP_FAILED)
+    {
+        mf->data = p;
+        mf->mapped = 1;
+        close(fd);
+        return 1;
+    }
+
+    /* fallback for file systems without mmap() support */
+    p = malloc(mf->size);
+    if (!p)
+    {
+        close(fd);
+        return 0;
+    }
+
+    for (pos = 0; pos < mf->size; pos += (unsigned long)n)
+    {
+        n = read(fd, (char*)p + pos, mf->size - pos);
+        if (n < 0 && errno == EINTR)
+        {
+            n = 0;
+            continue;
+        }
+
+        if (n <= 0)
+        {
+            free(p);
+            close(fd);
+            U_bzero(mf, sizeof(*mf));
+            return 0;
+        }
+    }
+
+    close(fd);
+    mf->data = p;
+    return 1;
+}
+
+void PL_UnmapFile(PL_MappedFile *mf)
+{
+    if (mf->mapped)
+        munmap((void*)mf->data, mf->size);
+    else if (mf->size)
+        free((void*)mf->data);
+
+    U_bzero(mf, sizeof(*mf));
+}
+#endif
+
 #ifndef _PL_FILE_EXISTS
 #define _PL_FILE_EXISTS
 int PL_FileExists(const char *path)
@@ -232,6 +435,110 @@ int PL_StatFile(const char *path, PL_Stat *st)
     return 0;
 }
 
+#ifndef _PL_LIST_DIRECTORY
+#define _PL_LIST_DIRECTORY
+/* Returns 1 when 'path' is a directory and was listed, otherwise 0. */
+int PL_ListDirectory(const char *path, PL_DirCallback cb, void *user)
+{
+    DIR *dir;
+    struct dirent *ent;
+    struct stat sb;
+    char entpath[PATH_MAX];
+    U_SStream ss;
+    int is_dir;
+
+    U_ASSERT(path);
+    U_ASSERT(cb);
+
+    dir = opendir(path);
+    if (!dir)
+        return 0;
+
+    while ((ent = readdir(dir)) != NULL)
+    {
+        if (ent->d_name[0] == '.' && (ent->d_name[1] == '\0' ||
+            (ent->d_name[1] == '.' && ent->d_name[2] == '\0')))
+            continue;
+
+        is_dir = 0;
+#ifdef DT_DIR
+        if (ent->d_type == DT_DIR)
+            is_dir = 1;
+        else if (ent->d_type == DT_UNKNOWN || ent->d_type == DT_LNK)
+#endif
+        {
+            U_sstream_init(&ss, &entpath[0], sizeof(entpath));
+            U_sstream_put_str(&ss, path);
+            U_sstream_put_str(&ss, "/");
+            U_sstream_put_str(&ss, ent->d_name);
+
+            if (ss.status == U_SSTREAM_OK && stat(ss.str, &sb) == 0 && S_ISDIR(sb.st_mode))
+                is_dir = 1;
+        }
+
+        cb(user, ent->d_name, is_dir);
+    }
+
+    closedir(dir);
+    return 1;
+}
+#endif
+
+#ifndef _PL_THREAD
+#define _PL_THREAD
+struct PL_Thread
+{
+    pthread_t thread;
+    PL_ThreadFunc fn;
+    void *arg;
+};
+
+static void *_pl_thread_main(void *arg)
+{
+    PL_Thread *t = arg;
+    t->fn(t->arg);
+    return NULL;
+}
+
+PL_Thread *PL_CreateThread(PL_ThreadFunc fn, void *arg)
+{
+    PL_Thread *t;
+
+    t = U_AllocManaged(sizeof(*t));
+    t->fn = fn;
+    t->arg = arg;
+
+    if (pthread_create(&t->thread, NULL, _pl_thread_main, t) != 0)
+    {
+        U_Printf("PL_CreateThread: failed: %s\n", strerror(errno));
+        U_FreeTracked(t);
+        return NULL;
+    }
+
+    return t;
+}
+
+void PL_JoinThread(PL_Thread *t)
+{
+    U_ASSERT(t);
+    pthread_join(t->thread, NULL);
+    U_FreeTracked(t);
+}
+
+unsigned PL_CpuCount(void)
+{
+    long n;
+
+    n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (unsigned)n : 1;
+}
+
+long PL_AtomicIncrement(volatile long *value)
+{
+    return __sync_add_and_fetch(value, 1);
+}
+#endif
+
 #ifndef _PL_CONFIG_DIR
 #define _PL_CONFIG_DIR
 const char *PL_ConfigDir(void)
@@ -128,6 +128,188 @@ int PL_WriteFile(const char *path, const void *buf, unsigned bufsize)
 }
 #endif
 
+#ifndef _PL_FILE_
+#define _PL_FILE_
+int PL_FileOpen(PL_File *file, const char *path, unsigned mode)
+{
+    U_ASSERT(file);
+    U_ASSERT(path);
+
+    if (mode == PL_FILE_WRITE)
+        file->handle = CreateFileA(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    else if (mode == PL_FILE_UPDATE)
+        file->handle = CreateFileA(path, GENERIC_WRITE, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    else
+        file->handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+
+    return file->handle == INVALID_HANDLE_VALUE ? 0 : 1;
+}
+
+int PL_FileWrite(PL_File *file, const void *buf, unsigned long size)
+{
+    DWORD n;
+    const char *p;
+
+    U_ASSERT(file->handle != INVALID_HANDLE_VALUE);
+
+    for (p = buf; size; )
+    {
+        if (!WriteFile(file->handle, p, (DWORD)size, &n, NULL) || n == 0)
+            return 0;
+
+        p += n;
+        size -= n;
+    }
+
+    return 1;
+}
+
+int PL_FileWriteAt(PL_File *file, unsigned long offset, const void *buf, unsigned long size)
+{
+    DWORD n;
+    OVERLAPPED ov;
+    LARGE_INTEGER cur;
+    LARGE_INTEGER zero;
+    const char *p;
+    int ret;
+
+    U_ASSERT(file->handle != INVALID_HANDLE_VALUE);
+
+    /* WriteFile() with OVERLAPPED moves the file pointer on synchronous
+       handles, restore it so that following PL_FileWrite() append. */
+    zero.QuadPart = 0;
+    if (!SetFilePointerEx(file->handle, zero, &cur, FILE_CURRENT))
+        return 0;
+
+    ret = 1;
+    for (p = buf; size; )
+    {
+        U_bzero(&ov, sizeof(ov));
+        ov.Offset = (DWORD)offset;
+
+        if (!WriteFile(file->handle, p, (DWORD)size, &n, &ov) || n == 0)
+        {
+            ret = 0;
+            break;
+        }
+
+        p += n;
+        offset += n;
+        size -= n;
+    }
+
+    if (!SetFilePointerEx(file->handle, cur, NULL, FILE_BEGIN))
+        ret = 0;
+
+    return ret;
+}
+
+/* WriteFileGather() needs unbuffered, page aligned I/O, write one by one */
+int PL_FileWriteV(PL_File *file, const PL_IoVec *iov, unsigned count)
+{
+    unsigned i;
+
+    for (i = 0; i < count; i++)
+    {
+        if (PL_FileWrite(file, iov[i].data, iov[i].size) == 0)
+            return 0;
+    }
+
+    return 1;
+}
+
+void PL_FileClose(PL_File *file)
+{
+    if (file->handle != INVALID_HANDLE_VALUE)
+        CloseHandle(file->handle);
+    file->handle = INVALID_HANDLE_VALUE;
+}
+#endif
+
+#ifndef _PL_MAP_FILE_
+#define _PL_MAP_FILE_
+int PL_MapFile(PL_MappedFile *mf, const char *path)
+{
+    HANDLE fh;
+    HANDLE mh;
+    DWORD n;
+    LARGE_INTEGER size;
+    unsigned long pos;
+    void *p;
+
+    U_ASSERT(mf);
+    U_ASSERT(path);
+    U_bzero(mf, sizeof(*mf));
+
+    fh = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (fh == INVALID_HANDLE_VALUE)
+        return 0;
+
+    if (!GetFileSizeEx(fh, &size) || size.HighPart != 0)
+    {
+        CloseHandle(fh);
+        return 0;
+    }
+
+    mf->size = size.LowPart;
+    if (mf->size == 0)
+    {
+        /* CreateFileMapping() doesn't support empty files */
+        mf->data = (const unsigned char*)"";
+        CloseHandle(fh);
+        return 1;
+    }
+
+    /* the view keeps the mapping alive after the handles are closed */
+    mh = CreateFileMappingA(fh, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mh)
+    {
+        p = MapViewOfFile(mh, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mh);
+        if (p)
+        {
+            mf->data = p;
+            mf->mapped = 1;
+            CloseHandle(fh);
+            return 1;
+        }
+    }
+
+    /* fallback, read into memory */
+    p = malloc(mf->size);
+    if (!p)
+    {
+        CloseHandle(fh);
+        return 0;
+    }
+
+    for (pos = 0; pos < mf->size; pos += n)
+    {
+        if (!ReadFile(fh, (char*)p + pos, mf->size - pos, &n, NULL) || n == 0)
+        {
+            free(p);
+            CloseHandle(fh);
+            U_bzero(mf, sizeof(*mf));
+            return 0;
+        }
+    }
+
+    CloseHandle(fh);
+    mf->data = p;
+    return 1;
+}
+
+void PL_UnmapFile(PL_MappedFile *mf)
+{
+    if (mf->mapped)
+        UnmapViewOfFile(mf->data);
+    else if (mf->size)
+        free((void*)mf->data);
+
+    U_bzero(mf, sizeof(*mf));
+}
+#endif
+
 #ifndef _PL_FILE_EXISTS
 #define _PL_FILE_EXISTS
 int PL_FileExists(const char *path)
@@ -218,6 +400,103 @@ int PL_StatFile(const char *path, PL_Stat *st)
     return 0;
 }
 
+#ifndef _PL_LIST_DIRECTORY
+#define _PL_LIST_DIRECTORY
+/* Returns 1 when 'path' is a directory and was listed, otherwise 0. */
+int PL_ListDirectory(const char *path, PL_DirCallback cb, void *user)
+{
+    HANDLE h;
+    WIN32_FIND_DATAA fd;
+    char pattern[MAX_PATH];
+    U_SStream ss;
+    const char *name;
+
+    U_ASSERT(path);
+    U_ASSERT(cb);
+
+    U_sstream_init(&ss, &pattern[0], sizeof(pattern));
+    U_sstream_put_str(&ss, path);
+    U_sstream_put_str(&ss, "\\*");
+
+    if (ss.status != U_SSTREAM_OK)
+        return 0;
+
+    h = FindFirstFileA(ss.str, &fd);
+    if (h == INVALID_HANDLE_VALUE)
+        return 0;
+
+    do
+    {
+        name = &fd.cFileName[0];
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+            continue;
+
+        cb(user, name, (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) ? 1 : 0);
+    }
+    while (FindNextFileA(h, &fd));
+
+    FindClose(h);
+    return 1;
+}
+#endif
+
+#ifndef _PL_THREAD
+#define _PL_THREAD
+struct PL_Thread
+{
+    HANDLE handle;
+    PL_ThreadFunc fn;
+    void *arg;
+};
+
+static DWORD WINAPI _pl_thread_main(LPVOID arg)
+{
+    PL_Thread *t = arg;
+    t->fn(t->arg);
+    return 0;
+}
+
+PL_Thread *PL_CreateThread(PL_ThreadFunc fn, void *arg)
+{
+    PL_Thread *t;
+
+    t = U_AllocManaged(sizeof(*t));
+    t->fn = fn;
+    t->arg = arg;
+    t->handle = CreateThread(NULL, 0, _pl_thread_main, t, 0, NULL);
+
+    if (t->handle == NULL)
+    {
+        U_Printf("PL_CreateThread: failed: %lu\n", GetLastError());
+        U_FreeTracked(t);
+        return NULL;
+    }
+
+    return t;
+}
+
+void PL_JoinThread(PL_Thread *t)
+{
+    U_ASSERT(t);
+    WaitForSingleObject(t->handle, INFINITE);
+    CloseHandle(t->handle);
+    U_FreeTracked(t);
+}
+
+unsigned PL_CpuCount(void)
+{
+    SYSTEM_INFO si;
+
+    GetSystemInfo(&si);
+    return si.dwNumberOfProcessors > 0 ? (unsigned)si.dwNumberOfProcessors : 1;
+}
+
+long PL_AtomicIncrement(volatile long *value)
+{
+    return InterlockedIncrement(value);
+}
+#endif
+
 #ifndef _PL_CONFIG_DIR
 #define _PL_CONFIG_DIR
 const char *PL_ConfigDir(void)
@@ -7,6 +7,15 @@ void U_InitArena(U_Arena *arena, unsigned size)
     arena->buf = U_AllocManaged(size);
 }
 
+/* Arena on caller owned memory, which isn't freed by U_FreeArena(). */
+void U_InitArenaStatic(U_Arena *arena, void *mem, unsigned size)
+{
+    U_ASSERT((size & U_ARENA_SIZE_MASK) == size);
+    arena->size = 0;
+    arena->_total_size = size | U_ARENA_STATIC_MEM_FLAG;
+    arena->buf = mem;
+}
+
 void *U_AllocArena(U_Arena *arena, unsigned size, unsigned alignment)
 {
     u8 *p;
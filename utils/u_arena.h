@@ -22,6 +22,7 @@ typedef struct U_Arena
 #endif
 
 void U_InitArena(U_Arena *arena, unsigned size);
+void U_InitArenaStatic(U_Arena *arena, void *mem, unsigned size);
 void *U_AllocArena(U_Arena *arena, unsigned size, unsigned alignment);
 void U_FreeArena(U_Arena *arena);
 u32 U_GetArenaPtr(U_Arena *arena, void *mem);
@@ -0,0 +1,172 @@
+
+/* MurmurHash64A by Austin Appleby (public domain), endian independent loads. */
+u64 U_hash64(const void *data, unsigned size)
+{
+    u64 h;
+    u64 k;
+    const u8 *p;
+    const u64 m = 0xC6A4A7935BD1E995ULL;
+    const int r = 47;
+
+    p = data;
+    h = 0x1F0D3804ULL ^ ((u64)size * m);
+
+    for (; size >= 8; size -= 8, p += 8)
+    {
+        k = (u64)p[0]       | (u64)p[1] << 8  | (u64)p[2] << 16 | (u64)p[3] << 24 |
+            (u64)p[4] << 32 | (u64)p[5] << 40 | (u64)p[6] << 48 | (u64)p[7] << 56;
+
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+
+        h ^= k;
+        h *= m;
+    }
+
+    switch (size)
+    {
+    case 7: h ^= (u64)p[6] << 48; /* fall through */
+    case 6: h ^= (u64)p[5] << 40; /* fall through */
+    case 5: h ^= (u64)p[4] << 32; /* fall through */
+    case 4: h ^= (u64)p[3] << 24; /* fall through */
+    case 3: h ^= (u64)p[2] << 16; /* fall through */
+    case 2: h ^= (u64)p[1] << 8;  /* fall through */
+    case 1: h ^= (u64)p[0];
+            h *= m;
+    default:
+        break;
+    }
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+
+    return h;
+}
+
+static U_HashMapEntry *U_HashMapAllocEntries(U_Arena *arena, unsigned size)
+{
+    U_HashMapEntry *entries;
+
+    entries = U_AllocArena(arena, size * sizeof(*entries), U_ARENA_ALIGN_8);
+    if (entries)
+        U_bzero(entries, size * sizeof(*entries));
+
+    return entries;
+}
+
+void U_HashMapInit(U_HashMap *map, U_Arena *arena, unsigned capacity)
+{
+    unsigned size;
+
+    /* keep load factor <= 0.5 */
+    for (size = 16; size < capacity * 2; size *= 2)
+        ;
+
+    map->arena = arena;
+    map->count = 0;
+    map->entries = U_HashMapAllocEntries(arena, size);
+    map->size = map->entries ? size : 0;
+}
+
+U_HashMapEntry *U_HashMapFind(const U_HashMap *map, const void *key, unsigned key_len)
+{
+    u64 hash;
+    unsigned i;
+    unsigned mask;
+    U_HashMapEntry *e;
+
+    if (map->size == 0)
+        return NULL;
+
+    hash = U_hash64(key, key_len);
+    mask = map->size - 1;
+
+    for (i = (unsigned)hash & mask; ; i = (i + 1) & mask)
+    {
+        e = &map->entries[i];
+        if (e->key == NULL)
+            return NULL;
+
+        if (e->hash == hash && e->key_len == key_len && U_memcmp(e->key, key, key_len) == 0)
+            return e;
+    }
+}
+
+static int U_HashMapGrow(U_HashMap *map)
+{
+    unsigned i;
+    unsigned j;
+    unsigned size;
+    U_HashMapEntry *entries;
+
+    size = map->size * 2;
+    entries = U_HashMapAllocEntries(map->arena, size);
+    if (!entries)
+        return 0;
+
+    for (i = 0; i < map->size; i++)
+    {
+        if (map->entries[i].key == NULL)
+            continue;
+
+        for (j = (unsigned)map->entries[i].hash & (size - 1); entries[j].key; j = (j + 1) & (size - 1))
+            ;
+
+        entries[j] = map->entries[i];
+    }
+
+    map->entries = entries;
+    map->size = size;
+    return 1;
+}
+
+/** Returns the entry for 'key', a new entry has a NULL value.
+ *
+ * 'inserted' is set to 1 when the key wasn't in the map before.
+ * Returns NULL when the arena is exhausted.
+ */
+U_HashMapEntry *U_HashMapInsert(U_HashMap *map, const void *key, unsigned key_len, int *inserted)
+{
+    u64 hash;
+    unsigned i;
+    unsigned mask;
+    char *key_copy;
+    U_HashMapEntry *e;
+
+    *inserted = 0;
+
+    e = U_HashMapFind(map, key, key_len);
+    if (e)
+        return e;
+
+    if (map->size == 0 || (map->count + 1) * 2 > map->size)
+    {
+        if (map->size == 0 || U_HashMapGrow(map) == 0)
+            return NULL;
+    }
+
+    key_copy = U_AllocArena(map->arena, key_len + 1, U_ARENA_ALIGN_1);
+    if (!key_copy)
+        return NULL;
+
+    U_memcpy(key_copy, key, key_len);
+    key_copy[key_len] = '\0';
+
+    hash = U_hash64(key, key_len);
+    mask = map->size - 1;
+
+    for (i = (unsigned)hash & mask; map->entries[i].key; i = (i + 1) & mask)
+        ;
+
+    e = &map->entries[i];
+    e->hash = hash;
+    e->key = key_copy;
+    e->key_len = key_len;
+    e->value = NULL;
+
+    map->count++;
+    *inserted = 1;
+    return e;
+}
@@ -0,0 +1,34 @@
+#ifndef U_HASHMAP_H
+#define U_HASHMAP_H
+
+/* Open addressing hash map with byte string keys.
+
+   Keys are copied into the arena and always compared in full, the 64-bit
+   hash only selects the slot. Memory is taken from a U_Arena, when the
+   map grows the old slot array stays unused in the arena.
+   Lookups don't modify the map and can be done by multiple threads.
+*/
+
+typedef struct U_HashMapEntry
+{
+    u64 hash;
+    const char *key;
+    unsigned key_len;
+    void *value;
+} U_HashMapEntry;
+
+typedef struct U_HashMap
+{
+    U_Arena *arena;
+    U_HashMapEntry *entries;
+    unsigned size; /* slot count, power of two */
+    unsigned count;
+} U_HashMap;
+
+u64 U_hash64(const void *data, unsigned size);
+
+void U_HashMapInit(U_HashMap *map, U_Arena *arena, unsigned capacity);
+U_HashMapEntry *U_HashMapFind(const U_HashMap *map, const void *key, unsigned key_len);
+U_HashMapEntry *U_HashMapInsert(U_HashMap *map, const void *key, unsigned key_len, int *inserted);
+
+#endif /* U_HASHMAP_H */
@@ -0,0 +1,285 @@
+
+#define U_LZ4_MIN_MATCH    4
+#define U_LZ4_LAST_LITERALS 5  /* last bytes of a block are always literals */
+#define U_LZ4_MF_LIMIT     12 /* last match starts at least this far before the end */
+#define U_LZ4_MAX_OFFSET   65535
+#define U_LZ4_MAX_HASH_LOG 14
+
+static u32 u_lz4_read32(const u8 *p)
+{
+    return (u32)p[0] | (u32)p[1] << 8 | (u32)p[2] << 16 | (u32)p[3] << 24;
+}
+
+static unsigned u_lz4_hash(u32 v, unsigned hash_log)
+{
+    return (unsigned)((v * 2654435761U) >> (32 - hash_log));
+}
+
+/* Writes a length continuation, 'len' is the part exceeding the 4-bit token field. */
+static u8 *u_lz4_put_length(u8 *op, unsigned len)
+{
+    for (; len >= 255; len -= 255)
+        *op++ = 255;
+    *op++ = (u8)len;
+    return op;
+}
+
+/* Emits one sequence, match_len 0 for the final literals-only sequence. */
+static u8 *u_lz4_put_sequence(u8 *op, u8 *oend, const u8 *lit, unsigned lit_len,
+                              unsigned offset, unsigned match_len)
+{
+    u8 *token;
+
+    /* token + length bytes + literals + offset + length bytes */
+    if ((unsigned long)(oend - op) < 1 + lit_len / 255 + 1 + lit_len + 2 + match_len / 255 + 1)
+        return NULL;
+
+    token = op++;
+
+    if (lit_len >= 15)
+    {
+        *token = 15 << 4;
+        op = u_lz4_put_length(op, lit_len - 15);
+    }
+    else
+    {
+        *token = (u8)(lit_len << 4);
+    }
+
+    U_memcpy(op, lit, lit_len);
+    op += lit_len;
+
+    if (match_len == 0)
+        return op;
+
+    *op++ = offset & 0xFF;
+    *op++ = (offset >> 8) & 0xFF;
+
+    match_len -= U_LZ4_MIN_MATCH;
+    if (match_len >= 15)
+    {
+        *token |= 15;
+        op = u_lz4_put_length(op, match_len - 15);
+    }
+    else
+    {
+        *token |= (u8)match_len;
+    }
+
+    return op;
+}
+
+unsigned U_lz4_compress_prefix(const void *src, unsigned prefix_size, unsigned src_size, void *dst, unsigned dst_size)
+{
+    u32 table[1 << U_LZ4_MAX_HASH_LOG];
+    unsigned hash_log;
+    unsigned h;
+    unsigned len;
+    unsigned step;
+    const u8 *base;
+    const u8 *start;
+    const u8 *ip;
+    const u8 *ref;
+    const u8 *anchor;
+    const u8 *end;
+    const u8 *mf_limit;
+    const u8 *match_limit;
+    u8 *op;
+    u8 *oend;
+
+    /* only the last 64K of the prefix are in reach of match offsets */
+    if (prefix_size > U_LZ4_MAX_OFFSET)
+    {
+        src = (const u8*)src + (prefix_size - U_LZ4_MAX_OFFSET);
+        prefix_size = U_LZ4_MAX_OFFSET;
+    }
+
+    base = src;
+    start = base + prefix_size;
+    ip = start;
+    anchor = start;
+    end = start + src_size;
+    op = dst;
+    oend = op + dst_size;
+
+    if (src_size > U_LZ4_MF_LIMIT)
+    {
+        /* smaller table for small inputs, it's cleared for every call */
+        for (hash_log = 8; hash_log < U_LZ4_MAX_HASH_LOG && (1U << hash_log) < prefix_size + src_size; hash_log++)
+            ;
+        U_bzero(table, (1U << hash_log) * sizeof(table[0]));
+
+        /* index the prefix, later positions overwrite earlier ones */
+        for (ref = base; ref < start; ref++)
+            table[u_lz4_hash(u_lz4_read32(ref), hash_log)] = (u32)(ref - base);
+
+        mf_limit = end - U_LZ4_MF_LIMIT;
+        match_limit = end - U_LZ4_LAST_LITERALS;
+
+        while (ip <= mf_limit)
+        {
+            h = u_lz4_hash(u_lz4_read32(ip), hash_log);
+            ref = base + table[h];
+            table[h] = (u32)(ip - base);
+
+            if (ref >= ip || ip - ref > U_LZ4_MAX_OFFSET || u_lz4_read32(ref) != u_lz4_read32(ip))
+            {
+                /* skip faster through data which doesn't compress */
+                step = 1 + (unsigned)((ip - anchor) >> 6);
+                ip += step;
+                continue;
+            }
+
+            /* extend backwards into pending literals */
+            while (ip > anchor && ref > base && ip[-1] == ref[-1])
+            {
+                ip--;
+                ref--;
+            }
+
+            for (len = U_LZ4_MIN_MATCH; ip + len < match_limit && ip[len] == ref[len]; len++)
+                ;
+
+            op = u_lz4_put_sequence(op, oend, anchor, (unsigned)(ip - anchor), (unsigned)(ip - ref), len);
+            if (!op)
+                return 0;
+
+            ip += len;
+            anchor = ip;
+
+            if (ip <= mf_limit)
+                table[u_lz4_hash(u_lz4_read32(ip - 2), hash_log)] = (u32)(ip - 2 - base);
+        }
+    }
+
+    op = u_lz4_put_sequence(op, oend, anchor, (unsigned)(end - anchor), 0, 0);
+    if (!op)
+        return 0;
+
+    return (unsigned)(op - (u8*)dst);
+}
+
+unsigned U_lz4_compress(const void *src, unsigned src_size, void *dst, unsigned dst_size)
+{
+    return U_lz4_compress_prefix(src, 0, src_size, dst, dst_size);
+}
+
+/* Reads a length continuation, returns 0 on truncated input or overflow. */
+static int u_lz4_get_length(const u8 **ip, const u8 *iend, unsigned *len)
+{
+    unsigned b;
+
+    do
+    {
+        if (*ip >= iend)
+            return 0;
+
+        b = *(*ip)++;
+        if (*len > 0xFFFFFFFFU - 255)
+            return 0;
+        *len += b;
+    }
+    while (b == 255);
+
+    return 1;
+}
+
+int U_lz4_decompress_dict(const void *dict, unsigned dict_size, const void *src, unsigned src_size,
+                          void *dst, unsigned dst_size)
+{
+    unsigned token;
+    unsigned len;
+    unsigned offset;
+    unsigned n;
+    const u8 *ip;
+    const u8 *iend;
+    const u8 *match;
+    u8 *op;
+    u8 *oend;
+
+    ip = src;
+    iend = ip + src_size;
+    op = dst;
+    oend = op + dst_size;
+
+    if (src_size == 0)
+        return -1;
+
+    for (;;)
+    {
+        if (ip >= iend)
+            return -1;
+
+        token = *ip++;
+
+        /* literals */
+        len = token >> 4;
+        if (len == 15 && !u_lz4_get_length(&ip, iend, &len))
+            return -1;
+
+        if (len > (unsigned long)(iend - ip) || len > (unsigned long)(oend - op))
+            return -1;
+
+        U_memcpy(op, ip, len);
+        op += len;
+        ip += len;
+
+        if (ip == iend)
+            break; /* last sequence has no match */
+
+        /* match */
+        if (iend - ip < 2)
+            return -1;
+
+        offset = (unsigned)ip[0] | (unsigned)ip[1] << 8;
+        ip += 2;
+
+        if (offset == 0 || offset > (unsigned long)(op - (u8*)dst) + dict_size)
+            return -1;
+
+        len = token & 15;
+        if (len == 15 && !u_lz4_get_length(&ip, iend, &len))
+            return -1;
+
+        len += U_LZ4_MIN_MATCH;
+        if (len > (unsigned long)(oend - op))
+            return -1;
+
+        if (offset > (unsigned long)(op - (u8*)dst))
+        {
+            /* match starts in the dictionary and may continue in dst */
+            n = offset - (unsigned)(op - (u8*)dst);
+            match = (const u8*)dict + (dict_size - n);
+            if (n > len)
+                n = len;
+
+            U_memcpy(op, match, n);
+            op += n;
+            len -= n;
+            match = dst;
+        }
+        else
+        {
+            match = op - offset;
+        }
+
+        if ((unsigned long)(op - match) >= len)
+        {
+            U_memcpy(op, match, len);
+            op += len;
+        }
+        else
+        {
+            /* overlapping copy repeats the last 'offset' bytes */
+            for (; len; len--)
+                *op++ = *match++;
+        }
+    }
+
+    return (int)(op - (u8*)dst);
+}
+
+int U_lz4_decompress(const void *src, unsigned src_size, void *dst, unsigned dst_size)
+{
+    return U_lz4_decompress_dict(NULL, 0, src, src_size, dst, dst_size);
+}
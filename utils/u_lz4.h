@@ -0,0 +1,34 @@
+#ifndef U_LZ4_H
+#define U_LZ4_H
+
+/* LZ4 block format compression.
+
+   Output is compatible with the LZ4 block format, a block can be decoded
+   by LZ4_decompress_safe() of the reference implementation and vice versa.
+   Only the block format is supported, no frames, checksums or streaming.
+   The decoder checks all bounds and can be used on untrusted input.
+*/
+
+/* worst case size of compressed data */
+#define U_LZ4_COMPRESS_BOUND(size) ((size) + ((size) / 255) + 16)
+
+/* Returns compressed size, or 0 if dst_size is too small. */
+unsigned U_lz4_compress(const void *src, unsigned src_size, void *dst, unsigned dst_size);
+
+/* Returns decompressed size, or -1 on invalid input or if dst_size is too small. */
+int U_lz4_decompress(const void *src, unsigned src_size, void *dst, unsigned dst_size);
+
+/* Dictionary compression.
+
+   The dictionary holds data which is likely repeated in the input, matches
+   can refer to its last 64K bytes. The compressor expects the dictionary
+   directly in front of the input: 'src' points to 'prefix_size' dictionary
+   bytes followed by 'src_size' bytes to compress. The decoder takes the
+   dictionary as separate buffer, the same dictionary bytes must be used
+   on both sides. Compatible with LZ4_decompress_safe_usingDict().
+*/
+unsigned U_lz4_compress_prefix(const void *src, unsigned prefix_size, unsigned src_size, void *dst, unsigned dst_size);
+int U_lz4_decompress_dict(const void *dict, unsigned dict_size, const void *src, unsigned src_size,
+                          void *dst, unsigned dst_size);
+
+#endif /* U_LZ4_H */
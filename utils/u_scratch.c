@@ -1,5 +1,5 @@
 
-static U_Arena _scratch_arena;
+static U_THREAD_LOCAL U_Arena _scratch_arena;
 
 void U_ScratchInit(unsigned size)
 {
@@ -7,6 +7,20 @@ void U_ScratchInit(unsigned size)
     U_InitArena(&_scratch_arena, size);
 }
 
+/* For worker threads, U_AllocManaged() must only be called from the main thread. */
+void U_ScratchInitStatic(void *mem, unsigned size)
+{
+    U_ASSERT(_scratch_arena.buf == NULL);
+    U_InitArenaStatic(&_scratch_arena, mem, size);
+}
+
+/* For data structures allocating from an arena, released by U_ScratchRestore(). */
+U_Arena *U_ScratchArena(void)
+{
+    U_ASSERT(_scratch_arena.buf != NULL);
+    return &_scratch_arena;
+}
+
 void *U_ScratchAlloc(unsigned size)
 {
     void *p;
@@ -21,6 +35,19 @@ unsigned U_ScratchPos(void)
 {
     return _scratch_arena.size;
 }
+
+/* Largest U_ScratchAlloc() size which still fits. */
+unsigned U_ScratchRemaining(void)
+{
+    unsigned total;
+
+    total = _scratch_arena._total_size & U_ARENA_SIZE_MASK;
+    if (total < _scratch_arena.size + 8)
+        return 0;
+
+    return total - _scratch_arena.size - 8; /* alignment and end check of U_AllocArena() */
+}
+
 void U_ScratchRestore(unsigned pos)
 {
     if (pos < _scratch_arena.size)
@@ -7,9 +7,13 @@
 
 #define U_SCRATCH_POP() U_ScratchRestore(scratch_pos)
 
+/* The scratch arena is thread local, each thread needs to initialize it. */
 void U_ScratchInit(unsigned size);
+void U_ScratchInitStatic(void *mem, unsigned size);
+U_Arena *U_ScratchArena(void);
 void *U_ScratchAlloc(unsigned size);
 unsigned U_ScratchPos(void);
+unsigned U_ScratchRemaining(void);
 void U_ScratchRestore(unsigned pos);
 void U_ScratchReset(void);
 void U_ScratchFree(void);
@@ -0,0 +1,1501 @@
+#ifdef U_SECP256K1_SUPPORTED
+
+__extension__ typedef unsigned __int128 u_secp_u128;
+
+#define U_SECP_M52 0xFFFFFFFFFFFFFULL
+#define U_SECP_M48 0xFFFFFFFFFFFFULL
+#define U_SECP_C   0x1000003D1ULL   /* 2^256 mod p */
+#define U_SECP_R   0x1000003D10ULL  /* 2^260 mod p */
+
+/* Field element mod p = 2^256 - 0x1000003D1, 5 x 52-bit limbs with the
+   least significant first. All functions return weakly normalized values:
+   limbs 0..3 < 2^52, limb 4 < 2^49, but not necessarily < p.
+ */
+typedef struct
+{
+    u64 n[5];
+} u_secp_fe;
+
+/* Scalar mod n, 4 x 64-bit limbs with the least significant first, always < n. */
+typedef struct
+{
+    u64 d[4];
+} u_secp_sc;
+
+/* affine point */
+typedef struct
+{
+    u_secp_fe x;
+    u_secp_fe y;
+} u_secp_ge;
+
+/* Jacobian point x = X / Z^2, y = Y / Z^3 */
+typedef struct
+{
+    u_secp_fe x;
+    u_secp_fe y;
+    u_secp_fe z;
+    int infinity;
+} u_secp_gej;
+
+static const u8 u_secp_g[64] = {
+    0x79, 0xBE, 0x66, 0x7E, 0xF9, 0xDC, 0xBB, 0xAC, 0x55, 0xA0, 0x62, 0x95, 0xCE, 0x87, 0x0B, 0x07,
+    0x02, 0x9B, 0xFC, 0xDB, 0x2D, 0xCE, 0x28, 0xD9, 0x59, 0xF2, 0x81, 0x5B, 0x16, 0xF8, 0x17, 0x98,
+    0x48, 0x3A, 0xDA, 0x77, 0x26, 0xA3, 0xC4, 0x65, 0x5D, 0xA4, 0xFB, 0xFC, 0x0E, 0x11, 0x08, 0xA8,
+    0xFD, 0x17, 0xB4, 0x48, 0xA6, 0x85, 0x54, 0x19, 0x9C, 0x47, 0xD0, 0x8F, 0xFB, 0x10, 0xD4, 0xB8
+};
+
+/* cube root of 1 mod p, (x, y) * lambda = (beta * x, y) */
+static const u8 u_secp_beta[32] = {
+    0x7A, 0xE9, 0x6A, 0x2B, 0x65, 0x7C, 0x07, 0x10, 0x6E, 0x64, 0x47, 0x9E, 0xAC, 0x34, 0x34, 0xE9,
+    0x9C, 0xF0, 0x49, 0x75, 0x12, 0xF5, 0x89, 0x95, 0xC1, 0x39, 0x6C, 0x28, 0x71, 0x95, 0x01, 0xEE
+};
+
+static const u64 u_secp_n[4] = {
+    0xBFD25E8CD0364141ULL, 0xBAAEDCE6AF48A03BULL, 0xFFFFFFFFFFFFFFFEULL, 0xFFFFFFFFFFFFFFFFULL
+};
+
+/* 2^256 - n */
+static const u64 u_secp_nc[3] = {
+    0x402DA1732FC9BEBFULL, 0x4551231950B75FC4ULL, 1
+};
+
+/* GLV constants: lambda, -b1, -b2 and g1, g2 = round(2^384 * b2 / n), round(2^384 * -b1 / n) */
+static const u_secp_sc u_secp_lambda = {{
+    0xDF02967C1B23BD72ULL, 0x122E22EA20816678ULL, 0xA5261C028812645AULL, 0x5363AD4CC05C30E0ULL
+}};
+
+static const u_secp_sc u_secp_minus_b1 = {{
+    0x6F547FA90ABFE4C3ULL, 0xE4437ED6010E8828ULL, 0, 0
+}};
+
+static const u_secp_sc u_secp_minus_b2 = {{
+    0xD765CDA83DB1562CULL, 0x8A280AC50774346DULL, 0xFFFFFFFFFFFFFFFEULL, 0xFFFFFFFFFFFFFFFFULL
+}};
+
+static const u_secp_sc u_secp_g1 = {{
+    0xE893209A45DBB031ULL, 0x3DAA8A1471E8CA7FULL, 0xE86C90E49284EB15ULL, 0x3086D221A7D46BCDULL
+}};
+
+static const u_secp_sc u_secp_g2 = {{
+    0x1571B4AE8AC47F71ULL, 0x221208AC9DF506C6ULL, 0x6F547FA90ABFE4C4ULL, 0xE4437ED6010E8828ULL
+}};
+
+#define U_SECP_COMB_WINDOWS 64 /* 4-bit windows */
+
+/* comb[i][j] = (j * 16^i) * G + U_i, the U_i are multiples of a point with
+   unknown discrete logarithm and sum up to infinity. No partial sum is
+   infinity or equal to the added point, the table can be used without
+   special cases.
+ */
+static u_secp_ge u_secp_comb[U_SECP_COMB_WINDOWS][16];
+
+/* odd multiples G, 3G, .. 127G for the wNAF in verification */
+#define U_SECP_WINDOW_G 8
+static u_secp_ge u_secp_pre_g[1 << (U_SECP_WINDOW_G - 2)];
+
+/* window of the odd multiples of a public key in U_secp256k1_verify() */
+#define U_SECP_WINDOW_A 5
+
+static u_secp_fe u_secp_fe_beta;
+static int u_secp_ready;
+
+/*** field ***************************************************************/
+
+static void u_secp_fe_weak(u_secp_fe *r)
+{
+    u64 x;
+
+    x = r->n[4] >> 48;
+    r->n[4] &= U_SECP_M48;
+    r->n[0] += x * U_SECP_C;
+    r->n[1] += r->n[0] >> 52; r->n[0] &= U_SECP_M52;
+    r->n[2] += r->n[1] >> 52; r->n[1] &= U_SECP_M52;
+    r->n[3] += r->n[2] >> 52; r->n[2] &= U_SECP_M52;
+    r->n[4] += r->n[3] >> 52; r->n[3] &= U_SECP_M52;
+}
+
+/* Fully normalizes to the canonical value < p, constant time. */
+static void u_secp_fe_normalize(u_secp_fe *r)
+{
+    u64 m;
+    u64 x;
+
+    u_secp_fe_weak(r);
+    m = r->n[1] & r->n[2] & r->n[3];
+
+    /* at most one subtraction of p is needed */
+    x = (r->n[4] >> 48) | ((r->n[4] == U_SECP_M48) & (m == U_SECP_M52) & (r->n[0] >= 0xFFFFEFFFFFC2FULL));
+    r->n[0] += x * U_SECP_C;
+    r->n[1] += r->n[0] >> 52; r->n[0] &= U_SECP_M52;
+    r->n[2] += r->n[1] >> 52; r->n[1] &= U_SECP_M52;
+    r->n[3] += r->n[2] >> 52; r->n[2] &= U_SECP_M52;
+    r->n[4] += r->n[3] >> 52; r->n[3] &= U_SECP_M52;
+    r->n[4] &= U_SECP_M48;
+}
+
+static void u_secp_fe_set_int(u_secp_fe *r, unsigned v)
+{
+    r->n[0] = v;
+    r->n[1] = 0;
+    r->n[2] = 0;
+    r->n[3] = 0;
+    r->n[4] = 0;
+}
+
+/* Returns 0 if the value isn't < p. */
+static int u_secp_fe_set_b32(u_secp_fe *r, const u8 *b)
+{
+    unsigned i;
+    u64 w[4];
+
+    for (i = 0; i < 4; i++)
+    {
+        w[i] = (u64)b[31 - i * 8] | (u64)b[30 - i * 8] << 8 | (u64)b[29 - i * 8] << 16 |
+               (u64)b[28 - i * 8] << 24 | (u64)b[27 - i * 8] << 32 | (u64)b[26 - i * 8] << 40 |
+               (u64)b[25 - i * 8] << 48 | (u64)b[24 - i * 8] << 56;
+    }
+
+    r->n[0] = w[0] & U_SECP_M52;
+    r->n[1] = (w[0] >> 52 | w[1] << 12) & U_SECP_M52;
+    r->n[2] = (w[1] >> 40 | w[2] << 24) & U_SECP_M52;
+    r->n[3] = (w[2] >> 28 | w[3] << 36) & U_SECP_M52;
+    r->n[4] = w[3] >> 16;
+
+    return !(r->n[4] == U_SECP_M48 && (r->n[1] & r->n[2] & r->n[3]) == U_SECP_M52 &&
+             r->n[0] >= 0xFFFFEFFFFFC2FULL);
+}
+
+static void u_secp_fe_get_b32(u8 *b, const u_secp_fe *a)
+{
+    unsigned i;
+    unsigned j;
+    u64 w[4];
+    u_secp_fe t;
+
+    t = *a;
+    u_secp_fe_normalize(&t);
+
+    w[0] = t.n[0] | t.n[1] << 52;
+    w[1] = t.n[1] >> 12 | t.n[2] << 40;
+    w[2] = t.n[2] >> 24 | t.n[3] << 28;
+    w[3] = t.n[3] >> 36 | t.n[4] << 16;
+
+    for (i = 0; i < 4; i++)
+    {
+        for (j = 0; j < 8; j++)
+            b[31 - i * 8 - j] = (u8)(w[i] >> (j * 8));
+    }
+}
+
+static int u_secp_fe_is_zero(const u_secp_fe *a)
+{
+    u_secp_fe t;
+
+    t = *a;
+    u_secp_fe_normalize(&t);
+    return (t.n[0] | t.n[1] | t.n[2] | t.n[3] | t.n[4]) == 0;
+}
+
+static int u_secp_fe_is_odd(const u_secp_fe *a)
+{
+    u_secp_fe t;
+
+    t = *a;
+    u_secp_fe_normalize(&t);
+    return (int)(t.n[0] & 1);
+}
+
+static void u_secp_fe_add(u_secp_fe *r, const u_secp_fe *a, const u_secp_fe *b)
+{
+    unsigned i;
+
+    for (i = 0; i < 5; i++)
+        r->n[i] = a->n[i] + b->n[i];
+    u_secp_fe_weak(r);
+}
+
+/* a + 4p - b, the limbs of 4p are larger than weakly normalized limbs */
+static void u_secp_fe_sub(u_secp_fe *r, const u_secp_fe *a, const u_secp_fe *b)
+{
+    r->n[0] = a->n[0] + 0x3FFFFBFFFFF0BCULL - b->n[0];
+    r->n[1] = a->n[1] + 0x3FFFFFFFFFFFFCULL - b->n[1];
+    r->n[2] = a->n[2] + 0x3FFFFFFFFFFFFCULL - b->n[2];
+    r->n[3] = a->n[3] + 0x3FFFFFFFFFFFFCULL - b->n[3];
+    r->n[4] = a->n[4] + 0x3FFFFFFFFFFFCULL - b->n[4];
+    u_secp_fe_weak(r);
+}
+
+static void u_secp_fe_negate(u_secp_fe *r, const u_secp_fe *a)
+{
+    u_secp_fe zero;
+
+    u_secp_fe_set_int(&zero, 0);
+    u_secp_fe_sub(r, &zero, a);
+}
+
+/* k <= 8 */
+static void u_secp_fe_mul_int(u_secp_fe *r, const u_secp_fe *a, unsigned k)
+{
+    unsigned i;
+
+    for (i = 0; i < 5; i++)
+        r->n[i] = a->n[i] * k;
+    u_secp_fe_weak(r);
+}
+
+static int u_secp_fe_equal(const u_secp_fe *a, const u_secp_fe *b)
+{
+    u_secp_fe t;
+
+    u_secp_fe_sub(&t, a, b);
+    return u_secp_fe_is_zero(&t);
+}
+
+/* Products are summed by columns with one accumulator, the high columns
+   first. They are split into 52-bit limbs d5..d9, limb i + 5 is at
+   2^260 = R mod p and added to column i. 'acc' holds the bits from 2^260.
+ */
+static void u_secp_fe_fold(u_secp_fe *r, u_secp_u128 acc)
+{
+    u64 top;
+
+    top = (r->n[4] >> 48) + ((u64)acc << 4);
+    r->n[4] &= U_SECP_M48;
+    acc = (u_secp_u128)top * U_SECP_C + r->n[0];
+    r->n[0] = (u64)acc & U_SECP_M52;
+    r->n[1] += (u64)(acc >> 52);
+    r->n[2] += r->n[1] >> 52; r->n[1] &= U_SECP_M52;
+    r->n[3] += r->n[2] >> 52; r->n[2] &= U_SECP_M52;
+    r->n[4] += r->n[3] >> 52; r->n[3] &= U_SECP_M52;
+}
+
+static void u_secp_fe_mul(u_secp_fe *r, const u_secp_fe *a, const u_secp_fe *b)
+{
+    u64 a0 = a->n[0], a1 = a->n[1], a2 = a->n[2], a3 = a->n[3], a4 = a->n[4];
+    u64 b0 = b->n[0], b1 = b->n[1], b2 = b->n[2], b3 = b->n[3], b4 = b->n[4];
+    u64 d5, d6, d7, d8, d9;
+    u_secp_u128 acc;
+
+    acc = (u_secp_u128)a1 * b4 + (u_secp_u128)a2 * b3 + (u_secp_u128)a3 * b2 + (u_secp_u128)a4 * b1;
+    d5 = (u64)acc & U_SECP_M52; acc >>= 52;
+    acc += (u_secp_u128)a2 * b4 + (u_secp_u128)a3 * b3 + (u_secp_u128)a4 * b2;
+    d6 = (u64)acc & U_SECP_M52; acc >>= 52;
+    acc += (u_secp_u128)a3 * b4 + (u_secp_u128)a4 * b3;
+    d7 = (u64)acc & U_SECP_M52; acc >>= 52;
+    acc += (u_secp_u128)a4 * b4;
+    d8 = (u64)acc & U_SECP_M52;
+    d9 = (u64)(acc >> 52);
+
+    acc = (u_secp_u128)a0 * b0 + (u_secp_u128)d5 * U_SECP_R;
+    r->n[0] = (u64)acc & U_SECP_M52; acc >>= 52;
+    acc += (u_secp_u128)a0 * b1 + (u_secp_u128)a1 * b0 + (u_secp_u128)d6 * U_SECP_R;
+    r->n[1] = (u64)acc & U_SECP_M52; acc >>= 52;
+    acc += (u_secp_u128)a0 * b2 + (u_secp_u128)a1 * b1 + (u_secp_u128)a2 * b0 + (u_secp_u128)d7 * U_SECP_R;
+    r->n[2] = (u64)acc & U_SECP_M52; acc >>= 52;
+    acc += (u_secp_u128)a0 * b3 + (u_secp_u128)a1 * b2 + (u_secp_u128)a2 * b1 + (u_secp_u128)a3 * b0 +
+           (u_secp_u128)d8 * U_SECP_R;
+    r->n[3] = (u64)acc & U_SECP_M52; acc >>= 52;
+    acc += (u_secp_u128)a0 * b4 + (u_secp_u128)a1 * b3 + (u_secp_u128)a2 * b2 + (u_secp_u128)a3 * b1 +
+           (u_secp_u128)a4 * b0 + (u_secp_u128)d9 * U_SECP_R;
+    r->n[4] = (u64)acc & U_SECP_M52; acc >>= 52;
+
+    u_secp_fe_fold(r, acc);
+}
+
+static void u_secp_fe_sqr(u_secp_fe *r, const u_secp_fe *a)
+{
+    u64 a0 = a->n[0], a1 = a->n[1], a2 = a->n[2], a3 = a->n[3], a4 = a->n[4];
+    u64 d5, d6, d7, d8, d9;
+    u_secp_u128 acc;
+
+    acc = (u_secp_u128)(a1 * 2) * a4 + (u_secp_u128)(a2 * 2) * a3;
+    d5 = (u64)acc & U_SECP_M52; acc >>= 52;
+    acc += (u_secp_u128)(a2 * 2) * a4 + (u_secp_u128)a3 * a3;
+    d6 = (u64)acc & U_SECP_M52; acc >>= 52;
+    acc += (u_secp_u128)(a3 * 2) * a4;
+    d7 = (u64)acc & U_SECP_M52; acc >>= 52;
+    acc += (u_secp_u128)a4 * a4;
+    d8 = (u64)acc & U_SECP_M52;
+    d9 = (u64)(acc >> 52);
+
+    acc = (u_secp_u128)a0 * a0 + (u_secp_u128)d5 * U_SECP_R;
+    r->n[0] = (u64)acc & U_SECP_M52; acc >>= 52;
+    acc += (u_secp_u128)(a0 * 2) * a1 + (u_secp_u128)d6 * U_SECP_R;
+    r->n[1] = (u64)acc & U_SECP_M52; acc >>= 52;
+    acc += (u_secp_u128)(a0 * 2) * a2 + (u_secp_u128)a1 * a1 + (u_secp_u128)d7 * U_SECP_R;
+    r->n[2] = (u64)acc & U_SECP_M52; acc >>= 52;
+    acc += (u_secp_u128)(a0 * 2) * a3 + (u_secp_u128)(a1 * 2) * a2 + (u_secp_u128)d8 * U_SECP_R;
+    r->n[3] = (u64)acc & U_SECP_M52; acc >>= 52;
+    acc += (u_secp_u128)(a0 * 2) * a4 + (u_secp_u128)(a1 * 2) * a3 + (u_secp_u128)a2 * a2 +
+           (u_secp_u128)d9 * U_SECP_R;
+    r->n[4] = (u64)acc & U_SECP_M52; acc >>= 52;
+
+    u_secp_fe_fold(r, acc);
+}
+
+static void u_secp_fe_sqr_n(u_secp_fe *r, const u_secp_fe *a, unsigned n)
+{
+    *r = *a;
+    while (n--)
+        u_secp_fe_sqr(r, r);
+}
+
+/* a^(2^k - 1) for k in 2, 3, 22, 223, the blocks of ones in p - 2 and (p + 1) / 4 */
+static void u_secp_fe_pow_blocks(const u_secp_fe *a, u_secp_fe *x2, u_secp_fe *x3, u_secp_fe *x22, u_secp_fe *x223)
+{
+    u_secp_fe x6;
+    u_secp_fe x9;
+    u_secp_fe x11;
+    u_secp_fe x44;
+    u_secp_fe x88;
+    u_secp_fe x176;
+    u_secp_fe x220;
+
+    u_secp_fe_sqr(x2, a);
+    u_secp_fe_mul(x2, x2, a);
+    u_secp_fe_sqr(x3, x2);
+    u_secp_fe_mul(x3, x3, a);
+    u_secp_fe_sqr_n(&x6, x3, 3);
+    u_secp_fe_mul(&x6, &x6, x3);
+    u_secp_fe_sqr_n(&x9, &x6, 3);
+    u_secp_fe_mul(&x9, &x9, x3);
+    u_secp_fe_sqr_n(&x11, &x9, 2);
+    u_secp_fe_mul(&x11, &x11, x2);
+    u_secp_fe_sqr_n(x22, &x11, 11);
+    u_secp_fe_mul(x22, x22, &x11);
+    u_secp_fe_sqr_n(&x44, x22, 22);
+    u_secp_fe_mul(&x44, &x44, x22);
+    u_secp_fe_sqr_n(&x88, &x44, 44);
+    u_secp_fe_mul(&x88, &x88, &x44);
+    u_secp_fe_sqr_n(&x176, &x88, 88);
+    u_secp_fe_mul(&x176, &x176, &x88);
+    u_secp_fe_sqr_n(&x220, &x176, 44);
+    u_secp_fe_mul(&x220, &x220, &x44);
+    u_secp_fe_sqr_n(x223, &x220, 3);
+    u_secp_fe_mul(x223, x223, x3);
+}
+
+/* a^(p - 2) */
+static void u_secp_fe_inv(u_secp_fe *r, const u_secp_fe *a)
+{
+    u_secp_fe x2;
+    u_secp_fe x3;
+    u_secp_fe x22;
+    u_secp_fe x223;
+    u_secp_fe t;
+
+    u_secp_fe_pow_blocks(a, &x2, &x3, &x22, &x223);
+    u_secp_fe_sqr_n(&t, &x223, 23);
+    u_secp_fe_mul(&t, &t, &x22);
+    u_secp_fe_sqr_n(&t, &t, 5);
+    u_secp_fe_mul(&t, &t, a);
+    u_secp_fe_sqr_n(&t, &t, 3);
+    u_secp_fe_mul(&t, &t, &x2);
+    u_secp_fe_sqr_n(&t, &t, 2);
+    u_secp_fe_mul(r, &t, a);
+}
+
+/* a^((p + 1) / 4), returns 0 if a has no square root */
+static int u_secp_fe_sqrt(u_secp_fe *r, const u_secp_fe *a)
+{
+    u_secp_fe x2;
+    u_secp_fe x3;
+    u_secp_fe x22;
+    u_secp_fe x223;
+    u_secp_fe t;
+
+    u_secp_fe_pow_blocks(a, &x2, &x3, &x22, &x223);
+    u_secp_fe_sqr_n(&t, &x223, 23);
+    u_secp_fe_mul(&t, &t, &x22);
+    u_secp_fe_sqr_n(&t, &t, 6);
+    u_secp_fe_mul(&t, &t, &x2);
+    u_secp_fe_sqr_n(r, &t, 2);
+
+    u_secp_fe_sqr(&t, r);
+    return u_secp_fe_equal(&t, a);
+}
+
+static void u_secp_fe_cmov(u_secp_fe *r, const u_secp_fe *a, u64 flag)
+{
+    unsigned i;
+    u64 mask;
+
+    mask = 0 - flag;
+    for (i = 0; i < 5; i++)
+        r->n[i] = (r->n[i] & ~mask) | (a->n[i] & mask);
+}
+
+/*** scalar **************************************************************/
+
+/* r = a + flag * (2^256 - n), returns the carry */
+static u64 u_secp_sc_add_nc(u64 *r, const u64 *a, u64 flag)
+{
+    unsigned i;
+    u64 mask;
+    u_secp_u128 acc;
+
+    mask = 0 - flag;
+    acc = 0;
+    for (i = 0; i < 4; i++)
+    {
+        acc += a[i];
+        if (i < 3)
+            acc += u_secp_nc[i] & mask;
+        r[i] = (u64)acc;
+        acc >>= 64;
+    }
+
+    return (u64)acc;
+}
+
+/* r = hi * 2^256 + d mod n for values < 2n, returns 1 if n was subtracted */
+static int u_secp_sc_reduce(u_secp_sc *r, const u64 *d, u64 hi)
+{
+    unsigned i;
+    u64 t[4];
+    u64 mask;
+
+    mask = 0 - (hi | u_secp_sc_add_nc(t, d, 1));
+    for (i = 0; i < 4; i++)
+        r->d[i] = (t[i] & mask) | (d[i] & ~mask);
+
+    return (int)(mask & 1);
+}
+
+/* Returns 1 if the value was >= n and got reduced. */
+static int u_secp_sc_set_b32(u_secp_sc *r, const u8 *b)
+{
+    unsigned i;
+    unsigned j;
+    u64 d[4];
+
+    for (i = 0; i < 4; i++)
+    {
+        d[i] = 0;
+        for (j = 0; j < 8; j++)
+            d[i] |= (u64)b[31 - i * 8 - j] << (j * 8);
+    }
+
+    return u_secp_sc_reduce(r, d, 0);
+}
+
+static void u_secp_sc_get_b32(u8 *b, const u_secp_sc *a)
+{
+    unsigned i;
+    unsigned j;
+
+    for (i = 0; i < 4; i++)
+    {
+        for (j = 0; j < 8; j++)
+            b[31 - i * 8 - j] = (u8)(a->d[i] >> (j * 8));
+    }
+}
+
+static int u_secp_sc_is_zero(const u_secp_sc *a)
+{
+    return (a->d[0] | a->d[1] | a->d[2] | a->d[3]) == 0;
+}
+
+static void u_secp_sc_add(u_secp_sc *r, const u_secp_sc *a, const u_secp_sc *b)
+{
+    unsigned i;
+    u64 d[4];
+    u_secp_u128 acc;
+
+    acc = 0;
+    for (i = 0; i < 4; i++)
+    {
+        acc += (u_secp_u128)a->d[i] + b->d[i];
+        d[i] = (u64)acc;
+        acc >>= 64;
+    }
+
+    u_secp_sc_reduce(r, d, (u64)acc);
+}
+
+static void u_secp_sc_negate(u_secp_sc *r, const u_secp_sc *a)
+{
+    unsigned i;
+    u64 mask;
+    u64 borrow;
+    u_secp_u128 t;
+
+    mask = 0 - (u64)!u_secp_sc_is_zero(a);
+    borrow = 0;
+    for (i = 0; i < 4; i++)
+    {
+        t = (u_secp_u128)u_secp_n[i] - a->d[i] - borrow;
+        r->d[i] = (u64)t & mask;
+        borrow = (u64)(t >> 64) & 1;
+    }
+}
+
+/* acc[0, len) += a[0, a_len) * (2^256 - n), the result must fit into len limbs */
+static void u_secp_sc_muladd_nc(u64 *acc, unsigned len, const u64 *a, unsigned a_len)
+{
+    unsigned i;
+    unsigned j;
+    u_secp_u128 t;
+
+    for (i = 0; i < a_len; i++)
+    {
+        t = 0;
+        for (j = 0; i + j < len; j++)
+        {
+            t += acc[i + j];
+            if (j < 3)
+                t += (u_secp_u128)a[i] * u_secp_nc[j];
+            acc[i + j] = (u64)t;
+            t >>= 64;
+        }
+    }
+}
+
+static void u_secp_sc_mul_512(u64 *l, const u_secp_sc *a, const u_secp_sc *b)
+{
+    unsigned i;
+    unsigned j;
+    u_secp_u128 t;
+
+    for (i = 0; i < 8; i++)
+        l[i] = 0;
+
+    for (i = 0; i < 4; i++)
+    {
+        t = 0;
+        for (j = 0; j < 4; j++)
+        {
+            t += (u_secp_u128)a->d[i] * b->d[j] + l[i + j];
+            l[i + j] = (u64)t;
+            t >>= 64;
+        }
+        l[i + 4] = (u64)t;
+    }
+}
+
+static void u_secp_sc_mul(u_secp_sc *r, const u_secp_sc *a, const u_secp_sc *b)
+{
+    u64 l[8];
+    u64 m[7];
+    u64 p[5];
+    u64 q[5];
+
+    u_secp_sc_mul_512(l, a, b);
+
+    /* 2^256 = 2^256 - n mod n, each step shrinks the value by 127 bits */
+    U_memcpy(m, l, 4 * sizeof(u64));
+    m[4] = m[5] = m[6] = 0;
+    u_secp_sc_muladd_nc(m, 7, &l[4], 4); /* < 2^386 */
+
+    U_memcpy(p, m, 4 * sizeof(u64));
+    p[4] = 0;
+    u_secp_sc_muladd_nc(p, 5, &m[4], 3); /* < 2^260 */
+
+    U_memcpy(q, p, 4 * sizeof(u64));
+    q[4] = 0;
+    u_secp_sc_muladd_nc(q, 5, &p[4], 1); /* < 2^256 + 2^133 */
+
+    u_secp_sc_reduce(r, q, q[4]);
+}
+
+/* a^(n - 2), the exponent is public so the window lookups don't leak */
+static void u_secp_sc_inv(u_secp_sc *r, const u_secp_sc *a)
+{
+    int i;
+    unsigned w;
+    u_secp_sc t[16];
+    static const u64 e[4] = {
+        0xBFD25E8CD036413FULL, 0xBAAEDCE6AF48A03BULL, 0xFFFFFFFFFFFFFFFEULL, 0xFFFFFFFFFFFFFFFFULL
+    };
+
+    U_bzero(&t[0], sizeof(t[0]));
+    t[0].d[0] = 1;
+    t[1] = *a;
+    for (i = 2; i < 16; i++)
+        u_secp_sc_mul(&t[i], &t[i - 1], a);
+
+    *r = t[0];
+    for (i = 63; i >= 0; i--)
+    {
+        u_secp_sc_mul(r, r, r);
+        u_secp_sc_mul(r, r, r);
+        u_secp_sc_mul(r, r, r);
+        u_secp_sc_mul(r, r, r);
+
+        w = (unsigned)(e[i >> 4] >> ((i & 15) * 4)) & 15;
+        if (w)
+            u_secp_sc_mul(r, r, &t[w]);
+    }
+}
+
+/* x = x / 2 mod n, x < n */
+static void u_secp_sc_half_var(u64 *x)
+{
+    unsigned i;
+    u64 hi;
+    u_secp_u128 t;
+
+    hi = 0;
+    if (x[0] & 1)
+    {
+        t = 0;
+        for (i = 0; i < 4; i++)
+        {
+            t += (u_secp_u128)x[i] + u_secp_n[i];
+            x[i] = (u64)t;
+            t >>= 64;
+        }
+        hi = (u64)t;
+    }
+
+    for (i = 0; i < 3; i++)
+        x[i] = x[i] >> 1 | x[i + 1] << 63;
+    x[3] = x[3] >> 1 | hi << 63;
+}
+
+static int u_secp_sc_cmp_var(const u64 *a, const u64 *b)
+{
+    int i;
+
+    for (i = 3; i >= 0; i--)
+    {
+        if (a[i] != b[i])
+            return a[i] > b[i] ? 1 : -1;
+    }
+
+    return 0;
+}
+
+/* a -= b, a >= b */
+static void u_secp_sc_sub_var(u64 *a, const u64 *b)
+{
+    unsigned i;
+    u64 borrow;
+    u_secp_u128 t;
+
+    borrow = 0;
+    for (i = 0; i < 4; i++)
+    {
+        t = (u_secp_u128)a[i] - b[i] - borrow;
+        a[i] = (u64)t;
+        borrow = (u64)(t >> 64) & 1;
+    }
+}
+
+/* Binary extended Euclid, variable time and only for public values, a != 0 */
+static void u_secp_sc_inv_var(u_secp_sc *r, const u_secp_sc *a)
+{
+    u64 u[4];
+    u64 v[4];
+    u_secp_sc x1;
+    u_secp_sc x2;
+    u_secp_sc t;
+    static const u64 one[4] = { 1, 0, 0, 0 };
+
+    U_memcpy(u, a->d, sizeof(u));
+    U_memcpy(v, u_secp_n, sizeof(v));
+    U_bzero(&x1, sizeof(x1));
+    U_bzero(&x2, sizeof(x2));
+    x1.d[0] = 1;
+
+    /* invariants: x1 * a = u, x2 * a = v mod n */
+    while (u_secp_sc_cmp_var(u, one) != 0 && u_secp_sc_cmp_var(v, one) != 0)
+    {
+        while ((u[0] & 1) == 0)
+        {
+            u_secp_sc_half_var(u);
+            u_secp_sc_half_var(x1.d);
+        }
+
+        while ((v[0] & 1) == 0)
+        {
+            u_secp_sc_half_var(v);
+            u_secp_sc_half_var(x2.d);
+        }
+
+        if (u_secp_sc_cmp_var(u, v) >= 0)
+        {
+            u_secp_sc_sub_var(u, v);
+            u_secp_sc_negate(&t, &x2);
+            u_secp_sc_add(&x1, &x1, &t);
+        }
+        else
+        {
+            u_secp_sc_sub_var(v, u);
+            u_secp_sc_negate(&t, &x1);
+            u_secp_sc_add(&x2, &x2, &t);
+        }
+    }
+
+    *r = u_secp_sc_cmp_var(u, one) == 0 ? x1 : x2;
+}
+
+/* round(a * b / 2^384) */
+static void u_secp_sc_mul_shift_384(u_secp_sc *r, const u_secp_sc *a, const u_secp_sc *b)
+{
+    u64 l[8];
+    u_secp_u128 t;
+
+    u_secp_sc_mul_512(l, a, b);
+    t = (u_secp_u128)l[6] + (l[5] >> 63);
+    r->d[0] = (u64)t;
+    r->d[1] = l[7] + (u64)(t >> 64);
+    r->d[2] = 0;
+    r->d[3] = 0;
+}
+
+/* k = r1 + r2 * lambda mod n, with r1, r2 or their negation < 2^128 */
+static void u_secp_sc_split_lambda(u_secp_sc *r1, u_secp_sc *r2, const u_secp_sc *k)
+{
+    u_secp_sc c1;
+    u_secp_sc c2;
+
+    u_secp_sc_mul_shift_384(&c1, k, &u_secp_g1);
+    u_secp_sc_mul_shift_384(&c2, k, &u_secp_g2);
+    u_secp_sc_mul(&c1, &c1, &u_secp_minus_b1);
+    u_secp_sc_mul(&c2, &c2, &u_secp_minus_b2);
+    u_secp_sc_add(r2, &c1, &c2);
+    u_secp_sc_mul(r1, r2, &u_secp_lambda);
+    u_secp_sc_negate(r1, r1);
+    u_secp_sc_add(r1, r1, k);
+}
+
+/* Width 'w' NAF of a scalar < 2^128, returns the number of digits. */
+static int u_secp_sc_wnaf(int *wnaf, const u_secp_sc *a, int w)
+{
+    int i;
+    int digit;
+    u64 s[3];
+
+    s[0] = a->d[0];
+    s[1] = a->d[1];
+    s[2] = 0;
+
+    for (i = 0; (s[0] | s[1] | s[2]) != 0; i++)
+    {
+        digit = 0;
+        if (s[0] & 1)
+        {
+            digit = (int)(s[0] & ((1u << w) - 1));
+            if (digit >= (1 << (w - 1)))
+                digit -= 1 << w;
+
+            /* s -= digit, the low bits of s are >= a positive digit */
+            if (digit > 0)
+            {
+                s[0] -= (u64)digit;
+            }
+            else
+            {
+                s[0] += (u64)-digit;
+                if (s[0] < (u64)-digit && ++s[1] == 0)
+                    s[2]++;
+            }
+        }
+
+        wnaf[i] = digit;
+        s[0] = s[0] >> 1 | s[1] << 63;
+        s[1] = s[1] >> 1 | s[2] << 63;
+        s[2] >>= 1;
+    }
+
+    return i;
+}
+
+/*** group ***************************************************************/
+
+static void u_secp_gej_set_ge(u_secp_gej *r, const u_secp_ge *a)
+{
+    r->x = a->x;
+    r->y = a->y;
+    u_secp_fe_set_int(&r->z, 1);
+    r->infinity = 0;
+}
+
+/* y^2 = x^3 + 7 */
+static int u_secp_ge_on_curve(const u_secp_ge *a)
+{
+    u_secp_fe t;
+    u_secp_fe y2;
+    u_secp_fe seven;
+
+    u_secp_fe_sqr(&t, &a->x);
+    u_secp_fe_mul(&t, &t, &a->x);
+    u_secp_fe_set_int(&seven, 7);
+    u_secp_fe_add(&t, &t, &seven);
+    u_secp_fe_sqr(&y2, &a->y);
+    return u_secp_fe_equal(&t, &y2);
+}
+
+/* Returns 0 if 'x' isn't on the curve. */
+static int u_secp_ge_set_x(u_secp_ge *r, const u_secp_fe *x, int odd)
+{
+    u_secp_fe t;
+    u_secp_fe seven;
+
+    u_secp_fe_sqr(&t, x);
+    u_secp_fe_mul(&t, &t, x);
+    u_secp_fe_set_int(&seven, 7);
+    u_secp_fe_add(&t, &t, &seven);
+
+    r->x = *x;
+    if (u_secp_fe_sqrt(&r->y, &t) == 0)
+        return 0;
+
+    if (u_secp_fe_is_odd(&r->y) != odd)
+        u_secp_fe_negate(&r->y, &r->y);
+
+    return 1;
+}
+
+static int u_secp_ge_set_b64(u_secp_ge *r, const u8 *b)
+{
+    if (u_secp_fe_set_b32(&r->x, &b[0]) == 0 || u_secp_fe_set_b32(&r->y, &b[32]) == 0)
+        return 0;
+
+    return u_secp_ge_on_curve(r);
+}
+
+static void u_secp_ge_set_gej(u_secp_ge *r, const u_secp_gej *a)
+{
+    u_secp_fe zi;
+    u_secp_fe zi2;
+
+    u_secp_fe_inv(&zi, &a->z);
+    u_secp_fe_sqr(&zi2, &zi);
+    u_secp_fe_mul(&r->x, &a->x, &zi2);
+    u_secp_fe_mul(&zi2, &zi2, &zi);
+    u_secp_fe_mul(&r->y, &a->y, &zi2);
+}
+
+/* Converts up to 64 points (not infinity) with one inversion. */
+static void u_secp_ge_set_all_gej(u_secp_ge *r, const u_secp_gej *a, unsigned count)
+{
+    unsigned i;
+    u_secp_fe zi;
+    u_secp_fe zi2;
+    u_secp_fe inv;
+    u_secp_fe prod[64];
+
+    prod[0] = a[0].z;
+    for (i = 1; i < count; i++)
+        u_secp_fe_mul(&prod[i], &prod[i - 1], &a[i].z);
+
+    u_secp_fe_inv(&inv, &prod[count - 1]);
+
+    for (i = count; i-- > 0;)
+    {
+        if (i > 0)
+        {
+            u_secp_fe_mul(&zi, &inv, &prod[i - 1]);
+            u_secp_fe_mul(&inv, &inv, &a[i].z);
+        }
+        else
+        {
+            zi = inv;
+        }
+
+        u_secp_fe_sqr(&zi2, &zi);
+        u_secp_fe_mul(&r[i].x, &a[i].x, &zi2);
+        u_secp_fe_mul(&zi2, &zi2, &zi);
+        u_secp_fe_mul(&r[i].y, &a[i].y, &zi2);
+    }
+}
+
+static void u_secp_gej_double(u_secp_gej *r, const u_secp_gej *a)
+{
+    u_secp_fe t_a;
+    u_secp_fe t_b;
+    u_secp_fe t_c;
+    u_secp_fe t_d;
+    u_secp_fe t_e;
+    u_secp_fe t_f;
+
+    /* dbl-2009-l, secp256k1 has no point with y = 0 */
+    r->infinity = a->infinity;
+    u_secp_fe_sqr(&t_a, &a->x);
+    u_secp_fe_sqr(&t_b, &a->y);
+    u_secp_fe_sqr(&t_c, &t_b);
+    u_secp_fe_add(&t_d, &a->x, &t_b);
+    u_secp_fe_sqr(&t_d, &t_d);
+    u_secp_fe_sub(&t_d, &t_d, &t_a);
+    u_secp_fe_sub(&t_d, &t_d, &t_c);
+    u_secp_fe_add(&t_d, &t_d, &t_d);
+    u_secp_fe_mul_int(&t_e, &t_a, 3);
+    u_secp_fe_sqr(&t_f, &t_e);
+
+    u_secp_fe_mul(&r->z, &a->y, &a->z);
+    u_secp_fe_add(&r->z, &r->z, &r->z);
+
+    u_secp_fe_sub(&r->x, &t_f, &t_d);
+    u_secp_fe_sub(&r->x, &r->x, &t_d);
+
+    u_secp_fe_sub(&t_d, &t_d, &r->x);
+    u_secp_fe_mul(&r->y, &t_e, &t_d);
+    u_secp_fe_mul_int(&t_c, &t_c, 8);
+    u_secp_fe_sub(&r->y, &r->y, &t_c);
+}
+
+/* Second half of an addition with h = u2 - u1, rr = s2 - s1, z = Z1 * Z2. */
+static void u_secp_gej_add_finish(u_secp_gej *r, const u_secp_fe *u1, const u_secp_fe *s1, const u_secp_fe *z,
+                                  const u_secp_fe *h, const u_secp_fe *rr)
+{
+    u_secp_fe hh;
+    u_secp_fe hhh;
+    u_secp_fe v;
+    u_secp_fe t;
+
+    u_secp_fe_sqr(&hh, h);
+    u_secp_fe_mul(&hhh, h, &hh);
+    u_secp_fe_mul(&v, u1, &hh);
+    u_secp_fe_mul(&t, s1, &hhh);
+    u_secp_fe_mul(&r->z, z, h);
+
+    u_secp_fe_sqr(&r->x, rr);
+    u_secp_fe_sub(&r->x, &r->x, &hhh);
+    u_secp_fe_sub(&r->x, &r->x, &v);
+    u_secp_fe_sub(&r->x, &r->x, &v);
+
+    u_secp_fe_sub(&v, &v, &r->x);
+    u_secp_fe_mul(&r->y, rr, &v);
+    u_secp_fe_sub(&r->y, &r->y, &t);
+    r->infinity = 0;
+}
+
+/* r = a + b, constant time, 'a' must not be infinity or +-b */
+static void u_secp_gej_add_ge(u_secp_gej *r, const u_secp_gej *a, const u_secp_ge *b)
+{
+    u_secp_fe z1z1;
+    u_secp_fe u2;
+    u_secp_fe s2;
+    u_secp_fe h;
+    u_secp_fe rr;
+    u_secp_fe x1;
+    u_secp_fe y1;
+    u_secp_fe z1;
+
+    x1 = a->x;
+    y1 = a->y;
+    z1 = a->z;
+    u_secp_fe_sqr(&z1z1, &z1);
+    u_secp_fe_mul(&u2, &b->x, &z1z1);
+    u_secp_fe_mul(&s2, &b->y, &z1z1);
+    u_secp_fe_mul(&s2, &s2, &z1);
+    u_secp_fe_sub(&h, &u2, &x1);
+    u_secp_fe_sub(&rr, &s2, &y1);
+    u_secp_gej_add_finish(r, &x1, &y1, &z1, &h, &rr);
+}
+
+static void u_secp_gej_add_ge_var(u_secp_gej *r, const u_secp_gej *a, const u_secp_ge *b)
+{
+    u_secp_fe z1z1;
+    u_secp_fe u2;
+    u_secp_fe s2;
+    u_secp_fe h;
+    u_secp_fe rr;
+    u_secp_fe x1;
+    u_secp_fe y1;
+    u_secp_fe z1;
+
+    if (a->infinity)
+    {
+        u_secp_gej_set_ge(r, b);
+        return;
+    }
+
+    x1 = a->x;
+    y1 = a->y;
+    z1 = a->z;
+    u_secp_fe_sqr(&z1z1, &z1);
+    u_secp_fe_mul(&u2, &b->x, &z1z1);
+    u_secp_fe_mul(&s2, &b->y, &z1z1);
+    u_secp_fe_mul(&s2, &s2, &z1);
+    u_secp_fe_sub(&h, &u2, &x1);
+    u_secp_fe_sub(&rr, &s2, &y1);
+
+    if (u_secp_fe_is_zero(&h))
+    {
+        if (u_secp_fe_is_zero(&rr))
+            u_secp_gej_double(r, a);
+        else
+            r->infinity = 1;
+        return;
+    }
+
+    u_secp_gej_add_finish(r, &x1, &y1, &z1, &h, &rr);
+}
+
+static void u_secp_gej_add_var(u_secp_gej *r, const u_secp_gej *a, const u_secp_gej *b)
+{
+    u_secp_fe z1z1;
+    u_secp_fe z2z2;
+    u_secp_fe u1;
+    u_secp_fe u2;
+    u_secp_fe s1;
+    u_secp_fe s2;
+    u_secp_fe h;
+    u_secp_fe rr;
+    u_secp_fe z;
+
+    if (a->infinity)
+    {
+        *r = *b;
+        return;
+    }
+
+    if (b->infinity)
+    {
+        *r = *a;
+        return;
+    }
+
+    u_secp_fe_sqr(&z1z1, &a->z);
+    u_secp_fe_sqr(&z2z2, &b->z);
+    u_secp_fe_mul(&u1, &a->x, &z2z2);
+    u_secp_fe_mul(&u2, &b->x, &z1z1);
+    u_secp_fe_mul(&s1, &a->y, &z2z2);
+    u_secp_fe_mul(&s1, &s1, &b->z);
+    u_secp_fe_mul(&s2, &b->y, &z1z1);
+    u_secp_fe_mul(&s2, &s2, &a->z);
+    u_secp_fe_sub(&h, &u2, &u1);
+    u_secp_fe_sub(&rr, &s2, &s1);
+
+    if (u_secp_fe_is_zero(&h))
+    {
+        if (u_secp_fe_is_zero(&rr))
+            u_secp_gej_double(r, a);
+        else
+            r->infinity = 1;
+        return;
+    }
+
+    u_secp_fe_mul(&z, &a->z, &b->z);
+    u_secp_gej_add_finish(r, &u1, &s1, &z, &h, &rr);
+}
+
+/* k * G, constant time */
+static void u_secp_mul_gen(u_secp_gej *r, const u_secp_sc *k)
+{
+    unsigned i;
+    unsigned j;
+    unsigned d;
+    u_secp_ge t;
+
+    for (i = 0; i < U_SECP_COMB_WINDOWS; i++)
+    {
+        d = (unsigned)(k->d[i >> 4] >> ((i & 15) * 4)) & 15;
+
+        /* read all entries to hide the index */
+        t = u_secp_comb[i][0];
+        for (j = 1; j < 16; j++)
+        {
+            u_secp_fe_cmov(&t.x, &u_secp_comb[i][j].x, ((u32)(d ^ j) - 1) >> 31);
+            u_secp_fe_cmov(&t.y, &u_secp_comb[i][j].y, ((u32)(d ^ j) - 1) >> 31);
+        }
+
+        if (i == 0)
+            u_secp_gej_set_ge(r, &t);
+        else
+            u_secp_gej_add_ge(r, r, &t);
+    }
+}
+
+/* r[i] = (2i + 1) * a for i < count */
+static void u_secp_odd_multiples(u_secp_ge *r, const u_secp_ge *a, unsigned count)
+{
+    unsigned i;
+    u_secp_gej d;
+    u_secp_gej pts[64];
+
+    u_secp_gej_set_ge(&pts[0], a);
+    u_secp_gej_double(&d, &pts[0]);
+    for (i = 1; i < count; i++)
+        u_secp_gej_add_var(&pts[i], &pts[i - 1], &d);
+
+    u_secp_ge_set_all_gej(r, pts, count);
+}
+
+/* Adds the odd multiple of a wNAF digit, of lambda * the point if 'lam' is set. */
+static void u_secp_add_digit_var(u_secp_gej *r, const u_secp_ge *pre, int digit, int lam, int neg)
+{
+    u_secp_ge p;
+
+    p = pre[(digit < 0 ? -digit : digit) >> 1];
+    if (lam)
+        u_secp_fe_mul(&p.x, &p.x, &u_secp_fe_beta);
+    if ((digit < 0) != neg)
+        u_secp_fe_negate(&p.y, &p.y);
+
+    u_secp_gej_add_ge_var(r, r, &p);
+}
+
+/* r = na * A + ng * G, variable time.
+ *
+ * 'pre_a' holds the odd multiples A, 3A, .. for wNAF window 'wa'. Both
+ * scalars are split into 128-bit halves with the endomorphism, the four
+ * wNAFs share the doublings.
+ */
+static void u_secp_ecmult_var(u_secp_gej *r, const u_secp_ge *pre_a, int wa, const u_secp_sc *na, const u_secp_sc *ng)
+{
+    int i;
+    int j;
+    int bits;
+    int len[4];
+    int neg[4];
+    int wnaf[4][130];
+    u_secp_sc k[4];
+
+    u_secp_sc_split_lambda(&k[0], &k[1], na);
+    u_secp_sc_split_lambda(&k[2], &k[3], ng);
+
+    bits = 0;
+    for (j = 0; j < 4; j++)
+    {
+        neg[j] = (k[j].d[2] | k[j].d[3]) != 0;
+        if (neg[j])
+            u_secp_sc_negate(&k[j], &k[j]);
+
+        len[j] = u_secp_sc_wnaf(wnaf[j], &k[j], j < 2 ? wa : U_SECP_WINDOW_G);
+        if (len[j] > bits)
+            bits = len[j];
+    }
+
+    U_bzero(r, sizeof(*r));
+    r->infinity = 1;
+
+    for (i = bits - 1; i >= 0; i--)
+    {
+        u_secp_gej_double(r, r);
+
+        for (j = 0; j < 4; j++)
+        {
+            if (i < len[j] && wnaf[j][i])
+                u_secp_add_digit_var(r, j < 2 ? pre_a : u_secp_pre_g, wnaf[j][i], j & 1, neg[j]);
+        }
+    }
+}
+
+void U_secp256k1_init(void)
+{
+    unsigned i;
+    unsigned j;
+    u8 seed[32];
+    u_secp_fe x;
+    u_secp_ge g;
+    u_secp_ge h;
+    u_secp_gej base;
+    u_secp_gej off;
+    u_secp_gej u;
+    u_secp_gej sum;
+    u_secp_gej pts[16];
+
+    if (u_secp_ready)
+        return;
+
+    u_secp_fe_set_b32(&u_secp_fe_beta, u_secp_beta);
+    u_secp_ge_set_b64(&g, u_secp_g);
+
+    /* offset point, x is the first valid value >= SHA-256 of the label */
+    U_sha256("secp256k1 comb offset", 21, seed);
+    u_secp_fe_set_b32(&x, seed);
+    while (u_secp_ge_set_x(&h, &x, 0) == 0)
+        x.n[0] += 1;
+
+    u_secp_gej_set_ge(&base, &g);
+    u_secp_gej_set_ge(&u, &h);
+    sum.infinity = 1;
+
+    for (i = 0; i < U_SECP_COMB_WINDOWS; i++)
+    {
+        /* U_i = 2^i * H, the last one cancels the sum of the others */
+        if (i < U_SECP_COMB_WINDOWS - 1)
+        {
+            off = u;
+            u_secp_gej_add_var(&sum, &sum, &u);
+            u_secp_gej_double(&u, &u);
+        }
+        else
+        {
+            off = sum;
+            u_secp_fe_negate(&off.y, &off.y);
+        }
+
+        pts[0] = off;
+        for (j = 1; j < 16; j++)
+            u_secp_gej_add_var(&pts[j], &pts[j - 1], &base);
+
+        u_secp_ge_set_all_gej(&u_secp_comb[i][0], pts, 16);
+
+        for (j = 0; j < 4; j++)
+            u_secp_gej_double(&base, &base);
+    }
+
+    u_secp_odd_multiples(u_secp_pre_g, &g, 1 << (U_SECP_WINDOW_G - 2));
+    u_secp_ready = 1;
+}
+
+static void u_secp_hmac_init(U_Sha256 *ctx, const u8 *key)
+{
+    unsigned i;
+    u8 pad[U_SHA256_BLOCK_SIZE];
+
+    for (i = 0; i < U_SHA256_BLOCK_SIZE; i++)
+        pad[i] = (i < U_SHA256_DIGEST_SIZE ? key[i] : 0) ^ 0x36;
+
+    U_sha256_init(ctx);
+    U_sha256_update(ctx, pad, sizeof(pad));
+}
+
+/* 'out' may be 'key' */
+static void u_secp_hmac_final(U_Sha256 *ctx, const u8 *key, u8 *out)
+{
+    unsigned i;
+    u8 inner[U_SHA256_DIGEST_SIZE];
+    u8 pad[U_SHA256_BLOCK_SIZE];
+
+    U_sha256_final(ctx, inner);
+
+    for (i = 0; i < U_SHA256_BLOCK_SIZE; i++)
+        pad[i] = (i < U_SHA256_DIGEST_SIZE ? key[i] : 0) ^ 0x5C;
+
+    U_sha256_init(ctx);
+    U_sha256_update(ctx, pad, sizeof(pad));
+    U_sha256_update(ctx, inner, sizeof(inner));
+    U_sha256_final(ctx, out);
+}
+
+int U_secp256k1_compute_public_key(const u8 *private_key, u8 *public_key)
+{
+    u_secp_sc d;
+    u_secp_gej r;
+    u_secp_ge p;
+
+    U_secp256k1_init();
+
+    if (u_secp_sc_set_b32(&d, private_key) || u_secp_sc_is_zero(&d))
+        return 0;
+
+    u_secp_mul_gen(&r, &d);
+    u_secp_ge_set_gej(&p, &r);
+    u_secp_fe_get_b32(&public_key[0], &p.x);
+    u_secp_fe_get_b32(&public_key[32], &p.y);
+    return 1;
+}
+
+int U_secp256k1_valid_public_key(const u8 *public_key)
+{
+    u_secp_ge p;
+
+    return u_secp_ge_set_b64(&p, public_key);
+}
+
+void U_secp256k1_compress(const u8 *public_key, u8 *compressed)
+{
+    compressed[0] = 2 + (public_key[63] & 1);
+    U_memcpy(&compressed[1], public_key, 32);
+}
+
+int U_secp256k1_decompress(const u8 *compressed, u8 *public_key)
+{
+    u_secp_fe x;
+    u_secp_ge p;
+
+    if ((compressed[0] != 2 && compressed[0] != 3) || u_secp_fe_set_b32(&x, &compressed[1]) == 0)
+        return 0;
+
+    if (u_secp_ge_set_x(&p, &x, compressed[0] == 3) == 0)
+        return 0;
+
+    u_secp_fe_get_b32(&public_key[0], &p.x);
+    u_secp_fe_get_b32(&public_key[32], &p.y);
+    return 1;
+}
+
+int U_secp256k1_sign(const u8 *private_key, const u8 *hash, u8 *signature)
+{
+    unsigned i;
+    unsigned tries;
+    u8 K[U_SHA256_DIGEST_SIZE];
+    u8 V[U_SHA256_DIGEST_SIZE + 1];
+    u8 kb[32];
+    u8 buf[32];
+    U_Sha256 ctx;
+    u_secp_sc d;
+    u_secp_sc e;
+    u_secp_sc k;
+    u_secp_sc r;
+    u_secp_sc s;
+    u_secp_gej rj;
+    u_secp_ge rp;
+
+    U_secp256k1_init();
+
+    if (u_secp_sc_set_b32(&d, private_key) || u_secp_sc_is_zero(&d))
+        return 0;
+
+    u_secp_sc_set_b32(&e, hash);
+
+    /* HMAC-DRBG seeded like uECC_sign_deterministic(): K = 0, V = 1,
+       K = HMAC_K(V | 0x00 | x | h), V = HMAC_K(V), same with 0x01 */
+    for (i = 0; i < U_SHA256_DIGEST_SIZE; i++)
+    {
+        K[i] = 0x00;
+        V[i] = 0x01;
+    }
+
+    for (i = 0; i < 2; i++)
+    {
+        V[U_SHA256_DIGEST_SIZE] = (u8)i;
+        u_secp_hmac_init(&ctx, K);
+        U_sha256_update(&ctx, V, U_SHA256_DIGEST_SIZE + 1);
+        U_sha256_update(&ctx, private_key, 32);
+        U_sha256_update(&ctx, hash, 32);
+        u_secp_hmac_final(&ctx, K, K);
+
+        u_secp_hmac_init(&ctx, K);
+        U_sha256_update(&ctx, V, U_SHA256_DIGEST_SIZE);
+        u_secp_hmac_final(&ctx, K, V);
+    }
+
+    for (tries = 0; tries < 64; tries++)
+    {
+        u_secp_hmac_init(&ctx, K);
+        U_sha256_update(&ctx, V, U_SHA256_DIGEST_SIZE);
+        u_secp_hmac_final(&ctx, K, V);
+
+        /* uECC reads k as native little endian words */
+        for (i = 0; i < 32; i++)
+            kb[i] = V[31 - i];
+
+        if (u_secp_sc_set_b32(&k, kb) == 0 && u_secp_sc_is_zero(&k) == 0)
+        {
+            u_secp_mul_gen(&rj, &k);
+            u_secp_ge_set_gej(&rp, &rj);
+            u_secp_fe_get_b32(buf, &rp.x);
+            u_secp_sc_set_b32(&r, buf);
+
+            /* s = (e + r * d) / k */
+            u_secp_sc_mul(&s, &r, &d);
+            u_secp_sc_add(&s, &s, &e);
+            u_secp_sc_inv(&k, &k);
+            u_secp_sc_mul(&s, &s, &k);
+
+            if (u_secp_sc_is_zero(&r) == 0 && u_secp_sc_is_zero(&s) == 0)
+            {
+                u_secp_sc_get_b32(&signature[0], &r);
+                u_secp_sc_get_b32(&signature[32], &s);
+                return 1;
+            }
+        }
+
+        /* K = HMAC_K(V | 0x00), V = HMAC_K(V) */
+        V[U_SHA256_DIGEST_SIZE] = 0x00;
+        u_secp_hmac_init(&ctx, K);
+        U_sha256_update(&ctx, V, U_SHA256_DIGEST_SIZE + 1);
+        u_secp_hmac_final(&ctx, K, K);
+
+        u_secp_hmac_init(&ctx, K);
+        U_sha256_update(&ctx, V, U_SHA256_DIGEST_SIZE);
+        u_secp_hmac_final(&ctx, K, V);
+    }
+
+    return 0;
+}
+
+/* Verifies with the odd multiples of the public key for wNAF window 'w'. */
+static int u_secp_verify_pre(const u_secp_ge *pre, int w, const u8 *hash, const u8 *signature)
+{
+    int i;
+    u64 rn[4];
+    u8 buf[32];
+    u_secp_u128 t;
+    u_secp_sc r;
+    u_secp_sc s;
+    u_secp_sc e;
+    u_secp_sc u1;
+    u_secp_sc u2;
+    u_secp_gej acc;
+    u_secp_fe x;
+    u_secp_fe zz;
+
+    U_secp256k1_init();
+
+    if (u_secp_sc_set_b32(&r, &signature[0]) || u_secp_sc_is_zero(&r) ||
+        u_secp_sc_set_b32(&s, &signature[32]) || u_secp_sc_is_zero(&s))
+        return 0;
+
+    /* R = u1 * G + u2 * Q, u1 = e / s, u2 = r / s */
+    u_secp_sc_set_b32(&e, hash);
+    u_secp_sc_inv_var(&s, &s);
+    u_secp_sc_mul(&u1, &e, &s);
+    u_secp_sc_mul(&u2, &r, &s);
+
+    u_secp_ecmult_var(&acc, pre, w, &u2, &u1);
+
+    if (acc.infinity)
+        return 0;
+
+    /* x(R) mod n == r, compared as r * Z^2 == X without inversion; if
+       r + n < p, x(R) might be r + n as well */
+    u_secp_fe_sqr(&zz, &acc.z);
+    u_secp_sc_get_b32(buf, &r);
+    u_secp_fe_set_b32(&x, buf);
+    u_secp_fe_mul(&x, &x, &zz);
+    if (u_secp_fe_equal(&x, &acc.x))
+        return 1;
+
+    t = 0;
+    for (i = 0; i < 4; i++)
+    {
+        t += (u_secp_u128)r.d[i] + u_secp_n[i];
+        rn[i] = (u64)t;
+        t >>= 64;
+    }
+
+    if (t == 0)
+    {
+        U_memcpy(&s.d[0], rn, sizeof(rn));
+        u_secp_sc_get_b32(buf, &s);
+        if (u_secp_fe_set_b32(&x, buf))
+        {
+            u_secp_fe_mul(&x, &x, &zz);
+            if (u_secp_fe_equal(&x, &acc.x))
+                return 1;
+        }
+    }
+
+    return 0;
+}
+
+int U_secp256k1_verify(const u8 *public_key, const u8 *hash, const u8 *signature)
+{
+    u_secp_ge q;
+    u_secp_ge pre[1 << (U_SECP_WINDOW_A - 2)];
+
+    if (u_secp_ge_set_b64(&q, public_key) == 0)
+        return 0;
+
+    u_secp_odd_multiples(pre, &q, 1 << (U_SECP_WINDOW_A - 2));
+    return u_secp_verify_pre(pre, U_SECP_WINDOW_A, hash, signature);
+}
+
+int U_secp256k1_prepare_key(U_Secp256k1_Key *key, const u8 *public_key)
+{
+    u_secp_ge q;
+
+    U_ASSERT(sizeof(key->table) == U_SECP256K1_KEY_POINTS * sizeof(u_secp_ge));
+
+    if (u_secp_ge_set_b64(&q, public_key) == 0)
+        return 0;
+
+    u_secp_odd_multiples((u_secp_ge*)key->table, &q, U_SECP256K1_KEY_POINTS);
+    return 1;
+}
+
+int U_secp256k1_verify_key(const U_Secp256k1_Key *key, const u8 *hash, const u8 *signature)
+{
+    return u_secp_verify_pre((const u_secp_ge*)key->table, U_SECP_WINDOW_G, hash, signature);
+}
+
+#endif /* U_SECP256K1_SUPPORTED */
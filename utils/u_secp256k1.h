@@ -0,0 +1,66 @@
+#ifndef U_SECP256K1_H
+#define U_SECP256K1_H
+
+/* secp256k1 ECDSA for 64-bit hosts.
+
+   Field elements use 5 x 52-bit limbs with 128-bit products. Multiples
+   of the generator come from a comb table, which is computed on first
+   use (85 KB together with the odd multiples of G). Verification splits
+   both scalars with the GLV endomorphism and adds the four 128-bit
+   halves by wNAF in one pass.
+
+   Keys and signatures use the formats of uECC: 32 byte private keys,
+   64 byte public keys x | y, 33 byte compressed keys and 64 byte
+   signatures r | s, all big endian. U_secp256k1_sign() creates the same
+   signatures as uECC_sign_deterministic() with SHA-256.
+
+   Needs a compiler with unsigned __int128, U_SECP256K1_SUPPORTED is
+   defined if it is available.
+*/
+
+#if defined(__SIZEOF_INT128__) && defined(_U_HAS_U64_TYPE)
+#define U_SECP256K1_SUPPORTED
+#endif
+
+#define U_SECP256K1_PRIVATE_KEY_SIZE 32
+#define U_SECP256K1_PUBLIC_KEY_SIZE  64
+#define U_SECP256K1_COMPRESSED_SIZE  33
+#define U_SECP256K1_SIGNATURE_SIZE   64
+
+/* Computes the comb table, the other functions call it on first use.
+   Call it before starting threads which use this module. */
+void U_secp256k1_init(void);
+
+/* Returns 0 if the private key isn't in range [1, n - 1]. */
+int U_secp256k1_compute_public_key(const u8 *private_key, u8 *public_key);
+
+int U_secp256k1_valid_public_key(const u8 *public_key);
+void U_secp256k1_compress(const u8 *public_key, u8 *compressed);
+
+/* Returns 0 if 'compressed' isn't a point on the curve. */
+int U_secp256k1_decompress(const u8 *compressed, u8 *public_key);
+
+/* Deterministic signature over a 32 byte hash (RFC 6979 style, as uECC). */
+int U_secp256k1_sign(const u8 *private_key, const u8 *hash, u8 *signature);
+
+/* Returns 1 if the signature over the 32 byte hash is valid. */
+int U_secp256k1_verify(const u8 *public_key, const u8 *hash, const u8 *signature);
+
+#ifdef U_SECP256K1_SUPPORTED
+/* Public key with the odd multiples P, 3P, .. 127P in affine coordinates
+   (5 KB), for many verifications with the same key. */
+#define U_SECP256K1_KEY_POINTS 64
+
+typedef struct U_Secp256k1_Key
+{
+    u64 table[U_SECP256K1_KEY_POINTS * 10];
+} U_Secp256k1_Key;
+
+/* Returns 0 if the public key isn't valid. */
+int U_secp256k1_prepare_key(U_Secp256k1_Key *key, const u8 *public_key);
+
+/* Same as U_secp256k1_verify() with a key from U_secp256k1_prepare_key(). */
+int U_secp256k1_verify_key(const U_Secp256k1_Key *key, const u8 *hash, const u8 *signature);
+#endif
+
+#endif /* U_SECP256K1_H */
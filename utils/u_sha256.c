@@ -0,0 +1,797 @@
+static const u32 u_sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define U_SHA256_ROR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static u32 u_sha256_load32(const u8 *p)
+{
+    return (u32)p[0] << 24 | (u32)p[1] << 16 | (u32)p[2] << 8 | (u32)p[3];
+}
+
+static void u_sha256_store32(u8 *p, u32 v)
+{
+    p[0] = (u8)(v >> 24);
+    p[1] = (u8)(v >> 16);
+    p[2] = (u8)(v >> 8);
+    p[3] = (u8)v;
+}
+
+/* Processes 'count' 64 byte blocks, portable version. */
+static void u_sha256_compress_c(u32 *state, const u8 *data, unsigned long count)
+{
+    unsigned i;
+    u32 w[64];
+    u32 a, b, c, d, e, f, g, h;
+    u32 t0, t1;
+
+    for (; count; count--, data += U_SHA256_BLOCK_SIZE)
+    {
+        for (i = 0; i < 16; i++)
+            w[i] = u_sha256_load32(&data[i * 4]);
+
+        for (i = 16; i < 64; i++)
+        {
+            t0 = U_SHA256_ROR(w[i - 15], 7) ^ U_SHA256_ROR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            t1 = U_SHA256_ROR(w[i - 2], 17) ^ U_SHA256_ROR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + t0 + w[i - 7] + t1;
+        }
+
+        a = state[0]; b = state[1]; c = state[2]; d = state[3];
+        e = state[4]; f = state[5]; g = state[6]; h = state[7];
+
+        for (i = 0; i < 64; i++)
+        {
+            t0 = h + (U_SHA256_ROR(e, 6) ^ U_SHA256_ROR(e, 11) ^ U_SHA256_ROR(e, 25)) +
+                 (g ^ (e & (f ^ g))) + u_sha256_k[i] + w[i];
+            t1 = (U_SHA256_ROR(a, 2) ^ U_SHA256_ROR(a, 13) ^ U_SHA256_ROR(a, 22)) +
+                 ((a & b) | (c & (a | b)));
+            h = g; g = f; f = e;
+            e = d + t0;
+            d = c; c = b; b = a;
+            a = t0 + t1;
+        }
+
+        state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+        state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+    }
+}
+
+/* Hardware SHA-256 instructions, selected at runtime when the CPU has them.
+   Define U_SHA256_NO_HW to build only the portable version.
+ */
+#ifndef U_SHA256_NO_HW
+  #if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+    #define U_SHA256_X86
+    #define U_SHA256_X86_TARGET __attribute__((target("sha,sse4.1,ssse3")))
+    #include <immintrin.h>
+    #include <cpuid.h>
+  #elif (defined(_M_X64) || defined(_M_IX86)) && defined(_MSC_VER)
+    #define U_SHA256_X86
+    #define U_SHA256_X86_TARGET
+    #include <immintrin.h>
+    #include <intrin.h>
+  #elif defined(__aarch64__) && defined(__GNUC__) && (defined(__linux__) || defined(__APPLE__))
+    #define U_SHA256_ARM
+    #ifdef __clang__
+      #define U_SHA256_ARM_TARGET __attribute__((target("crypto")))
+    #else
+      #define U_SHA256_ARM_TARGET __attribute__((target("+crypto")))
+    #endif
+    #include <arm_neon.h>
+    #ifdef __linux__
+      #include <sys/auxv.h>
+      #ifndef HWCAP_SHA2
+        #define HWCAP_SHA2 (1 << 6)
+      #endif
+    #endif
+  #endif
+#endif
+
+#ifdef U_SHA256_X86
+
+/* 4 rounds with the message words w0, the next words are scheduled in w0 */
+#define U_SHA256_X86_ROUNDS(i, w0, w1, w2, w3) \
+    msg = _mm_add_epi32(w0, _mm_loadu_si128((const __m128i*)&u_sha256_k[(i) * 4])); \
+    state1 = _mm_sha256rnds2_epu32(state1, state0, msg); \
+    state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(msg, 0x0E)); \
+    if ((i) < 12) \
+    { \
+        tmp = _mm_add_epi32(_mm_sha256msg1_epu32(w0, w1), _mm_alignr_epi8(w3, w2, 4)); \
+        w0 = _mm_sha256msg2_epu32(tmp, w3); \
+    }
+
+/* SHA extensions (SHA-NI), the state is kept as ABEF and CDGH */
+U_SHA256_X86_TARGET
+static void u_sha256_compress_x86(u32 *state, const u8 *data, unsigned long count)
+{
+    __m128i state0;
+    __m128i state1;
+    __m128i save0;
+    __m128i save1;
+    __m128i tmp;
+    __m128i msg;
+    __m128i w0, w1, w2, w3;
+    const __m128i mask = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+
+    tmp = _mm_loadu_si128((const __m128i*)&state[0]);
+    state1 = _mm_loadu_si128((const __m128i*)&state[4]);
+    tmp = _mm_shuffle_epi32(tmp, 0xB1);              /* CDAB */
+    state1 = _mm_shuffle_epi32(state1, 0x1B);        /* EFGH */
+    state0 = _mm_alignr_epi8(tmp, state1, 8);        /* ABEF */
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);     /* CDGH */
+
+    for (; count; count--, data += U_SHA256_BLOCK_SIZE)
+    {
+        save0 = state0;
+        save1 = state1;
+
+        w0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)&data[0]), mask);
+        w1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)&data[16]), mask);
+        w2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)&data[32]), mask);
+        w3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)&data[48]), mask);
+
+        U_SHA256_X86_ROUNDS(0, w0, w1, w2, w3)
+        U_SHA256_X86_ROUNDS(1, w1, w2, w3, w0)
+        U_SHA256_X86_ROUNDS(2, w2, w3, w0, w1)
+        U_SHA256_X86_ROUNDS(3, w3, w0, w1, w2)
+        U_SHA256_X86_ROUNDS(4, w0, w1, w2, w3)
+        U_SHA256_X86_ROUNDS(5, w1, w2, w3, w0)
+        U_SHA256_X86_ROUNDS(6, w2, w3, w0, w1)
+        U_SHA256_X86_ROUNDS(7, w3, w0, w1, w2)
+        U_SHA256_X86_ROUNDS(8, w0, w1, w2, w3)
+        U_SHA256_X86_ROUNDS(9, w1, w2, w3, w0)
+        U_SHA256_X86_ROUNDS(10, w2, w3, w0, w1)
+        U_SHA256_X86_ROUNDS(11, w3, w0, w1, w2)
+        U_SHA256_X86_ROUNDS(12, w0, w1, w2, w3)
+        U_SHA256_X86_ROUNDS(13, w1, w2, w3, w0)
+        U_SHA256_X86_ROUNDS(14, w2, w3, w0, w1)
+        U_SHA256_X86_ROUNDS(15, w3, w0, w1, w2)
+
+        state0 = _mm_add_epi32(state0, save0);
+        state1 = _mm_add_epi32(state1, save1);
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1B);           /* FEBA */
+    state1 = _mm_shuffle_epi32(state1, 0xB1);        /* DCHG */
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);     /* DCBA */
+    state1 = _mm_alignr_epi8(state1, tmp, 8);        /* HGFE */
+
+    _mm_storeu_si128((__m128i*)&state[0], state0);
+    _mm_storeu_si128((__m128i*)&state[4], state1);
+}
+
+/* regs: eax, ebx, ecx, edx of CPUID leaf, subleaf 0 */
+static void u_sha256_cpuid(unsigned leaf, unsigned *regs)
+{
+#ifdef _MSC_VER
+    int info[4];
+
+    __cpuidex(info, (int)leaf, 0);
+    regs[0] = (unsigned)info[0];
+    regs[1] = (unsigned)info[1];
+    regs[2] = (unsigned)info[2];
+    regs[3] = (unsigned)info[3];
+#else
+    if (__get_cpuid_max(0, 0) < leaf)
+    {
+        regs[0] = regs[1] = regs[2] = regs[3] = 0;
+        return;
+    }
+    __cpuid_count(leaf, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+static int u_sha256_has_hw(void)
+{
+    unsigned regs[4];
+
+    u_sha256_cpuid(1, regs);
+    if ((regs[2] & (1 << 19)) == 0 || (regs[2] & (1 << 9)) == 0) /* SSE4.1, SSSE3 */
+        return 0;
+
+    u_sha256_cpuid(7, regs);
+    return (regs[1] & (1 << 29)) != 0; /* SHA */
+}
+
+#define u_sha256_compress_hw u_sha256_compress_x86
+
+#endif /* U_SHA256_X86 */
+
+#ifdef U_SHA256_ARM
+
+/* 4 rounds with the message words w0, the next words are scheduled in w0 */
+#define U_SHA256_ARM_ROUNDS(i, w0, w1, w2, w3) \
+    msg = vaddq_u32(w0, vld1q_u32(&u_sha256_k[(i) * 4])); \
+    if ((i) < 12) \
+        w0 = vsha256su1q_u32(vsha256su0q_u32(w0, w1), w2, w3); \
+    abcd = state0; \
+    state0 = vsha256hq_u32(state0, state1, msg); \
+    state1 = vsha256h2q_u32(state1, abcd, msg);
+
+/* ARMv8 cryptography extensions */
+U_SHA256_ARM_TARGET
+static void u_sha256_compress_arm(u32 *state, const u8 *data, unsigned long count)
+{
+    uint32x4_t state0;
+    uint32x4_t state1;
+    uint32x4_t save0;
+    uint32x4_t save1;
+    uint32x4_t abcd;
+    uint32x4_t msg;
+    uint32x4_t w0, w1, w2, w3;
+
+    state0 = vld1q_u32(&state[0]);
+    state1 = vld1q_u32(&state[4]);
+
+    for (; count; count--, data += U_SHA256_BLOCK_SIZE)
+    {
+        save0 = state0;
+        save1 = state1;
+
+        w0 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(&data[0])));
+        w1 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(&data[16])));
+        w2 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(&data[32])));
+        w3 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(&data[48])));
+
+        U_SHA256_ARM_ROUNDS(0, w0, w1, w2, w3)
+        U_SHA256_ARM_ROUNDS(1, w1, w2, w3, w0)
+        U_SHA256_ARM_ROUNDS(2, w2, w3, w0, w1)
+        U_SHA256_ARM_ROUNDS(3, w3, w0, w1, w2)
+        U_SHA256_ARM_ROUNDS(4, w0, w1, w2, w3)
+        U_SHA256_ARM_ROUNDS(5, w1, w2, w3, w0)
+        U_SHA256_ARM_ROUNDS(6, w2, w3, w0, w1)
+        U_SHA256_ARM_ROUNDS(7, w3, w0, w1, w2)
+        U_SHA256_ARM_ROUNDS(8, w0, w1, w2, w3)
+        U_SHA256_ARM_ROUNDS(9, w1, w2, w3, w0)
+        U_SHA256_ARM_ROUNDS(10, w2, w3, w0, w1)
+        U_SHA256_ARM_ROUNDS(11, w3, w0, w1, w2)
+        U_SHA256_ARM_ROUNDS(12, w0, w1, w2, w3)
+        U_SHA256_ARM_ROUNDS(13, w1, w2, w3, w0)
+        U_SHA256_ARM_ROUNDS(14, w2, w3, w0, w1)
+        U_SHA256_ARM_ROUNDS(15, w3, w0, w1, w2)
+
+        state0 = vaddq_u32(state0, save0);
+        state1 = vaddq_u32(state1, save1);
+    }
+
+    vst1q_u32(&state[0], state0);
+    vst1q_u32(&state[4], state1);
+}
+
+static int u_sha256_has_hw(void)
+{
+#ifdef __APPLE__
+    return 1; /* all Apple ARM64 CPUs */
+#else
+    return (getauxval(AT_HWCAP) & HWCAP_SHA2) != 0;
+#endif
+}
+
+#define u_sha256_compress_hw u_sha256_compress_arm
+
+#endif /* U_SHA256_ARM */
+
+typedef void (*u_sha256_compress_func)(u32 *state, const u8 *data, unsigned long count);
+
+/* Selected on first use, all threads select the same function. */
+static u_sha256_compress_func u_sha256_compress;
+
+/* Multi-buffer engines hash independent messages in SIMD lanes, one
+   message per 32-bit lane. 'state' holds the 8 state words transposed:
+   state[word * lanes + lane]. Each call processes 'count' blocks of every
+   lane starting at data[lane].
+ */
+typedef void (*u_sha256_multi_func)(u32 *state, const u8 **data, unsigned long count);
+
+#ifdef U_SHA256_X86
+
+#ifdef _MSC_VER
+  #define U_SHA256_AVX2_TARGET
+  #define U_SHA256_AVX512_TARGET
+#else
+  #define U_SHA256_AVX2_TARGET __attribute__((target("avx2")))
+  #define U_SHA256_AVX512_TARGET __attribute__((target("avx512f,avx2")))
+#endif
+
+/* Loads 32 bytes of 8 lanes as big endian words and transposes them,
+   w[i] gets word i of all lanes.
+ */
+U_SHA256_AVX2_TARGET
+static void u_sha256_load8x8(__m256i *w, const u8 **data, unsigned long offset)
+{
+    unsigned i;
+    __m256i r[8];
+    __m256i t[8];
+    const __m256i bswap = _mm256_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+                                          12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+
+    for (i = 0; i < 8; i++)
+        r[i] = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)&data[i][offset]), bswap);
+
+    for (i = 0; i < 8; i += 2)
+    {
+        t[i] = _mm256_unpacklo_epi32(r[i], r[i + 1]);
+        t[i + 1] = _mm256_unpackhi_epi32(r[i], r[i + 1]);
+    }
+
+    for (i = 0; i < 8; i += 4)
+    {
+        r[i] = _mm256_unpacklo_epi64(t[i], t[i + 2]);
+        r[i + 1] = _mm256_unpackhi_epi64(t[i], t[i + 2]);
+        r[i + 2] = _mm256_unpacklo_epi64(t[i + 1], t[i + 3]);
+        r[i + 3] = _mm256_unpackhi_epi64(t[i + 1], t[i + 3]);
+    }
+
+    for (i = 0; i < 4; i++)
+    {
+        w[i] = _mm256_permute2x128_si256(r[i], r[i + 4], 0x20);
+        w[i + 4] = _mm256_permute2x128_si256(r[i], r[i + 4], 0x31);
+    }
+}
+
+#define U_SHA256_AVX2_ROR(x, n) _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+
+/* 8 lanes with AVX2 */
+U_SHA256_AVX2_TARGET
+static void u_sha256_multi_avx2(u32 *state, const u8 **data, unsigned long count)
+{
+    unsigned i;
+    unsigned long block;
+    __m256i s[8];
+    __m256i v[8];
+    __m256i w[16];
+    __m256i t0;
+    __m256i t1;
+
+    for (i = 0; i < 8; i++)
+        s[i] = _mm256_loadu_si256((const __m256i*)&state[i * 8]);
+
+    for (block = 0; block < count; block++)
+    {
+        u_sha256_load8x8(&w[0], data, block * U_SHA256_BLOCK_SIZE);
+        u_sha256_load8x8(&w[8], data, block * U_SHA256_BLOCK_SIZE + 32);
+
+        for (i = 0; i < 8; i++)
+            v[i] = s[i];
+
+        for (i = 0; i < 64; i++)
+        {
+            if (i >= 16)
+            {
+                t0 = w[(i - 15) & 15];
+                t1 = w[(i - 2) & 15];
+                t0 = _mm256_xor_si256(_mm256_xor_si256(U_SHA256_AVX2_ROR(t0, 7), U_SHA256_AVX2_ROR(t0, 18)),
+                                      _mm256_srli_epi32(t0, 3));
+                t1 = _mm256_xor_si256(_mm256_xor_si256(U_SHA256_AVX2_ROR(t1, 17), U_SHA256_AVX2_ROR(t1, 19)),
+                                      _mm256_srli_epi32(t1, 10));
+                w[i & 15] = _mm256_add_epi32(_mm256_add_epi32(w[i & 15], t0),
+                                             _mm256_add_epi32(w[(i - 7) & 15], t1));
+            }
+
+            /* t0 = h + S1(e) + ch(e, f, g) + k + w */
+            t0 = _mm256_xor_si256(_mm256_xor_si256(U_SHA256_AVX2_ROR(v[4], 6), U_SHA256_AVX2_ROR(v[4], 11)),
+                                  U_SHA256_AVX2_ROR(v[4], 25));
+            t0 = _mm256_add_epi32(_mm256_add_epi32(v[7], t0),
+                                  _mm256_xor_si256(v[6], _mm256_and_si256(v[4], _mm256_xor_si256(v[5], v[6]))));
+            t0 = _mm256_add_epi32(t0, _mm256_add_epi32(_mm256_set1_epi32((int)u_sha256_k[i]), w[i & 15]));
+
+            /* t1 = S0(a) + maj(a, b, c) */
+            t1 = _mm256_xor_si256(_mm256_xor_si256(U_SHA256_AVX2_ROR(v[0], 2), U_SHA256_AVX2_ROR(v[0], 13)),
+                                  U_SHA256_AVX2_ROR(v[0], 22));
+            t1 = _mm256_add_epi32(t1, _mm256_or_si256(_mm256_and_si256(v[0], v[1]),
+                                                      _mm256_and_si256(v[2], _mm256_or_si256(v[0], v[1]))));
+
+            v[7] = v[6]; v[6] = v[5]; v[5] = v[4];
+            v[4] = _mm256_add_epi32(v[3], t0);
+            v[3] = v[2]; v[2] = v[1]; v[1] = v[0];
+            v[0] = _mm256_add_epi32(t0, t1);
+        }
+
+        for (i = 0; i < 8; i++)
+            s[i] = _mm256_add_epi32(s[i], v[i]);
+    }
+
+    for (i = 0; i < 8; i++)
+        _mm256_storeu_si256((__m256i*)&state[i * 8], s[i]);
+}
+
+/* 16 lanes with AVX-512, the message words are transposed in two halves of 8 lanes */
+U_SHA256_AVX512_TARGET
+static void u_sha256_multi_avx512(u32 *state, const u8 **data, unsigned long count)
+{
+    unsigned i;
+    unsigned long block;
+    __m512i s[8];
+    __m512i v[8];
+    __m512i w[16];
+    __m512i t0;
+    __m512i t1;
+    __m256i lo[16];
+    __m256i hi[16];
+
+    for (i = 0; i < 8; i++)
+        s[i] = _mm512_loadu_si512((const void*)&state[i * 16]);
+
+    for (block = 0; block < count; block++)
+    {
+        u_sha256_load8x8(&lo[0], &data[0], block * U_SHA256_BLOCK_SIZE);
+        u_sha256_load8x8(&lo[8], &data[0], block * U_SHA256_BLOCK_SIZE + 32);
+        u_sha256_load8x8(&hi[0], &data[8], block * U_SHA256_BLOCK_SIZE);
+        u_sha256_load8x8(&hi[8], &data[8], block * U_SHA256_BLOCK_SIZE + 32);
+
+        for (i = 0; i < 16; i++)
+            w[i] = _mm512_inserti64x4(_mm512_castsi256_si512(lo[i]), hi[i], 1);
+
+        for (i = 0; i < 8; i++)
+            v[i] = s[i];
+
+        for (i = 0; i < 64; i++)
+        {
+            if (i >= 16)
+            {
+                t0 = w[(i - 15) & 15];
+                t1 = w[(i - 2) & 15];
+                t0 = _mm512_ternarylogic_epi32(_mm512_ror_epi32(t0, 7), _mm512_ror_epi32(t0, 18),
+                                               _mm512_srli_epi32(t0, 3), 0x96);
+                t1 = _mm512_ternarylogic_epi32(_mm512_ror_epi32(t1, 17), _mm512_ror_epi32(t1, 19),
+                                               _mm512_srli_epi32(t1, 10), 0x96);
+                w[i & 15] = _mm512_add_epi32(_mm512_add_epi32(w[i & 15], t0),
+                                             _mm512_add_epi32(w[(i - 7) & 15], t1));
+            }
+
+            /* 0x96: a ^ b ^ c, 0xCA: a ? b : c (ch), 0xE8: majority */
+            t0 = _mm512_ternarylogic_epi32(_mm512_ror_epi32(v[4], 6), _mm512_ror_epi32(v[4], 11),
+                                           _mm512_ror_epi32(v[4], 25), 0x96);
+            t0 = _mm512_add_epi32(_mm512_add_epi32(v[7], t0), _mm512_ternarylogic_epi32(v[4], v[5], v[6], 0xCA));
+            t0 = _mm512_add_epi32(t0, _mm512_add_epi32(_mm512_set1_epi32((int)u_sha256_k[i]), w[i & 15]));
+
+            t1 = _mm512_ternarylogic_epi32(_mm512_ror_epi32(v[0], 2), _mm512_ror_epi32(v[0], 13),
+                                           _mm512_ror_epi32(v[0], 22), 0x96);
+            t1 = _mm512_add_epi32(t1, _mm512_ternarylogic_epi32(v[0], v[1], v[2], 0xE8));
+
+            v[7] = v[6]; v[6] = v[5]; v[5] = v[4];
+            v[4] = _mm512_add_epi32(v[3], t0);
+            v[3] = v[2]; v[2] = v[1]; v[1] = v[0];
+            v[0] = _mm512_add_epi32(t0, t1);
+        }
+
+        for (i = 0; i < 8; i++)
+            s[i] = _mm512_add_epi32(s[i], v[i]);
+    }
+
+    for (i = 0; i < 8; i++)
+        _mm512_storeu_si512((void*)&state[i * 16], s[i]);
+}
+
+static unsigned u_sha256_xgetbv(void)
+{
+#ifdef _MSC_VER
+    return (unsigned)_xgetbv(0);
+#else
+    unsigned a, d;
+
+    __asm__ volatile ("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return a;
+#endif
+}
+
+/* Lane count of the best multi-buffer engine, 0 if there is none */
+static unsigned u_sha256_multi_lanes(void)
+{
+    unsigned regs[4];
+    unsigned xcr0;
+
+    u_sha256_cpuid(1, regs);
+    if ((regs[2] & (1 << 27)) == 0) /* OSXSAVE */
+        return 0;
+
+    xcr0 = u_sha256_xgetbv();
+    if ((xcr0 & 0x06) != 0x06) /* SSE, AVX state */
+        return 0;
+
+    u_sha256_cpuid(7, regs);
+    if ((regs[1] & (1 << 16)) && (regs[1] & (1 << 5)) && (xcr0 & 0xE0) == 0xE0) /* AVX-512F, AVX2, ZMM state */
+        return 16;
+
+    /* 8 lanes of AVX2 are slower than SHA-NI on one message */
+    if ((regs[1] & (1 << 5)) && u_sha256_compress != u_sha256_compress_x86)
+        return 8;
+
+    return 0;
+}
+
+#endif /* U_SHA256_X86 */
+
+
+static u_sha256_multi_func u_sha256_multi;
+static unsigned u_sha256_lanes;
+
+static void u_sha256_select(void)
+{
+    u_sha256_compress = u_sha256_compress_c;
+#if defined(U_SHA256_X86) || defined(U_SHA256_ARM)
+    if (u_sha256_has_hw())
+        u_sha256_compress = u_sha256_compress_hw;
+#endif
+
+#ifdef U_SHA256_X86
+    u_sha256_lanes = u_sha256_multi_lanes();
+    if (u_sha256_lanes == 16)
+        u_sha256_multi = u_sha256_multi_avx512;
+    else if (u_sha256_lanes == 8)
+        u_sha256_multi = u_sha256_multi_avx2;
+#endif
+}
+
+const char *U_sha256_impl(void)
+{
+    if (!u_sha256_compress)
+        u_sha256_select();
+
+#ifdef U_SHA256_X86
+    if (u_sha256_compress == u_sha256_compress_hw)
+        return "x86 SHA-NI";
+#endif
+#ifdef U_SHA256_ARM
+    if (u_sha256_compress == u_sha256_compress_hw)
+        return "ARMv8 crypto";
+#endif
+    return "portable";
+}
+
+void U_sha256_init(U_Sha256 *ctx)
+{
+    if (!u_sha256_compress)
+        u_sha256_select();
+
+    ctx->state[0] = 0x6a09e667;
+    ctx->state[1] = 0xbb67ae85;
+    ctx->state[2] = 0x3c6ef372;
+    ctx->state[3] = 0xa54ff53a;
+    ctx->state[4] = 0x510e527f;
+    ctx->state[5] = 0x9b05688c;
+    ctx->state[6] = 0x1f83d9ab;
+    ctx->state[7] = 0x5be0cd19;
+    ctx->length_lo = 0;
+    ctx->length_hi = 0;
+    ctx->buf_len = 0;
+}
+
+void U_sha256_update(U_Sha256 *ctx, const void *data, unsigned long size)
+{
+    unsigned n;
+    const u8 *p;
+
+    p = data;
+    ctx->length_lo += (u32)size;
+    if (ctx->length_lo < (u32)size)
+        ctx->length_hi++;
+    ctx->length_hi += (u32)((size >> 16) >> 16);
+
+    /* fill a partial block first */
+    if (ctx->buf_len)
+    {
+        n = U_SHA256_BLOCK_SIZE - ctx->buf_len;
+        if (n > size)
+            n = (unsigned)size;
+
+        U_memcpy(&ctx->buf[ctx->buf_len], p, n);
+        ctx->buf_len += n;
+        p += n;
+        size -= n;
+
+        if (ctx->buf_len < U_SHA256_BLOCK_SIZE)
+            return;
+
+        u_sha256_compress(ctx->state, ctx->buf, 1);
+        ctx->buf_len = 0;
+    }
+
+    /* whole blocks directly from the input */
+    if (size >= U_SHA256_BLOCK_SIZE)
+    {
+        u_sha256_compress(ctx->state, p, size / U_SHA256_BLOCK_SIZE);
+        p += size & ~(unsigned long)(U_SHA256_BLOCK_SIZE - 1);
+        size &= U_SHA256_BLOCK_SIZE - 1;
+    }
+
+    if (size)
+    {
+        U_memcpy(ctx->buf, p, (unsigned)size);
+        ctx->buf_len = (unsigned)size;
+    }
+}
+
+void U_sha256_final(U_Sha256 *ctx, u8 *digest)
+{
+    unsigned i;
+
+    /* padding: 0x80, zeros, 64-bit message length in bits */
+    ctx->buf[ctx->buf_len++] = 0x80;
+
+    if (ctx->buf_len > U_SHA256_BLOCK_SIZE - 8)
+    {
+        U_bzero(&ctx->buf[ctx->buf_len], U_SHA256_BLOCK_SIZE - ctx->buf_len);
+        u_sha256_compress(ctx->state, ctx->buf, 1);
+        ctx->buf_len = 0;
+    }
+
+    U_bzero(&ctx->buf[ctx->buf_len], U_SHA256_BLOCK_SIZE - 8 - ctx->buf_len);
+    u_sha256_store32(&ctx->buf[56], ctx->length_hi << 3 | ctx->length_lo >> 29);
+    u_sha256_store32(&ctx->buf[60], ctx->length_lo << 3);
+    u_sha256_compress(ctx->state, ctx->buf, 1);
+
+    for (i = 0; i < 8; i++)
+        u_sha256_store32(&digest[i * 4], ctx->state[i]);
+}
+
+void U_sha256(const void *data, unsigned long size, u8 *digest)
+{
+    U_Sha256 ctx;
+
+    U_sha256_init(&ctx);
+    U_sha256_update(&ctx, data, size);
+    U_sha256_final(&ctx, digest);
+}
+
+/* Message of a multi-buffer lane */
+typedef struct
+{
+    const u8 *data;         /* next block */
+    unsigned long blocks;   /* blocks left at data */
+    unsigned tail_blocks;   /* padding blocks in tail, processed after data */
+    unsigned msg;           /* message index */
+    u8 tail[2 * U_SHA256_BLOCK_SIZE];
+} u_sha256_lane;
+
+static void u_sha256_lane_start(u_sha256_lane *lane, u32 *state, unsigned lanes, unsigned l,
+                                unsigned msg, const u8 *data, unsigned long size)
+{
+    unsigned i;
+    unsigned rem;
+    unsigned long full;
+    U_Sha256 iv;
+
+    U_sha256_init(&iv);
+    for (i = 0; i < 8; i++)
+        state[i * lanes + l] = iv.state[i];
+
+    /* the last partial block and the padding are built in 'tail' */
+    full = size / U_SHA256_BLOCK_SIZE;
+    rem = (unsigned)(size % U_SHA256_BLOCK_SIZE);
+    lane->tail_blocks = rem + 9 > U_SHA256_BLOCK_SIZE ? 2 : 1;
+
+    U_bzero(lane->tail, sizeof(lane->tail));
+    U_memcpy(lane->tail, &data[full * U_SHA256_BLOCK_SIZE], rem);
+    lane->tail[rem] = 0x80;
+    rem = lane->tail_blocks * U_SHA256_BLOCK_SIZE;
+    u_sha256_store32(&lane->tail[rem - 8], (u32)((size >> 16) >> 13));
+    u_sha256_store32(&lane->tail[rem - 4], (u32)(size << 3));
+
+    lane->msg = msg;
+    lane->data = data;
+    lane->blocks = full;
+
+    if (full == 0)
+    {
+        lane->data = lane->tail;
+        lane->blocks = lane->tail_blocks;
+        lane->tail_blocks = 0;
+    }
+}
+
+void U_sha256_multi(const void *const *data, const unsigned long *size, unsigned count, u8 *digests)
+{
+    unsigned i;
+    unsigned l;
+    unsigned next;
+    unsigned active;
+    unsigned long n;
+    u32 state[8 * U_SHA256_MULTI_MAX_LANES];
+    const u8 *ptr[U_SHA256_MULTI_MAX_LANES];
+    u_sha256_lane lanes[U_SHA256_MULTI_MAX_LANES];
+
+    if (!u_sha256_compress)
+        u_sha256_select();
+
+    /* too few messages to fill the lanes */
+    if (u_sha256_lanes == 0 || count < u_sha256_lanes / 2)
+    {
+        for (i = 0; i < count; i++)
+            U_sha256(data[i], size[i], &digests[i * U_SHA256_DIGEST_SIZE]);
+        return;
+    }
+
+    next = 0;
+    active = 0;
+    for (l = 0; l < u_sha256_lanes; l++)
+    {
+        lanes[l].msg = count; /* idle */
+        if (next < count)
+        {
+            u_sha256_lane_start(&lanes[l], state, u_sha256_lanes, l, next, data[next], size[next]);
+            next++;
+            active++;
+        }
+    }
+
+    while (active)
+    {
+        /* run all lanes until the first one reaches the end of its data */
+        n = ~0UL;
+        for (l = 0; l < u_sha256_lanes; l++)
+        {
+            if (lanes[l].msg < count && lanes[l].blocks < n)
+                n = lanes[l].blocks;
+        }
+
+        for (l = 0; l < u_sha256_lanes; l++)
+        {
+            if (lanes[l].msg < count)
+                ptr[l] = lanes[l].data;
+        }
+
+        /* idle lanes hash a copy of an active lane, the result is ignored */
+        for (l = 0; l < u_sha256_lanes; l++)
+        {
+            if (lanes[l].msg == count)
+            {
+                for (i = 0; lanes[i].msg == count; i++)
+                    ;
+                ptr[l] = lanes[i].data;
+            }
+        }
+
+        u_sha256_multi(state, ptr, n);
+
+        for (l = 0; l < u_sha256_lanes; l++)
+        {
+            if (lanes[l].msg == count)
+                continue;
+
+            lanes[l].data += n * U_SHA256_BLOCK_SIZE;
+            lanes[l].blocks -= n;
+
+            if (lanes[l].blocks)
+                continue;
+
+            if (lanes[l].tail_blocks)
+            {
+                lanes[l].data = lanes[l].tail;
+                lanes[l].blocks = lanes[l].tail_blocks;
+                lanes[l].tail_blocks = 0;
+                continue;
+            }
+
+            for (i = 0; i < 8; i++)
+                u_sha256_store32(&digests[lanes[l].msg * U_SHA256_DIGEST_SIZE + i * 4], state[i * u_sha256_lanes + l]);
+
+            if (next < count)
+            {
+                u_sha256_lane_start(&lanes[l], state, u_sha256_lanes, l, next, data[next], size[next]);
+                next++;
+            }
+            else
+            {
+                lanes[l].msg = count;
+                active--;
+            }
+        }
+    }
+}
+
+unsigned U_sha256_multi_lanes(void)
+{
+    if (!u_sha256_compress)
+        u_sha256_select();
+
+    return u_sha256_lanes;
+}
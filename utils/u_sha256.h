@@ -0,0 +1,48 @@
+#ifndef U_SHA256_H
+#define U_SHA256_H
+
+/* SHA-256 (FIPS 180-4) with streaming interface.
+
+   Data can be fed in pieces of any size by U_sha256_update(), the result
+   is the same as hashing the concatenated data at once. The context has
+   no pointers and can be copied, e.g. to hash a common prefix only once.
+
+   The SHA instructions of x86 (SHA-NI) and ARMv8 are used if the CPU
+   supports them, otherwise the portable C version.
+*/
+
+#define U_SHA256_BLOCK_SIZE  64
+#define U_SHA256_DIGEST_SIZE 32
+#define U_SHA256_MULTI_MAX_LANES 16
+
+typedef struct U_Sha256
+{
+    u32 state[8];
+    u32 length_lo;  /* message length in bytes */
+    u32 length_hi;
+    unsigned buf_len;
+    u8 buf[U_SHA256_BLOCK_SIZE];
+} U_Sha256;
+
+void U_sha256_init(U_Sha256 *ctx);
+void U_sha256_update(U_Sha256 *ctx, const void *data, unsigned long size);
+void U_sha256_final(U_Sha256 *ctx, u8 *digest);
+
+/* One-shot hash of a buffer. */
+void U_sha256(const void *data, unsigned long size, u8 *digest);
+
+/* Name of the implementation selected for this CPU: "x86 SHA-NI",
+   "ARMv8 crypto" or "portable". */
+const char *U_sha256_impl(void);
+
+/* Hashes 'count' independent messages, the digest of message i is written
+   to digests[i * 32]. With AVX2 or AVX-512 the messages are hashed in
+   parallel SIMD lanes, otherwise one after another.
+*/
+void U_sha256_multi(const void *const *data, const unsigned long *size, unsigned count, u8 *digests);
+
+/* Number of messages U_sha256_multi() hashes in parallel, 0 if it uses
+   the single message implementation. */
+unsigned U_sha256_multi_lanes(void);
+
+#endif /* U_SHA256_H */
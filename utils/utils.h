@@ -8,6 +8,14 @@
 
 #define U_ARRAY_SIZE(a) (sizeof(a) / sizeof(a[0]))
 
+#if _MSC_VER
+  #define U_THREAD_LOCAL __declspec(thread)
+#elif __GNUC__
+  #define U_THREAD_LOCAL __thread
+#else
+  #define U_THREAD_LOCAL
+#endif
+
 /* dynamic buffer */
 typedef struct U_buffer
 {
@@ -61,6 +69,61 @@ int PL_DeleteFile(const char *path);
 int PL_MakeDirectory(const char *path);
 int PL_StatFile(const char *path, PL_Stat *st);
 
+/* Open file for streamed writes at the end and positioned writes
+   to already written parts (backpatching). */
+typedef struct PL_File
+{
+#ifdef _WIN32
+    void *handle;
+#else
+    int fd;
+#endif
+} PL_File;
+
+#define PL_FILE_READ  1
+#define PL_FILE_WRITE 2 /* create or truncate */
+#define PL_FILE_UPDATE 3 /* write to existing file */
+
+int PL_FileOpen(PL_File *file, const char *path, unsigned mode);
+int PL_FileWrite(PL_File *file, const void *buf, unsigned long size);
+int PL_FileWriteAt(PL_File *file, unsigned long offset, const void *buf, unsigned long size);
+
+/* part of a gathered write */
+typedef struct PL_IoVec
+{
+    const void *data;
+    unsigned long size;
+} PL_IoVec;
+
+int PL_FileWriteV(PL_File *file, const PL_IoVec *iov, unsigned count);
+void PL_FileClose(PL_File *file);
+
+/* Read-only view of a whole file. The file is memory mapped if possible,
+   otherwise it is read into heap memory. */
+typedef struct PL_MappedFile
+{
+    const unsigned char *data;
+    unsigned long size;
+    int mapped; /* 0 when data is a heap copy */
+} PL_MappedFile;
+
+int PL_MapFile(PL_MappedFile *mf, const char *path);
+void PL_UnmapFile(PL_MappedFile *mf);
+
+/* Called for each entry of a directory, except "." and "..". */
+typedef void (*PL_DirCallback)(void *user, const char *name, int is_dir);
+int PL_ListDirectory(const char *path, PL_DirCallback cb, void *user);
+
+/* threads */
+
+typedef struct PL_Thread PL_Thread;
+typedef void (*PL_ThreadFunc)(void *arg);
+
+PL_Thread *PL_CreateThread(PL_ThreadFunc fn, void *arg);
+void PL_JoinThread(PL_Thread *thread);
+unsigned PL_CpuCount(void);
+long PL_AtomicIncrement(volatile long *value);
+
 void U_Printf(const char *format, ...);
 void U_Write(const char *str, unsigned len);
 
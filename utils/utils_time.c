@@ -51,7 +51,11 @@ int U_TimeToISO8601_UTC(U_time time, void *buf, unsigned len)
 
     errno = 0;
 
-    mt = gmtime(&t);
+#ifdef PL_POSIX
+    mt = gmtime_r(&t, &tmt);
+#else
+    mt = gmtime(&t); /* MSVC uses thread local storage */
+#endif
     if (!mt || errno)
         return 0;
     tmt = *mt;